@@ -0,0 +1,104 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Two wired controllers change the AC unit at the same time: the protocol
+// handler and a simulated remote sharing the bus. Reports bus cycles until
+// the unit settles, writes that reverted the other controller's change and
+// whose change survived, with and without yielding to the remote.
+
+#include <memory>
+
+#include "benchmark/benchmark.h"
+#include "protocol/fuji_ac_protocol_handler.h"
+#include "protocol/fuji_ac_state.h"
+#include "sim/fuji_ac_bus_sim.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+// Unit is considered settled after this many cycles without a change.
+constexpr int kQuietCycles = 5;
+// Gives up on runs that never settle.
+constexpr int kMaxCycles = 100;
+
+enum Scenario { DIFFERENT_FIELDS = 0, SAME_FIELD = 1 };
+
+// Args: scenario, 1 if the handler yields to the remote, 1 if the remote
+// is polled before the handler within a cycle.
+void BM_Coexistence(benchmark::State &state) {
+  const Scenario scenario = static_cast<Scenario>(state.range(0));
+  const bool yield = state.range(1) != 0;
+  const bool foreign_first = state.range(2) != 0;
+  int64_t cycles = 0, collisions = 0, writes = 0, ours_kept = 0,
+          foreign_kept = 0;
+  for (auto _ : state) {
+    sim::FujiAcUnitSim unit;
+    sim::FujiForeignControllerSim foreign;
+    FujiAcState *ac_state = new FujiAcState();
+    FujiAcProtocolHandler handler(std::unique_ptr<FujiAcState>(ac_state),
+                                  yield);
+    sim::FujiAcBusSim bus(&unit, &foreign, foreign_first);
+    unit.SetEnabled(true);
+    unit.SetFan(fan_t::LOW);
+    unit.SetTemperature(22);
+    // Login and first status.
+    for (int i = 0; i < kQuietCycles; ++i) bus.Cycle(&handler);
+    const uint64_t start_cycle = bus.Cycles();
+    const uint64_t start_writes = bus.Writes() + bus.ForeignWrites();
+
+    ac_state->SetTemperature(25);
+    if (scenario == SAME_FIELD) {
+      foreign.SetTemperature(19);
+    } else {
+      foreign.SetFan(fan_t::HIGH);
+    }
+    uint64_t last_change = start_cycle;
+    while (bus.Cycles() - last_change < kQuietCycles &&
+           bus.Cycles() - start_cycle < kMaxCycles) {
+      const uint8_t temp = unit.Temperature();
+      const fan_t fan = unit.Fan();
+      bus.Cycle(&handler);
+      if (temp != unit.Temperature() || fan != unit.Fan()) {
+        last_change = bus.Cycles();
+      }
+    }
+    cycles += last_change - start_cycle;
+    collisions += bus.Collisions();
+    writes += bus.Writes() + bus.ForeignWrites() - start_writes;
+    ours_kept += unit.Temperature() == 25;
+    foreign_kept += scenario == SAME_FIELD ? unit.Temperature() == 19
+                                           : unit.Fan() == fan_t::HIGH;
+  }
+  state.counters["convergence_cycles"] =
+      benchmark::Counter(cycles, benchmark::Counter::kAvgIterations);
+  state.counters["collisions"] =
+      benchmark::Counter(collisions, benchmark::Counter::kAvgIterations);
+  state.counters["writes"] =
+      benchmark::Counter(writes, benchmark::Counter::kAvgIterations);
+  state.counters["ours_kept"] =
+      benchmark::Counter(ours_kept, benchmark::Counter::kAvgIterations);
+  state.counters["foreign_kept"] =
+      benchmark::Counter(foreign_kept, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_Coexistence)
+    ->ArgNames({"same_field", "yield", "foreign_first"})
+    ->ArgsProduct({{DIFFERENT_FIELDS, SAME_FIELD}, {0, 1}, {0, 1}});
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+BENCHMARK_MAIN();
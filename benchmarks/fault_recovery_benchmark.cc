@@ -0,0 +1,85 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Recovery of the daemon from faults on the simulated bus, one class of
+// faults at a time (sim/fuji_ac_faulty_serial.h). Reports master frames and
+// time from the last frame affected by a fault until the bus converged
+// again, and controller writes made meanwhile, averaged per fault.
+
+#include <memory>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "controller/fuji_ac_controller.h"
+#include "sim/fuji_ac_faulty_serial.h"
+#include "sim/fuji_ac_sim_serial.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+// Master frame interval of the simulated unit.
+constexpr absl::Duration kFrameInterval = absl::Milliseconds(1);
+// Faults injected per benchmark iteration.
+constexpr uint64_t kFaults = 20;
+
+// Arg: sim::FaultClass.
+void BM_FaultRecovery(benchmark::State &state) {
+  const sim::FaultClass fault = static_cast<sim::FaultClass>(state.range(0));
+  state.SetLabel(sim::FaultClassName(fault));
+  sim::FaultOptions options;
+  options.probability[state.range(0)] = 0.1;
+  sim::FaultClassStats total;
+  for (auto _ : state) {
+    sim::FujiAcSimSerial sim(kFrameInterval);
+    sim::FujiAcFaultySerial serial(&sim, options);
+    std::unique_ptr<FujiAcController> controller =
+        FujiAcController::MakeFujiAcController(&serial);
+    sim::FaultClassStats stats;
+    absl::Time deadline = absl::Now() + absl::Seconds(30);
+    while (stats.recovered < kFaults && absl::Now() < deadline) {
+      absl::SleepFor(absl::Milliseconds(10));
+      stats = serial.Stats(fault);
+    }
+    controller->Shutdown();
+    total.injected += stats.injected;
+    total.recovered += stats.recovered;
+    total.unrecovered += stats.unrecovered;
+    total.recovery_frames += stats.recovery_frames;
+    total.recovery_time += stats.recovery_time;
+    total.extra_writes += stats.extra_writes;
+    if (stats.max_recovery_frames > total.max_recovery_frames) {
+      total.max_recovery_frames = stats.max_recovery_frames;
+    }
+  }
+  const double recovered = total.recovered > 0 ? total.recovered : 1;
+  state.counters["unrecovered"] = total.unrecovered;
+  state.counters["recovery_frames"] = total.recovery_frames / recovered;
+  state.counters["max_recovery_frames"] = total.max_recovery_frames;
+  state.counters["recovery_ms"] =
+      absl::ToDoubleMilliseconds(total.recovery_time) / recovered;
+  state.counters["extra_writes"] = total.extra_writes / recovered;
+}
+BENCHMARK(BM_FaultRecovery)
+    ->ArgName("fault")
+    ->DenseRange(0, sim::kFaultClasses - 1)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+BENCHMARK_MAIN();
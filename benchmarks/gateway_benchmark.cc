@@ -0,0 +1,171 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Client-visible latency of a house with several units behind the gateway:
+// GetStatus answered by the daemon versus by the gateway cache, and a scene
+// changing every unit issued as sequential Update calls versus a single
+// UpdateMany. Daemons run simulated units with a shortened bus cycle and are
+// reached over in-process channels.
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "controller/fuji_ac_controller.grpc.pb.h"
+#include "controller/fuji_ac_service.h"
+#include "gateway/fuji_ac_gateway.h"
+#include "grpcpp/grpcpp.h"
+#include "sim/fuji_ac_sim_serial.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+// Master frame interval of simulated units.
+constexpr absl::Duration kFrameInterval = absl::Milliseconds(10);
+
+// Daemons for the given number of units and a gateway in front of them.
+class House {
+ public:
+  explicit House(int units) {
+    std::map<std::string, std::shared_ptr<grpc::ChannelInterface>> channels;
+    for (int i = 0; i < units; i++) {
+      std::string unit = absl::StrCat("unit", i);
+      services_.emplace_back(new FujiACControllerServiceImpl(
+          std::unique_ptr<FujiAcSerialInterface>(
+              new sim::FujiAcSimSerial(kFrameInterval)),
+          FujiAcControllerOptions()));
+      grpc::ServerBuilder builder;
+      builder.RegisterService(services_.back().get());
+      servers_.push_back(builder.BuildAndStart());
+      channels[unit] = servers_.back()->InProcessChannel(grpc::ChannelArguments());
+      units_.push_back(unit);
+    }
+    daemon_ = proto::FujiACControllerService::NewStub(channels[units_[0]]);
+    gateway_.reset(new gateway::FujiAcGateway(channels));
+    grpc::ServerBuilder builder;
+    builder.RegisterService(gateway_.get());
+    gateway_server_ = builder.BuildAndStart();
+    stub_ = proto::FujiACControllerService::NewStub(
+        gateway_server_->InProcessChannel(grpc::ChannelArguments()));
+    // Wait for the cache to fill.
+    proto::GetStatusManyResponse response;
+    do {
+      grpc::ClientContext context;
+      response.Clear();
+      stub_->GetStatusMany(&context, proto::GetStatusManyRequest(), &response);
+    } while (gateway_->Stats().cache_hits < units_.size());
+  }
+
+  ~House() {
+    gateway_server_->Shutdown();
+    gateway_.reset();
+    for (auto &server : servers_) {
+      server->Shutdown();
+    }
+  }
+
+  const std::vector<std::string> &units() const { return units_; }
+  // Talks to the gateway.
+  proto::FujiACControllerService::Stub *stub() { return stub_.get(); }
+  // Talks directly to the daemon of the first unit.
+  proto::FujiACControllerService::Stub *daemon() { return daemon_.get(); }
+
+ private:
+  std::vector<std::string> units_;
+  std::vector<std::unique_ptr<FujiACControllerServiceImpl>> services_;
+  std::vector<std::unique_ptr<grpc::Server>> servers_;
+  std::unique_ptr<gateway::FujiAcGateway> gateway_;
+  std::unique_ptr<grpc::Server> gateway_server_;
+  std::unique_ptr<proto::FujiACControllerService::Stub> stub_;
+  std::unique_ptr<proto::FujiACControllerService::Stub> daemon_;
+};
+
+// Arg: 0 asks the daemon, 1 asks the gateway.
+void BM_GetStatus(benchmark::State &state) {
+  House house(1);
+  auto stub = state.range(0) ? house.stub() : house.daemon();
+  for (auto _ : state) {
+    grpc::ClientContext context;
+    proto::StatusResponse response;
+    if (!stub->GetStatus(&context, proto::StatusRequest(), &response).ok()) {
+      state.SkipWithError("GetStatus failed");
+      break;
+    }
+  }
+}
+BENCHMARK(BM_GetStatus)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// Alternates every unit between two modes. Arg: number of units.
+void BM_SceneSequentialUpdates(benchmark::State &state) {
+  House house(state.range(0));
+  bool heat = false;
+  for (auto _ : state) {
+    heat = !heat;
+    for (const std::string &unit : house.units()) {
+      grpc::ClientContext context;
+      proto::UpdateRequest request;
+      request.set_unit(unit);
+      request.mutable_new_state()->set_mode(heat ? proto::MODE_HEAT
+                                                 : proto::MODE_COOL);
+      proto::StatusResponse response;
+      if (!house.stub()->Update(&context, request, &response).ok()) {
+        state.SkipWithError("Update failed");
+        return;
+      }
+    }
+  }
+}
+BENCHMARK(BM_SceneSequentialUpdates)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+void BM_SceneUpdateMany(benchmark::State &state) {
+  House house(state.range(0));
+  bool heat = false;
+  for (auto _ : state) {
+    heat = !heat;
+    grpc::ClientContext context;
+    proto::UpdateManyRequest request;
+    for (const std::string &unit : house.units()) {
+      proto::UpdateRequest *update = request.add_updates();
+      update->set_unit(unit);
+      update->mutable_new_state()->set_mode(heat ? proto::MODE_HEAT
+                                                 : proto::MODE_COOL);
+    }
+    proto::UpdateManyResponse response;
+    if (!house.stub()->UpdateMany(&context, request, &response).ok()) {
+      state.SkipWithError("UpdateMany failed");
+      return;
+    }
+  }
+}
+BENCHMARK(BM_SceneUpdateMany)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+BENCHMARK_MAIN();
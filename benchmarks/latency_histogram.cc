@@ -0,0 +1,69 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmarks/latency_histogram.h"
+
+#include <algorithm>
+#include <map>
+
+#include "absl/strings/str_format.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+
+void LatencyHistogram::Record(absl::Duration sample) {
+  samples_.push_back(sample);
+  sorted_ = false;
+}
+
+size_t LatencyHistogram::Count() const { return samples_.size(); }
+
+absl::Duration LatencyHistogram::Percentile(double percentile) const {
+  if (samples_.empty()) return absl::ZeroDuration();
+  if (!sorted_) {
+    std::sort(samples_.begin(), samples_.end());
+    sorted_ = true;
+  }
+  size_t index = static_cast<size_t>(percentile / 100 * (samples_.size() - 1));
+  return samples_[index];
+}
+
+void LatencyHistogram::Report(benchmark::State &state) const {
+  state.counters["p50_us"] = absl::ToDoubleMicroseconds(Percentile(50));
+  state.counters["p90_us"] = absl::ToDoubleMicroseconds(Percentile(90));
+  state.counters["p99_us"] = absl::ToDoubleMicroseconds(Percentile(99));
+  state.counters["p999_us"] = absl::ToDoubleMicroseconds(Percentile(99.9));
+  state.counters["max_us"] = absl::ToDoubleMicroseconds(Percentile(100));
+}
+
+void LatencyHistogram::Print(const std::string &title,
+                             std::ostream &os) const {
+  std::map<int64_t, size_t> buckets;
+  for (absl::Duration sample : samples_) {
+    int64_t us = absl::ToInt64Microseconds(sample);
+    int64_t bucket = 1;
+    while (bucket <= us) bucket <<= 1;
+    buckets[bucket]++;
+  }
+  os << title << " (" << samples_.size() << " samples)\n";
+  for (const auto &bucket : buckets) {
+    double share = 100.0 * bucket.second / samples_.size();
+    os << absl::StrFormat("  < %8d us %8d %6.2f%% %s\n", bucket.first,
+                          bucket.second, share,
+                          std::string(static_cast<size_t>(share / 2), '#'));
+  }
+}
+
+}  // namespace benchmarks
+}  // namespace fuji_iot
@@ -0,0 +1,48 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+// Collects latency samples of a single benchmark run and reports them as
+// percentile counters and a log2-bucketed histogram.
+class LatencyHistogram {
+ public:
+  void Record(absl::Duration sample);
+  size_t Count() const;
+  // Returns the given percentile (0-100) of recorded samples.
+  absl::Duration Percentile(double percentile) const;
+  // Publishes p50/p90/p99/p999/max (in microseconds) as benchmark counters.
+  void Report(benchmark::State &state) const;
+  // Prints histogram with power-of-two microsecond buckets.
+  void Print(const std::string &title, std::ostream &os) const;
+
+ private:
+  mutable std::vector<absl::Duration> samples_;
+  mutable bool sorted_ = true;
+};
+
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+#endif
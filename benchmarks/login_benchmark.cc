@@ -0,0 +1,95 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Time from controller start until main unit first confirms it as the wired
+// controller, i.e. until status is usable:
+// - cold: no saved session, full login exchange;
+// - resumed: restart while main unit still lists us;
+// - fast login: saved session, but main unit has dropped us meanwhile.
+// Simulated unit sends one master frame every kFrameInterval.
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "controller/fuji_ac_controller.h"
+#include "sim/fuji_ac_sim_serial.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+constexpr absl::Duration kFrameInterval = absl::Milliseconds(10);
+
+enum Start { COLD = 0, RESUMED = 1, FAST_LOGIN = 2 };
+
+// Runs a controller until main unit has confirmed it.
+proto::SessionMetrics RunUntilConfirmed(sim::FujiAcSimSerial *serial,
+                                        const FujiAcControllerOptions &options) {
+  auto controller = FujiAcController::MakeFujiAcController(serial, options);
+  proto::SessionMetrics metrics;
+  do {
+    absl::SleepFor(kFrameInterval / 10);
+    metrics = controller->GetSessionMetrics();
+  } while (metrics.frames_to_first_status() == 0);
+  controller->Shutdown();
+  return metrics;
+}
+
+// Arg: Start.
+void BM_TimeToFirstStatus(benchmark::State &state) {
+  const Start start = static_cast<Start>(state.range(0));
+  FujiAcControllerOptions options;
+  options.session_file =
+      absl::StrCat("/tmp/fuji_login_benchmark.", getpid());
+  int64_t frames = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    unlink(options.session_file.c_str());
+    std::unique_ptr<sim::FujiAcSimSerial> serial(
+        new sim::FujiAcSimSerial(kFrameInterval));
+    if (start != COLD) {
+      // Previous run of the daemon leaves the session behind.
+      RunUntilConfirmed(serial.get(), options);
+    }
+    if (start == FAST_LOGIN) {
+      serial.reset(new sim::FujiAcSimSerial(kFrameInterval));
+    }
+    state.ResumeTiming();
+    proto::SessionMetrics metrics = RunUntilConfirmed(serial.get(), options);
+    state.SetIterationTime(metrics.time_to_first_status_ms() / 1000.0);
+    frames += metrics.frames_to_first_status();
+  }
+  unlink(options.session_file.c_str());
+  state.counters["frames_to_first_status"] =
+      benchmark::Counter(frames, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_TimeToFirstStatus)
+    ->ArgName("start")
+    ->Arg(COLD)
+    ->Arg(RESUMED)
+    ->Arg(FAST_LOGIN)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+BENCHMARK_MAIN();
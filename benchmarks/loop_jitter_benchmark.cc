@@ -0,0 +1,135 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures reply turnaround of the bus thread (master frame written ->
+// controller frame read back) with and without real-time scheduling, while
+// other threads keep every CPU busy. Benchmark thread plays the role of the
+// main unit and runs with higher SCHED_FIFO priority in both cases, so that
+// only scheduling of the bus thread differs.
+//
+// SCHED_FIFO requires privileges, run as:
+//   sudo bazel-bin/benchmarks/loop_jitter_benchmark
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "benchmark/benchmark.h"
+#include "benchmarks/latency_histogram.h"
+#include "benchmarks/pipe_bus.h"
+#include "controller/fuji_ac_controller.h"
+#include "controller/fuji_ac_realtime.h"
+#include "glog/logging.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+// Keeps given number of threads spinning until destroyed.
+class CpuLoad {
+ public:
+  explicit CpuLoad(int threads) {
+    for (int i = 0; i < threads; i++) {
+      threads_.emplace_back([this]() {
+        volatile uint64_t counter = 0;
+        while (!stop_) counter++;
+      });
+    }
+  }
+  ~CpuLoad() {
+    stop_ = true;
+    for (auto &t : threads_) t.join();
+  }
+
+ private:
+  std::atomic<bool> stop_{false};
+  std::vector<std::thread> threads_;
+};
+
+// Moves calling thread to SCHED_FIFO above the bus thread. Returns false if
+// this process may not use real-time scheduling.
+bool PromoteMasterThread() {
+  RealtimeOptions options;
+  options.enabled = true;
+  options.priority = 60;
+  options.lock_memory = false;
+  return ApplyRealtimeOptions(options).ok();
+}
+
+// Threads inherit scheduling policy, so the master thread has to be demoted
+// before the next benchmark creates its controller and load.
+void DemoteMasterThread() {
+  sched_param param = {};
+  pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+}
+
+// Args: realtime (0/1), number of load threads per CPU.
+void BM_ReplyTurnaround(benchmark::State &state) {
+  const bool realtime = state.range(0) != 0;
+  FujiAcControllerOptions options;
+  options.realtime.enabled = realtime;
+  options.realtime.cpu = realtime ? 0 : -1;
+
+  PipeBus bus;
+  sim::FujiAcUnitSim sim;
+  auto controller = FujiAcController::MakeFujiAcController(&bus, options);
+  CpuLoad load(state.range(1) * std::thread::hardware_concurrency());
+  if (!PromoteMasterThread()) {
+    controller->Shutdown();
+    state.SkipWithError("SCHED_FIFO not permitted, run with CAP_SYS_NICE");
+    return;
+  }
+
+  LatencyHistogram histogram;
+  for (auto _ : state) {
+    FujiMasterFrame mf = sim.GetNextMasterFrame();
+    absl::Time start = absl::Now();
+    bus.SendMasterFrame(mf);
+    auto cf = bus.AwaitControllerFrame(absl::Seconds(5));
+    absl::Duration turnaround = absl::Now() - start;
+    if (!cf.has_value()) {
+      state.SkipWithError("Controller did not reply");
+      break;
+    }
+    sim.PushControllerFrame(cf.value());
+    histogram.Record(turnaround);
+  }
+  DemoteMasterThread();
+  controller->Shutdown();
+  if (realtime) munlockall();
+
+  histogram.Report(state);
+  histogram.Print(absl::StrFormat("reply turnaround realtime=%d load=%d",
+                                  realtime, state.range(1)),
+                  std::cerr);
+}
+BENCHMARK(BM_ReplyTurnaround)
+    ->ArgsProduct({{0, 1}, {0, 2}})
+    ->Iterations(2000)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+BENCHMARK_MAIN();
@@ -0,0 +1,87 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmarks/pipe_bus.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "glog/logging.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+// Reads exactly 8 bytes unless nothing arrives within timeout.
+bool ReadFrame(int fd, std::array<uint8_t, 8> *data, absl::Duration timeout) {
+  size_t got = 0;
+  while (got < data->size()) {
+    pollfd pfd = {fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, absl::ToInt64Milliseconds(timeout));
+    if (ready < 0) PLOG(FATAL) << "poll failed";
+    if (ready == 0) return false;
+    ssize_t bytes = read(fd, data->data() + got, data->size() - got);
+    if (bytes <= 0) PLOG(FATAL) << "read failed";
+    got += bytes;
+  }
+  return true;
+}
+
+void WriteFrame(int fd, const std::array<uint8_t, 8> &data) {
+  if (write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+    PLOG(FATAL) << "write failed";
+  }
+}
+
+}  // namespace
+
+PipeBus::PipeBus() {
+  if (pipe(to_controller_) < 0 || pipe(to_master_) < 0) {
+    PLOG(FATAL) << "Failed to create pipes";
+  }
+}
+
+PipeBus::~PipeBus() {
+  for (int fd : {to_controller_[0], to_controller_[1], to_master_[0],
+                 to_master_[1]}) {
+    close(fd);
+  }
+}
+
+void PipeBus::WriteControllerFrame(const FujiControllerFrame &frame) {
+  WriteFrame(to_master_[1], frame.FullFrame());
+}
+
+absl::optional<FujiMasterFrame> PipeBus::ReadMasterFrame() {
+  std::array<uint8_t, 8> data;
+  // Short timeout lets the controller notice shutdown.
+  if (!ReadFrame(to_controller_[0], &data, absl::Milliseconds(50))) {
+    return absl::nullopt;
+  }
+  return FujiMasterFrame(data);
+}
+
+void PipeBus::SendMasterFrame(const FujiMasterFrame &frame) {
+  WriteFrame(to_controller_[1], frame.FullFrame());
+}
+
+absl::optional<FujiControllerFrame> PipeBus::AwaitControllerFrame(
+    absl::Duration timeout) {
+  std::array<uint8_t, 8> data;
+  if (!ReadFrame(to_master_[0], &data, timeout)) return absl::nullopt;
+  return FujiControllerFrame(data);
+}
+
+}  // namespace benchmarks
+}  // namespace fuji_iot
@@ -0,0 +1,51 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIPE_BUS_H_
+#define PIPE_BUS_H_
+
+#include <array>
+
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "controller/fuji_ac_serial_interface.h"
+#include "protocol/fuji_frame.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+// Serial interface backed by a pair of pipes. Controller side blocks in
+// read() just like it does on a tty, so wake-up latency of the bus thread is
+// part of what gets measured. Master side is driven by the benchmark.
+class PipeBus : public FujiAcSerialInterface {
+ public:
+  PipeBus();
+  ~PipeBus();
+  virtual void WriteControllerFrame(const FujiControllerFrame &frame) override;
+  virtual absl::optional<FujiMasterFrame> ReadMasterFrame() override;
+
+  // Master side of the bus.
+  void SendMasterFrame(const FujiMasterFrame &frame);
+  // Waits for controller reply. Returns nullopt on timeout.
+  absl::optional<FujiControllerFrame> AwaitControllerFrame(
+      absl::Duration timeout);
+
+ private:
+  int to_controller_[2];
+  int to_master_[2];
+};
+
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,71 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures time between master frame being handed to the protocol handler
+// and the reply being ready to write, with replies built on demand and
+// prepared during idle time.
+
+#include <chrono>
+#include <memory>
+
+#include "benchmark/benchmark.h"
+#include "protocol/fuji_ac_protocol_handler.h"
+#include "protocol/fuji_ac_state.h"
+#include "protocol/fuji_frame.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+// Steady state: main unit keeps polling STATUS register, nothing changes.
+// Arg: 1 if replies are prepared between master frames.
+void BM_HandleStatusFrame(benchmark::State &state) {
+  const bool prepare = state.range(0) != 0;
+  FujiAcProtocolHandler handler(
+      std::unique_ptr<FujiAcState>(new FujiAcState()));
+  const FujiMasterFrame status({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x01, 0x20});
+  const FujiMasterFrame login({0x00, 0xa0, 0x20, 0x1f, 0x1f, 0x05, 0x01, 0x00});
+  // Go through login sequence first.
+  handler.HandleMasterFrame(status);
+  handler.HandleMasterFrame(login);
+  for (auto _ : state) {
+    // Idle time is not part of the measurement.
+    if (prepare) handler.PrepareReplies();
+    auto start = std::chrono::steady_clock::now();
+    auto reply = handler.HandleMasterFrame(status);
+    benchmark::DoNotOptimize(reply);
+    state.SetIterationTime(std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count());
+  }
+}
+BENCHMARK(BM_HandleStatusFrame)->Arg(0)->Arg(1)->UseManualTime();
+
+// Cost of preparing replies when they are already up to date, paid on every
+// idle period.
+void BM_PrepareRepliesUpToDate(benchmark::State &state) {
+  FujiAcProtocolHandler handler(
+      std::unique_ptr<FujiAcState>(new FujiAcState()));
+  handler.PrepareReplies();
+  for (auto _ : state) {
+    handler.PrepareReplies();
+  }
+}
+BENCHMARK(BM_PrepareRepliesUpToDate);
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+BENCHMARK_MAIN();
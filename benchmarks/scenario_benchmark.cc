@@ -0,0 +1,80 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs scenario files given on the command line (sim/fuji_ac_scenario.h),
+// one benchmark each. Reports latency and rate of every operation of every
+// phase, as "<phase>/<op>_<stat>" counters, and failed expectations.
+//
+//   bazel run //benchmarks:scenario_benchmark -- path/to/a.scenario
+
+#include <iostream>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "sim/fuji_ac_scenario.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+void BM_Scenario(benchmark::State &state, const sim::Scenario &scenario) {
+  sim::ScenarioResult result;
+  size_t failures = 0;
+  for (auto _ : state) {
+    result = sim::RunScenario(scenario);
+    failures += result.failures.size();
+  }
+  for (const sim::PhaseResult &phase : result.phases) {
+    for (const auto &op : phase.ops) {
+      const std::string name = absl::StrCat(phase.name, "/", op.first);
+      const sim::OpStats &stats = op.second;
+      state.counters[name + "_rate"] = stats.rate;
+      state.counters[name + "_p50_ms"] = absl::ToDoubleMilliseconds(stats.p50);
+      state.counters[name + "_p99_ms"] = absl::ToDoubleMilliseconds(stats.p99);
+      state.counters[name + "_errors"] = stats.errors;
+    }
+  }
+  state.counters["failures"] = failures;
+  if (failures > 0) state.SkipWithError(result.failures[0].c_str());
+}
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <scenario>..." << std::endl;
+    return 1;
+  }
+  for (int i = 1; i < argc; ++i) {
+    fuji_iot::sim::Scenario scenario;
+    absl::Status status = fuji_iot::sim::LoadScenario(argv[i], &scenario);
+    if (!status.ok()) {
+      std::cerr << status << std::endl;
+      return 1;
+    }
+    benchmark::RegisterBenchmark(argv[i], fuji_iot::benchmarks::BM_Scenario,
+                                 scenario)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime()
+        ->Iterations(1);
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
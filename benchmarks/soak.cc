@@ -0,0 +1,301 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Soak run of the full daemon stack: gRPC service, controller and the
+// simulated unit in a heated room whose occupants use the IR remote
+// (sim/fuji_ac_room_sim.h), driven through months of simulated time while
+// clients keep calling the service. Process resources and call latencies
+// are sampled at fixed intervals of simulated time and written as CSV or
+// JSON, one sample per line, to compare releases. Exits with 1 if any of
+// them trends upwards by more than --max_drift.
+//
+//   bazel run -c opt //benchmarks:soak -- --days=90 --format=json
+
+#include <dirent.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "controller/fuji_ac_controller.grpc.pb.h"
+#include "controller/fuji_ac_malloc_hooks.h"
+#include "controller/fuji_ac_service.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "grpcpp/grpcpp.h"
+#include "sim/fuji_ac_room_sim.h"
+#include "sim/fuji_ac_sim_serial.h"
+
+DEFINE_int32(days, 90, "Simulated days to run");
+DEFINE_int32(sim_seconds_per_frame, 60,
+             "Simulated time per master frame of the unit");
+DEFINE_int32(frame_interval_us, 200, "Master frame interval of the unit");
+DEFINE_double(sample_every_days, 1, "Simulated days between samples");
+DEFINE_int32(clients, 4, "Concurrent clients calling the service");
+DEFINE_int32(client_interval_ms, 5, "Pause between calls of a client");
+DEFINE_int32(update_every, 10, "Every n-th call of a client is an Update");
+DEFINE_string(format, "csv", "Output format, csv or json");
+DEFINE_string(output, "", "Output file, standard output when empty");
+DEFINE_int32(warmup_samples, 3, "Samples left out of the drift check");
+DEFINE_double(max_drift, 0.25,
+              "Largest allowed growth of a metric over the run, relative to "
+              "its mean, as fitted by least squares");
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+// Metrics of one sample, in output order.
+const std::vector<std::string> kMetrics = {
+    "rss_kb",      "heap_kb",      "allocs",         "fds",
+    "threads",     "get_p50_us",   "get_p99_us",     "update_p50_us",
+    "update_p99_us", "remote_changes"};
+// Metrics expected to stay flat. Remote changes follow the household.
+constexpr int kCheckedMetrics = 9;
+
+struct Sample {
+  double day;
+  double wall_seconds;
+  std::vector<double> values;
+};
+
+// Second field of /proc/self/statm is resident pages.
+double RssKb() {
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE) / 1024.0;
+}
+
+double HeapKb() {
+#ifdef __GLIBC__
+  return mallinfo2().uordblks / 1024.0;
+#else
+  return 0;
+#endif
+}
+
+double OpenFds() {
+  DIR *dir = opendir("/proc/self/fd");
+  if (dir == nullptr) return 0;
+  int fds = 0;
+  while (readdir(dir) != nullptr) fds++;
+  closedir(dir);
+  // ".", ".." and the descriptor of dir itself.
+  return fds - 3;
+}
+
+double Threads() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    int threads;
+    if (line.rfind("Threads:", 0) == 0 &&
+        absl::SimpleAtoi(line.substr(8), &threads)) {
+      return threads;
+    }
+  }
+  return 0;
+}
+
+// Latencies of calls since the last sample.
+class CallLatencies {
+ public:
+  void Record(bool update, absl::Duration latency) {
+    absl::MutexLock l(&mu_);
+    (update ? updates_ : gets_).push_back(latency);
+  }
+
+  // Appends p50 and p99 of get and update calls in microseconds, and
+  // starts over.
+  void TakePercentiles(std::vector<double> *values) {
+    absl::MutexLock l(&mu_);
+    for (std::vector<absl::Duration> *calls : {&gets_, &updates_}) {
+      std::sort(calls->begin(), calls->end());
+      for (int percentile : {50, 99}) {
+        values->push_back(
+            calls->empty() ? 0
+                           : absl::ToDoubleMicroseconds(
+                                 (*calls)[(calls->size() - 1) * percentile /
+                                          100]));
+      }
+      calls->clear();
+    }
+  }
+
+ private:
+  absl::Mutex mu_;
+  std::vector<absl::Duration> gets_ ABSL_GUARDED_BY(mu_);
+  std::vector<absl::Duration> updates_ ABSL_GUARDED_BY(mu_);
+};
+
+void RunClient(proto::FujiACControllerService::Stub *stub, int id,
+               const std::atomic<bool> *done, CallLatencies *latencies) {
+  for (int call = 0; !*done; ++call) {
+    absl::SleepFor(absl::Milliseconds(FLAGS_client_interval_ms));
+    grpc::ClientContext context;
+    proto::StatusResponse response;
+    const bool update = (call + id) % FLAGS_update_every == 0;
+    absl::Time start = absl::Now();
+    grpc::Status status;
+    if (update) {
+      proto::UpdateRequest request;
+      request.mutable_new_state()->set_setpoint_temperature(18 + call % 6);
+      status = stub->Update(&context, request, &response);
+    } else {
+      status = stub->GetStatus(&context, proto::StatusRequest(), &response);
+    }
+    latencies->Record(update, absl::Now() - start);
+    LOG_IF(WARNING, !status.ok()) << "Call failed: " << status.error_message();
+  }
+}
+
+// Growth of values over the run fitted by least squares, relative to their
+// mean.
+double Drift(const std::vector<double> &values) {
+  const double n = values.size();
+  if (n < 2) return 0;
+  double mean_x = (n - 1) / 2, mean_y = 0;
+  for (double y : values) mean_y += y / n;
+  double sxy = 0, sxx = 0;
+  for (size_t x = 0; x < values.size(); ++x) {
+    sxy += (x - mean_x) * (values[x] - mean_y);
+    sxx += (x - mean_x) * (x - mean_x);
+  }
+  return sxy / sxx * (n - 1) / std::max(mean_y, 1.0);
+}
+
+std::string FormatSample(const Sample &sample) {
+  std::vector<std::string> values;
+  for (double value : sample.values) values.push_back(absl::StrCat(value));
+  if (FLAGS_format == "csv") {
+    return absl::StrFormat("%.2f,%.1f,%s", sample.day, sample.wall_seconds,
+                           absl::StrJoin(values, ","));
+  }
+  std::string json = absl::StrFormat("{\"day\":%.2f,\"wall_s\":%.1f",
+                                     sample.day, sample.wall_seconds);
+  for (size_t i = 0; i < kMetrics.size(); ++i) {
+    absl::StrAppend(&json, ",\"", kMetrics[i], "\":", values[i]);
+  }
+  return json + "}";
+}
+
+int Soak(std::ostream &out) {
+  auto *serial = new sim::FujiAcSimSerial(
+      absl::Microseconds(FLAGS_frame_interval_us));
+  std::unique_ptr<sim::FujiAcRoomSim> room = sim::MakeWorkdayRoomSim();
+  sim::FujiAcRoomSim *room_ptr = room.get();
+  serial->AttachRoom(std::move(room),
+                     absl::Seconds(FLAGS_sim_seconds_per_frame));
+  FujiAcControllerOptions options;
+  // Clients of the soak are not what is limited in production.
+  options.update_rate_limit = 0;
+  FujiACControllerServiceImpl service(
+      std::unique_ptr<FujiAcSerialInterface>(serial), options);
+  grpc::ServerBuilder builder;
+  builder.RegisterService(&service);
+  std::unique_ptr<grpc::Server> server = builder.BuildAndStart();
+  std::unique_ptr<proto::FujiACControllerService::Stub> stub =
+      proto::FujiACControllerService::NewStub(
+          server->InProcessChannel(grpc::ChannelArguments()));
+
+  std::atomic<bool> done{false};
+  CallLatencies latencies;
+  std::vector<std::thread> clients;
+  for (int i = 0; i < FLAGS_clients; ++i) {
+    clients.emplace_back(RunClient, stub.get(), i, &done, &latencies);
+  }
+
+  if (FLAGS_format == "csv") {
+    out << "day,wall_s," << absl::StrJoin(kMetrics, ",") << std::endl;
+  }
+  const absl::Duration interval = absl::Hours(24 * FLAGS_sample_every_days);
+  const absl::Time start = absl::Now();
+  std::vector<Sample> samples;
+  uint64_t last_allocations = ProcessAllocations();
+  absl::Duration next_sample = interval;
+  while (next_sample <= absl::Hours(24 * FLAGS_days)) {
+    absl::SleepFor(absl::Milliseconds(10));
+    absl::Duration elapsed;
+    uint64_t remote_changes = 0;
+    serial->WithSim([&](sim::FujiAcUnitSim *) {
+      elapsed = room_ptr->Elapsed();
+      remote_changes = room_ptr->RemoteChanges();
+    });
+    if (elapsed < next_sample) continue;
+    next_sample += interval;
+
+    uint64_t now_allocations = ProcessAllocations();
+    Sample sample{absl::ToDoubleHours(elapsed) / 24,
+                  absl::ToDoubleSeconds(absl::Now() - start),
+                  {RssKb(), HeapKb(),
+                   static_cast<double>(now_allocations - last_allocations),
+                   OpenFds(), Threads()}};
+    last_allocations = now_allocations;
+    latencies.TakePercentiles(&sample.values);
+    sample.values.push_back(remote_changes);
+    out << FormatSample(sample) << std::endl;
+    samples.push_back(std::move(sample));
+  }
+  done = true;
+  for (std::thread &client : clients) client.join();
+  server->Shutdown();
+
+  int drifting = 0;
+  for (int metric = 0; metric < kCheckedMetrics; ++metric) {
+    std::vector<double> values;
+    for (size_t i = FLAGS_warmup_samples; i < samples.size(); ++i) {
+      values.push_back(samples[i].values[metric]);
+    }
+    double drift = Drift(values);
+    if (drift > FLAGS_max_drift) {
+      LOG(ERROR) << kMetrics[metric] << " grew by " << drift * 100
+                 << "% over the run";
+      drifting++;
+    }
+  }
+  return drifting > 0 ? 1 : 0;
+}
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_format != "csv" && FLAGS_format != "json") {
+    LOG(FATAL) << "Invalid --format: " << FLAGS_format;
+  }
+  if (FLAGS_output.empty()) return fuji_iot::benchmarks::Soak(std::cout);
+  std::ofstream out(FLAGS_output);
+  if (!out) PLOG(FATAL) << "Cannot open " << FLAGS_output;
+  return fuji_iot::benchmarks::Soak(out);
+}
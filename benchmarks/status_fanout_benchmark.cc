@@ -0,0 +1,115 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Cost of GetStatus when many clients poll the same daemon at once, e.g.
+// dashboards refreshing together. Each benchmark thread is one caller. In
+// the steady case state does not change; in the other one a writer keeps
+// changing the setpoint, so callers regularly arrive while the state is
+// settling and have to wait for the next bus cycle. Reported times are per
+// call over all threads; they should stay flat as the number of callers
+// grows. Contention only shows up with several CPUs available.
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "controller/fuji_ac_controller.h"
+#include "sim/fuji_ac_sim_serial.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+// Master frame interval of the simulated unit.
+constexpr absl::Duration kFrameInterval = absl::Milliseconds(5);
+// Pause of the writer between setpoint changes.
+constexpr absl::Duration kChangeInterval = absl::Milliseconds(1);
+
+// Controller shared by all benchmark threads, set up once per run.
+class Daemon {
+ public:
+  explicit Daemon(bool writer) : serial_(kFrameInterval) {
+    controller_ = FujiAcController::MakeFujiAcController(&serial_);
+    controller_->GetStatus();
+    if (writer) {
+      writer_ = std::thread([this]() {
+        proto::ACUnitState state;
+        for (int i = 0; !stop_; i++) {
+          state.set_setpoint_temperature(20 + i % 2);
+          controller_->Update(state).IgnoreError();
+          absl::SleepFor(kChangeInterval);
+        }
+      });
+    }
+  }
+
+  ~Daemon() {
+    stop_ = true;
+    if (writer_.joinable()) writer_.join();
+    controller_->Shutdown();
+  }
+
+  FujiAcController *controller() { return controller_.get(); }
+
+ private:
+  sim::FujiAcSimSerial serial_;
+  std::unique_ptr<FujiAcController> controller_;
+  std::atomic<bool> stop_{false};
+  std::thread writer_;
+};
+
+Daemon *daemon = nullptr;
+
+void SetUpSteady(const benchmark::State &) { daemon = new Daemon(false); }
+void SetUpChanging(const benchmark::State &) { daemon = new Daemon(true); }
+void TearDown(const benchmark::State &) {
+  delete daemon;
+  daemon = nullptr;
+}
+
+// Fills a response the way the daemon's GetStatus handler does.
+void BM_GetStatus(benchmark::State &state) {
+  for (auto _ : state) {
+    proto::StatusResponse response = *daemon->controller()->GetSharedStatus();
+    benchmark::DoNotOptimize(response);
+  }
+}
+BENCHMARK(BM_GetStatus)
+    ->Name("BM_GetStatusSteady")
+    ->Setup(SetUpSteady)
+    ->Teardown(TearDown)
+    ->Threads(1)
+    ->Threads(10)
+    ->Threads(100)
+    ->MeasureProcessCPUTime()
+    ->UseRealTime();
+BENCHMARK(BM_GetStatus)
+    ->Name("BM_GetStatusChanging")
+    ->Setup(SetUpChanging)
+    ->Teardown(TearDown)
+    ->Threads(1)
+    ->Threads(10)
+    ->Threads(100)
+    ->MeasureProcessCPUTime()
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+BENCHMARK_MAIN();
@@ -0,0 +1,157 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures round trip of a frame through the local tty transport and through
+// the TCP serial bridge transport: master frame written on the far end ->
+// transport delivers it -> reply written -> reply read back on the far end.
+// The tty path runs over a pseudo terminal, the TCP path over loopback, so
+// the difference between the two is latency added by the network transport
+// itself. Both include the 30ms pacing pause each transport takes after a
+// received frame.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pty.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "absl/time/clock.h"
+#include "benchmark/benchmark.h"
+#include "benchmarks/latency_histogram.h"
+#include "controller/fuji_ac_serial_interface.h"
+#include "controller/fuji_ac_serial_reader.h"
+#include "controller/fuji_ac_tcp_serial.h"
+#include "glog/logging.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+const std::array<uint8_t, 8> kMasterFrame = {0xff, 0x5f, 0xff, 0xb9,
+                                             0xed, 0x5f, 0xfe, 0xdf};
+
+// Replies to every frame delivered by the transport until destroyed.
+class Responder {
+ public:
+  explicit Responder(FujiAcSerialInterface *serial)
+      : thread_([this, serial]() {
+          while (!stop_) {
+            if (serial->ReadMasterFrame().has_value()) {
+              serial->WriteControllerFrame(FujiControllerFrame());
+            }
+          }
+        }) {}
+  ~Responder() {
+    stop_ = true;
+    thread_.join();
+  }
+
+ private:
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+// Reads exactly size bytes, returns false on timeout or error.
+bool ReadFully(int fd, uint8_t *data, size_t size) {
+  size_t received = 0;
+  while (received < size) {
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 1000) <= 0) return false;
+    ssize_t n = read(fd, data + received, size - received);
+    if (n <= 0) return false;
+    received += n;
+  }
+  return true;
+}
+
+// Plays the main unit on fd.
+void RunRoundTrips(benchmark::State &state, int fd) {
+  LatencyHistogram histogram;
+  std::array<uint8_t, 8> reply;
+  for (auto _ : state) {
+    auto start = std::chrono::steady_clock::now();
+    if (write(fd, kMasterFrame.data(), kMasterFrame.size()) != 8 ||
+        !ReadFully(fd, reply.data(), reply.size())) {
+      state.SkipWithError("No reply");
+      break;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    state.SetIterationTime(std::chrono::duration<double>(elapsed).count());
+    histogram.Record(absl::FromChrono(elapsed));
+  }
+  histogram.Report(state);
+}
+
+void BM_TtyRoundTrip(benchmark::State &state) {
+  int master, slave;
+  char name[64];
+  if (openpty(&master, &slave, name, nullptr, nullptr) < 0) {
+    state.SkipWithError("openpty failed");
+    return;
+  }
+  {
+    auto reader =
+        FujiAcSerialReader::Build(name, FujiEchoSuppressor::Mode::OFF);
+    Responder responder(reader.get());
+    RunRoundTrips(state, master);
+  }
+  close(slave);
+  close(master);
+}
+BENCHMARK(BM_TtyRoundTrip)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+void BM_TcpRoundTrip(benchmark::State &state) {
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), len) < 0 ||
+      listen(listen_fd, 1) < 0 ||
+      getsockname(listen_fd, reinterpret_cast<sockaddr *>(&addr), &len) < 0) {
+    state.SkipWithError("Failed to listen");
+    close(listen_fd);
+    return;
+  }
+  FujiAcTcpSerialOptions options;
+  options.host = "127.0.0.1";
+  options.port = ntohs(addr.sin_port);
+  {
+    auto serial = FujiAcTcpSerial::Build(options);
+    Responder responder(serial.get());
+    int fd = accept(listen_fd, nullptr, nullptr);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    RunRoundTrips(state, fd);
+    close(fd);
+  }
+  close(listen_fd);
+}
+BENCHMARK(BM_TcpRoundTrip)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+BENCHMARK_MAIN();
@@ -0,0 +1,88 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays a simulated working day through the daemon: a heated room whose
+// occupants use the IR remote on a schedule and whenever it feels too cold
+// or too warm (sim/fuji_ac_room_sim.h). Reports the wall time per day, the
+// remote changes made and the state change events the controller recorded
+// for Subscribe. The argument is simulated seconds per master frame; at the
+// real bus rate a frame is roughly one second.
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "controller/fuji_ac_controller.h"
+#include "sim/fuji_ac_room_sim.h"
+#include "sim/fuji_ac_sim_serial.h"
+
+namespace fuji_iot {
+namespace benchmarks {
+namespace {
+
+// Master frame interval of the simulated unit.
+constexpr absl::Duration kFrameInterval = absl::Microseconds(100);
+constexpr absl::Duration kDay = absl::Hours(24);
+
+void BM_WorkdayReplay(benchmark::State &state) {
+  const absl::Duration room_step = absl::Seconds(state.range(0));
+  int64_t remote_changes = 0, events = 0;
+  for (auto _ : state) {
+    sim::FujiAcSimSerial serial(kFrameInterval);
+    std::unique_ptr<sim::FujiAcRoomSim> room = sim::MakeWorkdayRoomSim();
+    sim::FujiAcRoomSim *room_ptr = room.get();
+    serial.AttachRoom(std::move(room), room_step);
+    std::unique_ptr<FujiAcController> controller =
+        FujiAcController::MakeFujiAcController(&serial);
+    uint64_t run_id = 0;
+    uint64_t seq = 0;
+    absl::Duration elapsed;
+    std::vector<proto::StateEvent> batch;
+    while (elapsed < kDay) {
+      batch.clear();
+      controller->AwaitEvents(run_id, seq, absl::Milliseconds(10), &batch);
+      if (!batch.empty()) {
+        run_id = batch.back().run_id();
+        seq = batch.back().seq();
+      }
+      events += batch.size();
+      serial.WithSim([&](sim::FujiAcUnitSim *) {
+        elapsed = room_ptr->Elapsed();
+      });
+    }
+    controller->Shutdown();
+    serial.WithSim([&](sim::FujiAcUnitSim *) {
+      remote_changes += room_ptr->RemoteChanges();
+    });
+  }
+  state.counters["remote_changes"] =
+      benchmark::Counter(remote_changes, benchmark::Counter::kAvgIterations);
+  state.counters["events"] =
+      benchmark::Counter(events, benchmark::Counter::kAvgIterations);
+  state.counters["frames"] = absl::FDivDuration(kDay, room_step);
+}
+BENCHMARK(BM_WorkdayReplay)
+    ->ArgName("sim_seconds_per_frame")
+    ->Arg(10)
+    ->Arg(60)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace benchmarks
+}  // namespace fuji_iot
+
+BENCHMARK_MAIN();
@@ -0,0 +1,116 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_bus_budget.h"
+
+#include <algorithm>
+
+namespace fuji_iot {
+
+FujiBusMeter::FujiBusMeter(absl::Time start) : start_(start) {}
+
+FujiBusMeter::Bucket &FujiBusMeter::BucketAt(absl::Time now) {
+  int64_t second = absl::ToUnixSeconds(now);
+  Bucket &bucket = buckets_[second % kWindowSeconds];
+  if (bucket.second != second) bucket = Bucket{second, 0, 0};
+  return bucket;
+}
+
+void FujiBusMeter::RecordFrame(absl::Time now) { BucketAt(now).frames++; }
+
+void FujiBusMeter::RecordWrite(absl::Time now) {
+  Bucket &bucket = BucketAt(now);
+  bucket.frames++;
+  bucket.writes++;
+}
+
+FujiBusUsage FujiBusMeter::Usage(absl::Time now) const {
+  int64_t second = absl::ToUnixSeconds(now);
+  uint64_t frames = 0, writes = 0;
+  for (const Bucket &bucket : buckets_) {
+    if (bucket.second > second - kWindowSeconds && bucket.second <= second) {
+      frames += bucket.frames;
+      writes += bucket.writes;
+    }
+  }
+  // Window starts with the oldest bucket, or at start if that is later.
+  absl::Time window_start = std::max(
+      start_, absl::FromUnixSeconds(second - kWindowSeconds + 1));
+  double seconds = absl::ToDoubleSeconds(now - window_start);
+  FujiBusUsage usage;
+  if (seconds <= 0) return usage;
+  usage.frames_per_second = frames / seconds;
+  usage.writes_per_second = writes / seconds;
+  usage.utilisation = std::min(
+      1.0, usage.frames_per_second * absl::ToDoubleSeconds(kFrameAirtime));
+  return usage;
+}
+
+FujiClientRateLimiter::FujiClientRateLimiter(double rate, double burst)
+    : rate_(rate),
+      burst_(std::max(burst, 1.0)),
+      refill_time_(rate > 0 ? absl::Seconds(burst_ / rate)
+                            : absl::InfiniteDuration()) {}
+
+void FujiClientRateLimiter::Refill(Bucket *bucket, absl::Time now) const {
+  double elapsed = absl::ToDoubleSeconds(now - bucket->updated);
+  if (elapsed > 0) {
+    bucket->tokens = std::min(burst_, bucket->tokens + elapsed * rate_);
+    bucket->updated = now;
+  }
+}
+
+bool FujiClientRateLimiter::Admit(const std::string &client, absl::Time now) {
+  if (rate_ <= 0) return true;
+  absl::MutexLock l(&mu_);
+  // Every request moves its client to the front of lru_, so buckets at the
+  // back are the ones updated longest ago. Those idle for refill_time_ are
+  // full and can be forgotten.
+  while (!lru_.empty()) {
+    auto oldest = buckets_.find(lru_.back());
+    if (now - oldest->second.updated < refill_time_) break;
+    buckets_.erase(oldest);
+    lru_.pop_back();
+  }
+  auto it = buckets_.find(client);
+  if (it == buckets_.end()) {
+    if (buckets_.size() >= kMaxClients) {
+      buckets_.erase(lru_.back());
+      lru_.pop_back();
+    }
+    lru_.push_front(client);
+    it = buckets_.emplace(client, Bucket{burst_, now, lru_.begin()}).first;
+  } else {
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+  }
+  Refill(&it->second, now);
+  if (it->second.tokens < 1) {
+    rejected_++;
+    return false;
+  }
+  it->second.tokens -= 1;
+  return true;
+}
+
+uint64_t FujiClientRateLimiter::Rejected() const {
+  absl::MutexLock l(&mu_);
+  return rejected_;
+}
+
+size_t FujiClientRateLimiter::Clients() const {
+  absl::MutexLock l(&mu_);
+  return buckets_.size();
+}
+
+}  // namespace fuji_iot
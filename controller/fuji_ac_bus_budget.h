@@ -0,0 +1,107 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_BUS_BUDGET_H_
+#define FUJI_AC_BUS_BUDGET_H_
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <string>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace fuji_iot {
+// Time needed to transmit one frame at 500 baud, 8E1: 8 bytes, 11 bits each.
+constexpr absl::Duration kFrameAirtime = absl::Milliseconds(176);
+
+// Bus usage over the last few seconds.
+struct FujiBusUsage {
+  // All frames on the bus, ours included.
+  double frames_per_second = 0;
+  // Frames written by the controller.
+  double writes_per_second = 0;
+  // Fraction of time the bus was busy transmitting.
+  double utilisation = 0;
+};
+
+// Counts bus traffic in one second buckets covering a sliding window.
+// Recording does not allocate. Class is not thread-safe.
+class FujiBusMeter {
+ public:
+  static constexpr int kWindowSeconds = 10;
+
+  explicit FujiBusMeter(absl::Time start);
+  // Records a frame of the main unit, or any other device on the bus.
+  void RecordFrame(absl::Time now);
+  // Records a frame written by the controller.
+  void RecordWrite(absl::Time now);
+  FujiBusUsage Usage(absl::Time now) const;
+
+ private:
+  struct Bucket {
+    int64_t second = -1;
+    uint32_t frames = 0;
+    uint32_t writes = 0;
+  };
+  Bucket &BucketAt(absl::Time now);
+
+  const absl::Time start_;
+  std::array<Bucket, kWindowSeconds> buckets_;
+};
+
+// Limits rate of requests per client with a token bucket each. Clients
+// idle long enough to have a full bucket are forgotten. At most kMaxClients
+// are tracked, a new client replaces the one idle for longest. Class is
+// thread-safe.
+class FujiClientRateLimiter {
+ public:
+  static constexpr size_t kMaxClients = 256;
+
+  // rate is the sustained number of requests per second a client may make,
+  // burst how many it may make at once. Zero rate disables limiting.
+  FujiClientRateLimiter(double rate, double burst);
+  // Returns true and charges the client if it is within its budget.
+  bool Admit(const std::string &client, absl::Time now);
+  // Number of requests refused so far.
+  uint64_t Rejected() const;
+  // Number of clients tracked.
+  size_t Clients() const;
+
+ private:
+  struct Bucket {
+    double tokens;
+    absl::Time updated;
+    // Position in lru_.
+    std::list<std::string>::iterator lru;
+  };
+  // Refills bucket up to now.
+  void Refill(Bucket *bucket, absl::Time now) const;
+
+  const double rate_;
+  const double burst_;
+  // Time it takes an empty bucket to fill up.
+  const absl::Duration refill_time_;
+  mutable absl::Mutex mu_;
+  std::map<std::string, Bucket> buckets_ ABSL_GUARDED_BY(mu_);
+  // Clients by time of their last request, most recent first.
+  std::list<std::string> lru_ ABSL_GUARDED_BY(mu_);
+  uint64_t rejected_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace fuji_iot
+
+#endif
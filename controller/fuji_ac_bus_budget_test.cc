@@ -0,0 +1,96 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_bus_budget.h"
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace fuji_iot {
+
+const absl::Time kStart = absl::FromUnixSeconds(1000000);
+
+TEST(FujiBusMeterTest, RatesOverWindow) {
+  FujiBusMeter meter(kStart);
+  // Two master frames and one reply per second for the whole window.
+  for (int s = 0; s < FujiBusMeter::kWindowSeconds; s++) {
+    absl::Time t = kStart + absl::Seconds(s);
+    meter.RecordFrame(t);
+    meter.RecordFrame(t + absl::Milliseconds(300));
+    meter.RecordWrite(t + absl::Milliseconds(600));
+  }
+  FujiBusUsage usage = meter.Usage(kStart + absl::Seconds(10));
+  EXPECT_DOUBLE_EQ(usage.frames_per_second, 3);
+  EXPECT_DOUBLE_EQ(usage.writes_per_second, 1);
+  EXPECT_DOUBLE_EQ(usage.utilisation, 3 * 0.176);
+}
+
+TEST(FujiBusMeterTest, ForgetsOldTraffic) {
+  FujiBusMeter meter(kStart);
+  meter.RecordWrite(kStart);
+  EXPECT_DOUBLE_EQ(meter.Usage(kStart + absl::Seconds(2)).writes_per_second,
+                   0.5);
+  EXPECT_DOUBLE_EQ(meter.Usage(kStart + absl::Seconds(30)).frames_per_second,
+                   0);
+}
+
+TEST(FujiClientRateLimiterTest, BurstThenRate) {
+  FujiClientRateLimiter limiter(2, 3);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(limiter.Admit("a", kStart));
+  }
+  EXPECT_FALSE(limiter.Admit("a", kStart));
+  // Other clients have their own budget.
+  EXPECT_TRUE(limiter.Admit("b", kStart));
+  EXPECT_TRUE(limiter.Admit("a", kStart + absl::Milliseconds(500)));
+  EXPECT_FALSE(limiter.Admit("a", kStart + absl::Milliseconds(500)));
+  EXPECT_EQ(limiter.Rejected(), 2);
+}
+
+TEST(FujiClientRateLimiterTest, ZeroRateDisables) {
+  FujiClientRateLimiter limiter(0, 0);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(limiter.Admit("a", kStart));
+  }
+  EXPECT_EQ(limiter.Rejected(), 0);
+}
+
+TEST(FujiClientRateLimiterTest, ManyClients) {
+  FujiClientRateLimiter limiter(1, 1);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(limiter.Admit(absl::StrCat("client", i),
+                              kStart + absl::Seconds(i)));
+  }
+  EXPECT_FALSE(limiter.Admit("client999", kStart + absl::Seconds(999)));
+  // Idle clients were forgotten along the way.
+  EXPECT_EQ(limiter.Clients(), 1);
+}
+
+TEST(FujiClientRateLimiterTest, CapsClients) {
+  FujiClientRateLimiter limiter(0.01, 1);
+  EXPECT_TRUE(limiter.Admit("script", kStart));
+  // Ids changing faster than buckets refill replace the least recently
+  // seen client, but the map does not grow past the cap.
+  for (int i = 0; i < 10000; i++) {
+    const absl::Time now = kStart + absl::Milliseconds(i);
+    EXPECT_TRUE(limiter.Admit(absl::StrCat("client", i), now));
+    if (i % 100 == 0) {
+      EXPECT_FALSE(limiter.Admit("script", now));
+    }
+  }
+  EXPECT_EQ(limiter.Clients(), FujiClientRateLimiter::kMaxClients);
+}
+
+}  // namespace fuji_iot
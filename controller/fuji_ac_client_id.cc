@@ -0,0 +1,46 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "controller/fuji_ac_client_id.h"
+
+#include <algorithm>
+
+#include "absl/strings/match.h"
+
+namespace fuji_iot {
+
+std::string PeerAddress(const ::grpc::ServerContext &context) {
+  std::string peer = context.peer();
+  if (absl::StartsWith(peer, "ipv4:") || absl::StartsWith(peer, "ipv6:")) {
+    peer = peer.substr(0, peer.rfind(':'));
+  }
+  return peer;
+}
+
+std::string ClientId(const ::grpc::ServerContext &context,
+                     const std::vector<std::string> &trusted_peers) {
+  std::string peer = PeerAddress(context);
+  if (std::find(trusted_peers.begin(), trusted_peers.end(), peer) ==
+      trusted_peers.end()) {
+    return peer;
+  }
+  auto it = context.client_metadata().find(kClientMetadataKey);
+  if (it != context.client_metadata().end()) {
+    return std::string(it->second.data(), it->second.size());
+  }
+  return peer;
+}
+
+}  // namespace fuji_iot
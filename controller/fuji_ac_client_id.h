@@ -0,0 +1,43 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FUJI_AC_CLIENT_ID_H_
+#define FUJI_AC_CLIENT_ID_H_
+
+#include <string>
+#include <vector>
+
+#include "grpcpp/grpcpp.h"
+
+namespace fuji_iot {
+// Metadata naming the client on whose behalf a call is made. Set by the
+// gateway, so that per-client limits of daemons apply to the original
+// clients rather than to the gateway itself.
+constexpr char kClientMetadataKey[] = "fuji-client";
+
+// Address of the caller. Port changes with every connection and is left
+// out, e.g. "ipv4:192.168.1.10".
+std::string PeerAddress(const ::grpc::ServerContext &context);
+
+// Identifies caller for rate limiting: kClientMetadataKey if the caller is
+// one of trusted_peers (addresses as returned by PeerAddress), otherwise the
+// peer address. Metadata of other callers is ignored, so that they can't
+// pick a new id for every call.
+std::string ClientId(const ::grpc::ServerContext &context,
+                     const std::vector<std::string> &trusted_peers);
+
+}  // namespace fuji_iot
+
+#endif
@@ -14,73 +14,23 @@
 
 #include "controller/fuji_ac_controller.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "controller/fuji_ac_session_file.h"
+#include "controller/fuji_ac_trace.h"
 #include "glog/logging.h"
 
 namespace fuji_iot {
+namespace {
 
-absl::Status FujiAcController::Update(const proto::ACUnitState &new_state) {
-  absl::MutexLock l(&mu_);
-  ready_ = false;
-  switch (new_state.mode()) {
-    case proto::MODE_OFF:
-      state_->SetEnabled(false);
-      break;
-    case proto::MODE_AUTO:
-      state_->SetEnabled(true);
-      state_->SetMode(mode_t::AUTO);
-      break;
-    case proto::MODE_COOL:
-      state_->SetEnabled(true);
-      state_->SetMode(mode_t::COOL);
-      break;
-    case proto::MODE_HEAT:
-      state_->SetEnabled(true);
-      state_->SetMode(mode_t::HEAT);
-      break;
-    case proto::MODE_DRY:
-      state_->SetEnabled(true);
-      state_->SetMode(mode_t::DRY);
-      break;
-    case proto::MODE_FAN:
-      state_->SetEnabled(true);
-      state_->SetMode(mode_t::FAN);
-      break;
-    default:
-      break;
-  }
-  switch (new_state.fan()) {
-    case proto::FAN_AUTO:
-      state_->SetFan(fan_t::AUTO);
-      break;
-    case proto::FAN_MAX:
-      state_->SetFan(fan_t::MAX);
-      break;
-    case proto::FAN_HIGH:
-      state_->SetFan(fan_t::HIGH);
-      break;
-    case proto::FAN_MEDIUM:
-      state_->SetFan(fan_t::MEDIUM);
-      break;
-    case proto::FAN_LOW:
-      state_->SetFan(fan_t::LOW);
-      break;
-    default:
-      break;
-  }
-  if (new_state.setpoint_temperature() != 0) {
-    state_->SetTemperature(new_state.setpoint_temperature());
-  }
-  mu_.Await(absl::Condition(&ready_));
-  return absl::OkStatus();
-}
-
-const proto::ACUnitState FujiAcController::GetStatus() {
-  absl::MutexLock l(&mu_);
-  mu_.Await(absl::Condition(&ready_));
+proto::ACUnitState StateToProto(const FujiAcState &state) {
   proto::ACUnitState ret;
-  if (state_->Enabled()) {
-    switch (state_->Mode()) {
+  if (state.Enabled()) {
+    switch (state.Mode()) {
       case mode_t::AUTO:
         ret.set_mode(proto::MODE_AUTO);
         break;
@@ -104,7 +54,7 @@ const proto::ACUnitState FujiAcController::GetStatus() {
   } else {
     ret.set_mode(proto::MODE_OFF);
   }
-  switch (state_->Fan()) {
+  switch (state.Fan()) {
     case fan_t::AUTO:
       ret.set_fan(proto::FAN_AUTO);
       break;
@@ -123,37 +73,418 @@ const proto::ACUnitState FujiAcController::GetStatus() {
     default:
       break;
   }
-  ret.set_setpoint_temperature(state_->Temperature());
+  ret.set_setpoint_temperature(state.Temperature());
 
   return ret;
 }
 
+}  // namespace
+
+absl::Status FujiAcController::Update(const proto::ACUnitState &new_state) {
+  google::protobuf::FieldMask mask;
+  if (new_state.mode() != proto::MODE_UNKNOWN) mask.add_paths("mode");
+  if (new_state.fan() != proto::FAN_UNKNOWN) mask.add_paths("fan");
+  if (new_state.setpoint_temperature() != 0) {
+    mask.add_paths("setpoint_temperature");
+  }
+  return Update(new_state, mask, absl::nullopt);
+}
+
+absl::Status FujiAcController::Update(
+    const proto::ACUnitState &new_state,
+    const google::protobuf::FieldMask &mask,
+    absl::optional<uint64_t> expected_version) {
+  bool set_mode = false, set_fan = false, set_temperature = false;
+  for (const std::string &path : mask.paths()) {
+    if (path == "mode") {
+      if (new_state.mode() == proto::MODE_UNKNOWN) {
+        return absl::InvalidArgumentError("Mode can't be UNKNOWN.");
+      }
+      set_mode = true;
+    } else if (path == "fan") {
+      if (new_state.fan() == proto::FAN_UNKNOWN) {
+        return absl::InvalidArgumentError("Fan can't be UNKNOWN.");
+      }
+      set_fan = true;
+    } else if (path == "setpoint_temperature") {
+      if (new_state.setpoint_temperature() <= 0 ||
+          new_state.setpoint_temperature() > 0xFF) {
+        return absl::InvalidArgumentError(
+            "Setpoint temperature out of range.");
+      }
+      set_temperature = true;
+    } else {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unknown field in update mask: ", path));
+    }
+  }
+
+  FujiProfiledLock l(&mu_, LockProfile(), LockSite::UPDATE);
+  if (shutdown_) {
+    return absl::UnavailableError("Controller is shut down.");
+  }
+  if (expected_version.has_value() &&
+      expected_version.value() != state_->Generation()) {
+    return absl::AbortedError(absl::StrCat("State version is ",
+                                           state_->Generation(), ", expected ",
+                                           expected_version.value()));
+  }
+  if (options_.listen_only) {
+    // Empty update is a plain status query, which still works.
+    if (mask.paths_size() == 0) return absl::OkStatus();
+    return absl::FailedPreconditionError(
+        "Controller is in listen-only mode, updates are not possible");
+  }
+  ready_ = false;
+  updates_++;
+  if (set_mode) {
+    switch (new_state.mode()) {
+      case proto::MODE_OFF:
+        state_->SetEnabled(false);
+        break;
+      case proto::MODE_AUTO:
+        state_->SetEnabled(true);
+        state_->SetMode(mode_t::AUTO);
+        break;
+      case proto::MODE_COOL:
+        state_->SetEnabled(true);
+        state_->SetMode(mode_t::COOL);
+        break;
+      case proto::MODE_HEAT:
+        state_->SetEnabled(true);
+        state_->SetMode(mode_t::HEAT);
+        break;
+      case proto::MODE_DRY:
+        state_->SetEnabled(true);
+        state_->SetMode(mode_t::DRY);
+        break;
+      case proto::MODE_FAN:
+        state_->SetEnabled(true);
+        state_->SetMode(mode_t::FAN);
+        break;
+      default:
+        break;
+    }
+  }
+  if (set_fan) {
+    switch (new_state.fan()) {
+      case proto::FAN_AUTO:
+        state_->SetFan(fan_t::AUTO);
+        break;
+      case proto::FAN_MAX:
+        state_->SetFan(fan_t::MAX);
+        break;
+      case proto::FAN_HIGH:
+        state_->SetFan(fan_t::HIGH);
+        break;
+      case proto::FAN_MEDIUM:
+        state_->SetFan(fan_t::MEDIUM);
+        break;
+      case proto::FAN_LOW:
+        state_->SetFan(fan_t::LOW);
+        break;
+      default:
+        break;
+    }
+  }
+  if (set_temperature) {
+    state_->SetTemperature(new_state.setpoint_temperature());
+  }
+  RecordEvent();
+  const uint64_t update = updates_;
+  FUJI_AC_TRACE(update_enqueued, update, state_->Generation());
+  auto settled = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return ready_ || shutdown_;
+  };
+  l.Await(absl::Condition(&settled));
+  if (!ready_) {
+    return absl::UnavailableError(
+        "Controller was shut down before the unit took the update.");
+  }
+  FUJI_AC_TRACE(update_acknowledged, update, state_->Generation());
+  return absl::OkStatus();
+}
+
+const proto::ACUnitState FujiAcController::GetStatus() {
+  return GetSharedStatus()->state();
+}
+
+const proto::ACUnitState FujiAcController::GetStatus(uint64_t *version) {
+  auto status = GetSharedStatus();
+  *version = status->version();
+  return status->state();
+}
+
+std::shared_ptr<const proto::StatusResponse>
+FujiAcController::GetSharedStatus() {
+  std::shared_ptr<StatusFlight> flight;
+  {
+    FujiProfiledLock l(&mu_, LockProfile(), LockSite::GET_STATUS);
+    if (ready_ && status_ != nullptr &&
+        status_->version() == state_->Generation()) {
+      return status_;
+    }
+    if (status_flight_ == nullptr) {
+      // First caller waits for the state and builds the response for
+      // everyone who joins meanwhile.
+      flight = status_flight_ = std::make_shared<StatusFlight>();
+      // Once shut down, the last known state is all there is.
+      auto settled = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        return ready_ || shutdown_;
+      };
+      l.Await(absl::Condition(&settled));
+      auto status = std::make_shared<proto::StatusResponse>();
+      *status->mutable_state() = BuildStatus();
+      status->set_version(state_->Generation());
+      status_ = flight->status = std::move(status);
+      status_flight_ = nullptr;
+      flight->done.Notify();
+      return status_;
+    }
+    flight = status_flight_;
+  }
+  flight->done.WaitForNotification();
+  return flight->status;
+}
+
+bool FujiAcController::AwaitStatusChange(uint64_t version,
+                                         absl::Duration timeout) {
+  absl::MutexLock l(&mu_);
+  auto changed = [this, version]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return ready_ && state_->Generation() != version;
+  };
+  return mu_.AwaitWithTimeout(absl::Condition(&changed), timeout);
+}
+
+void FujiAcController::AwaitEvents(uint64_t from_run_id, uint64_t from_seq,
+                                   absl::Duration timeout,
+                                   std::vector<proto::StateEvent> *events) {
+  absl::MutexLock l(&mu_);
+  auto available = [this, from_run_id,
+                    from_seq]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return events_.LastSeq() != from_seq ||
+           (from_seq != 0 && events_.RunId() != from_run_id);
+  };
+  mu_.AwaitWithTimeout(absl::Condition(&available), timeout);
+  events_.ReadSince(from_run_id, from_seq, events);
+}
+
+void FujiAcController::RecordEvent() {
+  if (state_->Generation() == event_generation_) return;
+  event_generation_ = state_->Generation();
+  events_.Record(BuildStatus());
+}
+
+proto::ACUnitState FujiAcController::BuildStatus() {
+  return StateToProto(*state_);
+}
+
 void FujiAcController::DoLoop() {
+  absl::Status rt = ApplyRealtimeOptions(options_.realtime);
+  if (!rt.ok()) {
+    LOG(ERROR) << "Failed to apply real-time settings to bus thread: " << rt;
+  }
   while (!shutdown_) {
     auto mf = serial_->ReadMasterFrame();
     if (!mf.has_value()) {
       continue;
     }
+    FUJI_AC_TRACE(master_frame, mf->FullFrame()[0],
+                  static_cast<int>(mf->Destination()),
+                  static_cast<int>(mf->Type()));
+    if (options_.listen_only) {
+      FujiProfiledLock l(&mu_, LockProfile(), LockSite::BUS_LOOP);
+      Listen(mf.value(), absl::Now());
+      continue;
+    }
+    // Response window starts once the master frame is delivered. Only the
+    // protocol handler and the write happen inside of it.
+    absl::Time received = absl::Now();
+    absl::optional<FujiControllerFrame> cf;
+    uint64_t updates;
+    absl::optional<FujiLoginSession> session;
     {
-      absl::MutexLock l(&mu_);
-      auto cf = client_->HandleMasterFrame(mf.value());
-      if (cf.has_value()) {
-        if (cf == last_frame_) ready_ = true;
-        serial_->WriteControllerFrame(cf.value());
-        last_frame_ = cf.value();
+      FujiProfiledLock l(&mu_, LockProfile(), LockSite::BUS_LOOP);
+      cf = client_->HandleMasterFrame(mf.value());
+      updates = updates_;
+      if (!time_to_confirm_.has_value() && client_->Confirmed()) {
+        time_to_confirm_ = received - start_;
+        LOG(INFO) << "Main unit confirmed controller after "
+                  << *time_to_confirm_;
       }
+      session = client_->Session();
+    }
+    FUJI_AC_TRACE(handler_decision, static_cast<int>(mf->Type()),
+                  cf.has_value() ? static_cast<int>(cf->QueryRegister()) : -1,
+                  cf.has_value() && cf->WriteBit());
+    if (!cf.has_value()) {
+      FujiProfiledLock l(&mu_, LockProfile(), LockSite::BUS_LOOP);
+      bus_.RecordFrame(received);
+      continue;
+    }
+    serial_->WriteControllerFrame(cf.value());
+    absl::Duration turnaround = absl::Now() - received;
+    FUJI_AC_TRACE(controller_frame_written,
+                  static_cast<int>(cf->QueryRegister()), cf->WriteBit(),
+                  absl::ToInt64Nanoseconds(turnaround));
+
+    // Reply is on the wire, waking up waiters and bookkeeping can't delay it.
+    {
+      FujiProfiledLock l(&mu_, LockProfile(), LockSite::BUS_LOOP);
+      if (cf == last_frame_ && updates == updates_) ready_ = true;
+      last_frame_ = cf.value();
+      RecordReplyTiming(turnaround);
+      bus_.RecordFrame(received);
+      bus_.RecordWrite(received + turnaround);
+      RecordEvent();
+      // Bus stays silent until the next master frame, get its reply ready.
+      client_->PrepareReplies();
+    }
+    SaveSession(session);
+  }
+}
+
+void FujiAcController::SaveSession(
+    const absl::optional<FujiLoginSession> &session) {
+  if (options_.session_file.empty() || !session.has_value()) return;
+  if (saved_session_.has_value() &&
+      saved_session_->login_register == session->login_register &&
+      saved_session_->controller_present == session->controller_present) {
+    return;
+  }
+  // Not retried until the session changes again, a failing disk should not
+  // cost a write attempt every cycle.
+  saved_session_ = session;
+  absl::Status status = SaveLoginSession(options_.session_file, *session);
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to save login session: " << status;
+  }
+}
+
+void FujiAcController::RecordReplyTiming(absl::Duration turnaround) {
+  last_turnaround_ = turnaround;
+  max_turnaround_ = std::max(max_turnaround_, turnaround);
+  if (turnaround <= options_.reply_window) {
+    replies_on_time_++;
+    if (late_mode_ &&
+        ++on_time_streak_ >= options_.late_mode_recovery_cycles) {
+      late_mode_ = false;
+      LOG(INFO) << "Replies are on time again, " << replies_late_
+                << " late replies so far";
     }
+    return;
+  }
+  replies_late_++;
+  on_time_streak_ = 0;
+  if (!late_mode_) {
+    // Synchronous logging is expensive on a Pi, so only the first late reply
+    // of a series is reported individually.
+    late_mode_ = true;
+    LOG(WARNING) << "Late reply: " << turnaround << " exceeds response window "
+                 << options_.reply_window;
+  } else if (replies_late_ % 100 == 0) {
+    LOG(WARNING) << replies_late_ << " late replies so far, last took "
+                 << turnaround;
+  }
+}
+
+const proto::ReplyTimingMetrics FujiAcController::GetReplyTimingMetrics() {
+  absl::MutexLock l(&mu_);
+  proto::ReplyTimingMetrics ret;
+  ret.set_replies_on_time(replies_on_time_);
+  ret.set_replies_late(replies_late_);
+  ret.set_last_turnaround_us(absl::ToInt64Microseconds(last_turnaround_));
+  ret.set_max_turnaround_us(absl::ToInt64Microseconds(max_turnaround_));
+  ret.set_late_mode(late_mode_);
+  return ret;
+}
+
+void FujiAcController::Listen(const FujiMasterFrame &frame,
+                              absl::Time received) {
+  bus_.RecordFrame(received);
+  sniffer_.HandleFrame(frame.FullFrame());
+  const FujiAcState *shadow = sniffer_.State(
+      static_cast<uint8_t>(DestinationAddr::WIRED_CONTROLLER_ADDR));
+  if (shadow == nullptr) return;
+  if (!ready_ || shadow->Generation() != state_->Generation()) {
+    // Shadow generation only grows, so copying it keeps versions monotonic.
+    *state_ = *shadow;
+    ready_ = true;
+    RecordEvent();
   }
 }
 
+const proto::LockMetrics FujiAcController::GetLockMetrics() {
+  proto::LockMetrics ret;
+  if (options_.lock_profiling) lock_profile_.ToProto(&ret);
+  return ret;
+}
+
+const proto::BusDevicesResponse FujiAcController::GetBusDevices() {
+  absl::MutexLock l(&mu_);
+  proto::BusDevicesResponse ret;
+  for (uint8_t address : sniffer_.Addresses()) {
+    proto::BusDevice *device = ret.add_devices();
+    device->set_address(address);
+    *device->mutable_state() = StateToProto(*sniffer_.State(address));
+    device->set_frames(sniffer_.Frames(address));
+  }
+  return ret;
+}
+
+const proto::BusMetrics FujiAcController::GetBusMetrics() {
+  proto::BusMetrics ret;
+  {
+    absl::MutexLock l(&mu_);
+    FujiBusUsage usage = bus_.Usage(absl::Now());
+    ret.set_frames_per_second(usage.frames_per_second);
+    ret.set_writes_per_second(usage.writes_per_second);
+    ret.set_utilisation(usage.utilisation);
+    ret.set_foreign_controller_present(client_->ForeignControllerPresent());
+    ret.set_foreign_writes(client_->ForeignWrites());
+    ret.set_yielded_changes(client_->YieldedChanges());
+  }
+  ret.set_updates_rejected(update_limiter_.Rejected());
+  return ret;
+}
+
+const proto::SessionMetrics FujiAcController::GetSessionMetrics() {
+  absl::MutexLock l(&mu_);
+  proto::SessionMetrics ret;
+  if (time_to_confirm_.has_value()) {
+    ret.set_time_to_first_status_ms(
+        absl::ToInt64Milliseconds(*time_to_confirm_));
+  }
+  ret.set_frames_to_first_status(client_->FramesToConfirm());
+  ret.set_resumed(resumed_);
+  ret.set_full_logins(client_->FullLogins());
+  ret.set_fast_logins(client_->FastLogins());
+  return ret;
+}
+
+absl::Status FujiAcController::AdmitUpdate(const std::string &client) {
+  if (update_limiter_.Admit(client, absl::Now())) return absl::OkStatus();
+  return absl::ResourceExhaustedError(
+      absl::StrCat("Update rate limit of ", options_.update_rate_limit,
+                   "/s exceeded by ", client));
+}
+
 FujiAcController::FujiAcController(
     std::unique_ptr<FujiAcProtocolHandler> handler,
-    FujiAcSerialInterface *serial, FujiAcState *state)
+    FujiAcSerialInterface *serial, FujiAcState *state,
+    const FujiAcControllerOptions &options)
     : client_(std::move(handler)),
+      saved_session_(client_->Session()),
+      resumed_(saved_session_.has_value()),
+      start_(absl::Now()),
       serial_(serial),
       state_(state),
+      options_(options),
       shutdown_(false),
-      ready_(false) {
+      ready_(false),
+      events_(options.event_log_capacity),
+      bus_(absl::Now()),
+      update_limiter_(options.update_rate_limit, options.update_burst) {
   loop_thread_ = std::unique_ptr<std::thread>(
       new std::thread(&FujiAcController::DoLoop, this));
 }
@@ -162,7 +493,11 @@ void FujiAcController::Shutdown() {
   if (shutdown_) {
     LOG(FATAL) << "already shut down.";
   }
-  shutdown_ = true;
+  {
+    // Under the lock, so that callers waiting for the unit wake up.
+    absl::MutexLock l(&mu_);
+    shutdown_ = true;
+  }
   loop_thread_->join();
 }
 
@@ -175,12 +510,26 @@ FujiAcController::~FujiAcController() {
 
 std::unique_ptr<FujiAcController> FujiAcController::MakeFujiAcController(
     FujiAcSerialInterface *serial) {
+  return MakeFujiAcController(serial, FujiAcControllerOptions());
+}
+
+std::unique_ptr<FujiAcController> FujiAcController::MakeFujiAcController(
+    FujiAcSerialInterface *serial, const FujiAcControllerOptions &options) {
   FujiAcState *state = new FujiAcState();
   std::unique_ptr<FujiAcProtocolHandler> handler =
       std::unique_ptr<FujiAcProtocolHandler>(
-          new FujiAcProtocolHandler(std::unique_ptr<FujiAcState>(state)));
+          new FujiAcProtocolHandler(std::unique_ptr<FujiAcState>(state),
+                                    options.yield_to_foreign_controller));
+  if (!options.session_file.empty() && !options.listen_only) {
+    absl::optional<FujiLoginSession> session =
+        LoadLoginSession(options.session_file);
+    if (session.has_value()) {
+      LOG(INFO) << "Resuming login session from " << options.session_file;
+      handler->ResumeSession(*session);
+    }
+  }
   return std::unique_ptr<FujiAcController>(
-      new FujiAcController(std::move(handler), serial, state));
+      new FujiAcController(std::move(handler), serial, state, options));
 }
 
 }  // namespace fuji_iot
\ No newline at end of file
@@ -17,17 +17,63 @@
 
 #include <atomic>
 #include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "controller/fuji_ac_bus_budget.h"
 #include "controller/fuji_ac_controller.pb.h"
+#include "controller/fuji_ac_event_log.h"
+#include "controller/fuji_ac_lock_profile.h"
+#include "controller/fuji_ac_realtime.h"
 #include "controller/fuji_ac_serial_interface.h"
 #include "protocol/fuji_ac_protocol_handler.h"
 #include "protocol/fuji_ac_state.h"
+#include "protocol/fuji_bus_sniffer.h"
 #include "protocol/fuji_types.h"
 
 namespace fuji_iot {
+// Tunables of FujiAcController. Defaults match the behaviour of a plain
+// wired-controller.
+struct FujiAcControllerOptions {
+  // Scheduling of the background thread that handles bus communication.
+  RealtimeOptions realtime;
+  // Time allowed between master frame delivery and our reply being fully
+  // transmitted. At 500 bps the 8-byte frame alone takes ~176ms to send.
+  absl::Duration reply_window = absl::Milliseconds(300);
+  // Number of consecutive on-time replies after which late mode is left.
+  int late_mode_recovery_cycles = 100;
+  // Number of recent state changes kept for clients resuming Subscribe.
+  size_t event_log_capacity = 256;
+  // Sustained Update rate allowed per client, 0 for no limit. Every Update
+  // costs at least one bus cycle and delays other clients' reads.
+  double update_rate_limit = 0;
+  // Updates a client may issue at once before the rate limit applies.
+  double update_burst = 5;
+  // Addresses of gateways, as returned by PeerAddress(), whose calls are
+  // charged to the client they name in kClientMetadataKey rather than to
+  // the gateway. Other callers are told apart by address.
+  std::vector<std::string> trusted_gateway_peers;
+  // Only decodes bus traffic, never transmits. Status is the one the main
+  // unit sends to the wired controller address, typically an original
+  // remote already on the bus. Updates fail with FAILED_PRECONDITION.
+  bool listen_only = false;
+  // With another wired controller on the bus, its changes win over ours
+  // made at the same time instead of both controllers reverting each other.
+  bool yield_to_foreign_controller = true;
+  // File the login session is kept in, so that after a restart the
+  // controller is usable in fewer bus cycles. Empty disables it.
+  std::string session_file;
+  // Records wait and hold times of the state lock per call site, see
+  // GetLockMetrics(). Costs a few clock reads per lock.
+  bool lock_profiling = false;
+};
+
 // This class combines protocol logic with hardware interface and provides an
 // abstraction of a wired-controller. Given the serial interface, this object
 // will run separate thead in the background that will handle periodic
@@ -38,35 +84,128 @@ class FujiAcController {
   // Call to change AC unit parameters. This method will block until values are
   // changed.
   absl::Status Update(const proto::ACUnitState &new_state);
+  // Changes only fields of new_state listed in mask. If expected_version is
+  // given and differs from the current state version, returns ABORTED without
+  // waiting. Invalid mask or values are rejected with INVALID_ARGUMENT.
+  absl::Status Update(const proto::ACUnitState &new_state,
+                      const google::protobuf::FieldMask &mask,
+                      absl::optional<uint64_t> expected_version);
   // Call to obtain last known state of the AC unit. This method will usually
   // return immediately, unless there was no state obtained from the controller
   // yet.
   const proto::ACUnitState GetStatus();
+  // Same as above, also returns version of the state. Version changes every
+  // time the state changes, either through Update() or on the AC unit side.
+  const proto::ACUnitState GetStatus(uint64_t *version);
+  // Same as above, without copying. Response is built once per state version
+  // and shared by all callers; callers arriving while the state is settling
+  // share a single wait.
+  std::shared_ptr<const proto::StatusResponse> GetSharedStatus();
+  // Blocks until the state version differs from the given one and the state is
+  // stable. Returns false if timeout expired first.
+  bool AwaitStatusChange(uint64_t version, absl::Duration timeout);
+  // Appends state change events following the cursor (from_run_id, from_seq)
+  // to events, waiting up to timeout for at least one. See
+  // FujiAcEventLog::ReadSince.
+  void AwaitEvents(uint64_t from_run_id, uint64_t from_seq,
+                   absl::Duration timeout,
+                   std::vector<proto::StateEvent> *events);
+  // Returns counters describing how replies fit into the response window.
+  const proto::ReplyTimingMetrics GetReplyTimingMetrics();
+  // Returns recent bus traffic.
+  const proto::BusMetrics GetBusMetrics();
+  // Returns how long it took main unit to accept us after start.
+  const proto::SessionMetrics GetSessionMetrics();
+  // Returns use of the state lock, empty unless lock_profiling is set.
+  const proto::LockMetrics GetLockMetrics();
+  // Returns states of all bus addresses, empty unless in listen-only mode.
+  const proto::BusDevicesResponse GetBusDevices();
+  // Charges an update to client's budget. Returns RESOURCE_EXHAUSTED if the
+  // client exceeded its rate limit; the update should not be applied then.
+  absl::Status AdmitUpdate(const std::string &client);
   // Will construct FujiAcController and start underlying thread for protocol
   // handling.
   static std::unique_ptr<FujiAcController> MakeFujiAcController(
       FujiAcSerialInterface *serial);
-  // Should be called prior to destruction to stop underlying thread.
+  static std::unique_ptr<FujiAcController> MakeFujiAcController(
+      FujiAcSerialInterface *serial, const FujiAcControllerOptions &options);
+  // Should be called prior to destruction to stop underlying thread. Calls
+  // made meanwhile or later do not wait for the unit: updates fail with
+  // UNAVAILABLE and status is the last known one.
   void Shutdown();
 
  private:
+  // Result of GetSharedStatus() awaited by callers that joined a pending one.
+  struct StatusFlight {
+    absl::Notification done;
+    std::shared_ptr<const proto::StatusResponse> status;
+  };
+
   void DoLoop();
+  proto::ACUnitState BuildStatus() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Follows a frame seen on the bus in listen-only mode.
+  void Listen(const FujiMasterFrame &frame, absl::Time received)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Adds an event to the log if state changed since the last one.
+  void RecordEvent() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void RecordReplyTiming(absl::Duration turnaround)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Writes session to the session file if it changed since the last write.
+  // Called from the loop thread only.
+  void SaveSession(const absl::optional<FujiLoginSession> &session);
+  // Profile to record use of mu_ into, null unless lock_profiling is set.
+  FujiLockProfile *LockProfile() {
+    return options_.lock_profiling ? &lock_profile_ : nullptr;
+  }
 
   absl::Mutex mu_;
+  FujiLockProfile lock_profile_;
   FujiAcController(std::unique_ptr<FujiAcProtocolHandler> handler,
-                   FujiAcSerialInterface *serial, FujiAcState *state);
+                   FujiAcSerialInterface *serial, FujiAcState *state,
+                   const FujiAcControllerOptions &options);
   std::unique_ptr<FujiAcProtocolHandler> client_;
   std::unique_ptr<std::thread> loop_thread_;
+  // Session last written to the session file, or resumed from it.
+  absl::optional<FujiLoginSession> saved_session_;
+  const bool resumed_;
+  const absl::Time start_;
+  // Time until main unit first confirmed us.
+  absl::optional<absl::Duration> time_to_confirm_ ABSL_GUARDED_BY(mu_);
 
   FujiAcSerialInterface *serial_;
   FujiAcState *state_;
 
   FujiControllerFrame last_frame_;
+  const FujiAcControllerOptions options_;
 
   // looping vars
   std::atomic<bool> shutdown_;
   // indicates whether controller reached a stable state.
   bool ready_;
+  // Incremented by every Update(), lets the loop tell whether the frame it
+  // has just written already reflects the latest request.
+  uint64_t updates_ = 0;
+
+  // Last response of GetSharedStatus(), valid while its version matches.
+  std::shared_ptr<const proto::StatusResponse> status_ ABSL_GUARDED_BY(mu_);
+  // Set while a GetSharedStatus() caller waits for the state to settle.
+  std::shared_ptr<StatusFlight> status_flight_ ABSL_GUARDED_BY(mu_);
+
+  FujiAcEventLog events_ ABSL_GUARDED_BY(mu_);
+  FujiBusMeter bus_ ABSL_GUARDED_BY(mu_);
+  FujiBusSniffer sniffer_ ABSL_GUARDED_BY(mu_);
+  FujiClientRateLimiter update_limiter_;
+  // State generation the last event was recorded at.
+  uint64_t event_generation_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Reply timing. While late replies keep occurring the loop is in late mode
+  // and throttles its own diagnostics.
+  uint64_t replies_on_time_ = 0;
+  uint64_t replies_late_ = 0;
+  absl::Duration last_turnaround_;
+  absl::Duration max_turnaround_;
+  bool late_mode_ = false;
+  int on_time_streak_ = 0;
 };
 
 }  // namespace fuji_iot
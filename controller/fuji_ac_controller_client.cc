@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -24,21 +25,70 @@
 
 DEFINE_string(address, "", "Specifies bind address, all interfaces by default");
 DEFINE_int32(port, 12345, "Specifies bind port");
+DEFINE_string(unit, "", "Unit to talk to, required only with a gateway");
 DEFINE_string(mode, "", "New mode setting");
 DEFINE_string(fan, "", "New fan setting");
 DEFINE_int32(setpoint, 0, "New setpoint temperature");
+DEFINE_string(contention_profile, "",
+              "If set, writes contention profile of the daemon to this file "
+              "instead, for pprof");
+DEFINE_int32(profile_seconds, 0,
+             "If set, makes the daemon capture CPU and heap profiles for this "
+             "many seconds instead, and prints where it wrote them");
 
 namespace fuji_iot {
 
+void SaveContentionProfile(proto::FujiACControllerService::Stub *stub) {
+  grpc::ClientContext context;
+  proto::ContentionProfileRequest request;
+  proto::ContentionProfileResponse response;
+  request.set_unit(FLAGS_unit);
+  auto status = stub->GetContentionProfile(&context, request, &response);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to get contention profile: "
+               << status.error_message();
+    return;
+  }
+  std::ofstream out(FLAGS_contention_profile);
+  out << response.profile();
+  if (!out) PLOG(ERROR) << "Failed to write " << FLAGS_contention_profile;
+}
+
+void CaptureProfile(proto::FujiACControllerService::Stub *stub) {
+  grpc::ClientContext context;
+  proto::CaptureProfileRequest request;
+  proto::CaptureProfileResponse response;
+  request.set_unit(FLAGS_unit);
+  request.set_seconds(FLAGS_profile_seconds);
+  auto status = stub->CaptureProfile(&context, request, &response);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to capture profile: " << status.error_message();
+    return;
+  }
+  LOG(INFO) << "CPU profile: " << response.cpu_profile();
+  if (!response.heap_profile().empty()) {
+    LOG(INFO) << "Heap profile: " << response.heap_profile();
+  }
+}
+
 // Very simple client. If mode/fan/setpoint flags are not specified, will query
 // for status. If present, will change that property to flag value.
 void RunClient() {
   auto stub = proto::FujiACControllerService::NewStub(
       ::grpc::CreateChannel(absl::StrFormat("%s:%d", FLAGS_address, FLAGS_port),
                             grpc::InsecureChannelCredentials()));
+  if (!FLAGS_contention_profile.empty()) {
+    SaveContentionProfile(stub.get());
+    return;
+  }
+  if (FLAGS_profile_seconds > 0) {
+    CaptureProfile(stub.get());
+    return;
+  }
   grpc::ClientContext context;
   proto::UpdateRequest request;
   proto::StatusResponse response;
+  request.set_unit(FLAGS_unit);
   auto new_state = request.mutable_new_state();
   if (FLAGS_mode == "off") {
     new_state->set_mode(proto::Mode::MODE_OFF);
@@ -0,0 +1,89 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_event_log.h"
+
+#include <random>
+#include <utility>
+
+namespace fuji_iot {
+namespace {
+
+uint64_t RandomRunId() {
+  std::random_device random;
+  uint64_t run_id = 0;
+  while (run_id == 0) {
+    run_id = (static_cast<uint64_t>(random()) << 32) | random();
+  }
+  return run_id;
+}
+
+}  // namespace
+
+FujiAcEventLog::FujiAcEventLog(size_t capacity)
+    : capacity_(capacity), run_id_(RandomRunId()) {}
+
+bool FujiAcEventLog::Record(const proto::ACUnitState &state) {
+  proto::StateEvent event;
+  if (state.mode() != state_.mode()) {
+    event.mutable_changed()->add_paths("mode");
+    event.mutable_state()->set_mode(state.mode());
+  }
+  if (state.fan() != state_.fan()) {
+    event.mutable_changed()->add_paths("fan");
+    event.mutable_state()->set_fan(state.fan());
+  }
+  if (state.setpoint_temperature() != state_.setpoint_temperature()) {
+    event.mutable_changed()->add_paths("setpoint_temperature");
+    event.mutable_state()->set_setpoint_temperature(
+        state.setpoint_temperature());
+  }
+  if (!event.has_changed()) return false;
+  event.set_seq(++last_seq_);
+  event.set_run_id(run_id_);
+  state_ = state;
+  events_.push_back(std::move(event));
+  if (events_.size() > capacity_) events_.pop_front();
+  return true;
+}
+
+void FujiAcEventLog::ReadSince(uint64_t from_run_id, uint64_t from_seq,
+                               std::vector<proto::StateEvent> *events) const {
+  // Sequence numbers of another run say nothing about this one.
+  const bool same_run = from_seq == 0 || from_run_id == run_id_;
+  if (same_run && from_seq == last_seq_) return;
+  // Events from_seq + 1 ... last_seq_ are needed, log holds the last
+  // events_.size() of them.
+  if (same_run && from_seq < last_seq_ &&
+      last_seq_ - from_seq <= events_.size()) {
+    events->insert(events->end(), events_.end() - (last_seq_ - from_seq),
+                   events_.end());
+    return;
+  }
+  proto::StateEvent snapshot;
+  snapshot.set_seq(last_seq_);
+  snapshot.set_snapshot(true);
+  snapshot.set_run_id(run_id_);
+  *snapshot.mutable_state() = state_;
+  snapshot.mutable_changed()->add_paths("mode");
+  snapshot.mutable_changed()->add_paths("fan");
+  snapshot.mutable_changed()->add_paths("setpoint_temperature");
+  events->push_back(std::move(snapshot));
+}
+
+uint64_t FujiAcEventLog::LastSeq() const { return last_seq_; }
+
+uint64_t FujiAcEventLog::RunId() const { return run_id_; }
+
+}  // namespace fuji_iot
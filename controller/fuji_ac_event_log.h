@@ -0,0 +1,58 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_EVENT_LOG_H_
+#define FUJI_AC_EVENT_LOG_H_
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "controller/fuji_ac_controller.pb.h"
+
+namespace fuji_iot {
+// Bounded log of AC unit state changes. Every change gets the next sequence
+// number, clients holding the number of the last event they have seen can
+// catch up with only the changes they missed. Once the log is full the oldest
+// events are dropped, clients that fell behind get a snapshot instead.
+// Numbering starts anew with every log, so each log picks a random run id
+// that events carry along with the sequence number. Class is not thread-safe.
+class FujiAcEventLog {
+ public:
+  explicit FujiAcEventLog(size_t capacity);
+  // Records transition to state. Returns false if nothing changed.
+  bool Record(const proto::ACUnitState &state);
+  // Appends events following the event from_seq of run from_run_id to
+  // events. If some of them are no longer in the log, or the cursor is
+  // unknown or of another run, appends a single snapshot of the current state
+  // instead. from_seq 0 reads from the first event, whatever the run id.
+  void ReadSince(uint64_t from_run_id, uint64_t from_seq,
+                 std::vector<proto::StateEvent> *events) const;
+  // Sequence number of the last recorded event, 0 if there were none.
+  uint64_t LastSeq() const;
+  // Run id of this log, never 0.
+  uint64_t RunId() const;
+
+ private:
+  const size_t capacity_;
+  const uint64_t run_id_;
+  std::deque<proto::StateEvent> events_;
+  // State after the last event.
+  proto::ACUnitState state_;
+  uint64_t last_seq_ = 0;
+};
+
+}  // namespace fuji_iot
+
+#endif
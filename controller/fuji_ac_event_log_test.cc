@@ -0,0 +1,122 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_event_log.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace fuji_iot {
+
+proto::ACUnitState State(proto::Mode mode, proto::Fan fan, int temperature) {
+  proto::ACUnitState state;
+  state.set_mode(mode);
+  state.set_fan(fan);
+  state.set_setpoint_temperature(temperature);
+  return state;
+}
+
+std::vector<proto::StateEvent> ReadSince(const FujiAcEventLog &log,
+                                         uint64_t seq) {
+  std::vector<proto::StateEvent> events;
+  log.ReadSince(log.RunId(), seq, &events);
+  return events;
+}
+
+TEST(FujiAcEventLogTest, RecordsOnlyChangedFields) {
+  FujiAcEventLog log(8);
+  EXPECT_TRUE(log.Record(State(proto::MODE_COOL, proto::FAN_AUTO, 22)));
+  EXPECT_FALSE(log.Record(State(proto::MODE_COOL, proto::FAN_AUTO, 22)));
+  EXPECT_TRUE(log.Record(State(proto::MODE_COOL, proto::FAN_AUTO, 24)));
+  EXPECT_EQ(log.LastSeq(), 2);
+
+  auto events = ReadSince(log, 1);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].seq(), 2);
+  EXPECT_EQ(events[0].run_id(), log.RunId());
+  EXPECT_FALSE(events[0].snapshot());
+  ASSERT_EQ(events[0].changed().paths_size(), 1);
+  EXPECT_EQ(events[0].changed().paths(0), "setpoint_temperature");
+  EXPECT_EQ(events[0].state().setpoint_temperature(), 24);
+}
+
+TEST(FujiAcEventLogTest, ReplaysMissedEvents) {
+  FujiAcEventLog log(8);
+  for (int t = 18; t < 23; t++) {
+    log.Record(State(proto::MODE_HEAT, proto::FAN_LOW, t));
+  }
+  EXPECT_TRUE(ReadSince(log, 5).empty());
+  auto events = ReadSince(log, 2);
+  ASSERT_EQ(events.size(), 3);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(events[i].seq(), 3 + i);
+    EXPECT_EQ(events[i].state().setpoint_temperature(), 20 + i);
+  }
+  EXPECT_EQ(ReadSince(log, 0).size(), 5);
+}
+
+TEST(FujiAcEventLogTest, SnapshotWhenCursorFellOutOfLog) {
+  FujiAcEventLog log(2);
+  log.Record(State(proto::MODE_COOL, proto::FAN_AUTO, 22));
+  log.Record(State(proto::MODE_COOL, proto::FAN_HIGH, 22));
+  log.Record(State(proto::MODE_DRY, proto::FAN_HIGH, 22));
+
+  EXPECT_EQ(ReadSince(log, 1).size(), 2);
+  auto events = ReadSince(log, 0);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_TRUE(events[0].snapshot());
+  EXPECT_EQ(events[0].seq(), 3);
+  EXPECT_EQ(events[0].changed().paths_size(), 3);
+  EXPECT_EQ(events[0].state().mode(), proto::MODE_DRY);
+  EXPECT_EQ(events[0].state().fan(), proto::FAN_HIGH);
+  EXPECT_EQ(events[0].state().setpoint_temperature(), 22);
+}
+
+TEST(FujiAcEventLogTest, SnapshotWhenCursorIsAhead) {
+  FujiAcEventLog log(8);
+  log.Record(State(proto::MODE_FAN, proto::FAN_MEDIUM, 20));
+  auto events = ReadSince(log, 100);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_TRUE(events[0].snapshot());
+  EXPECT_EQ(events[0].seq(), 1);
+}
+
+TEST(FujiAcEventLogTest, SnapshotWhenCursorIsOfAnotherRun) {
+  // Daemon restarted and numbering began anew, the cursor is below the last
+  // sequence number of the new run.
+  FujiAcEventLog before(8);
+  FujiAcEventLog after(8);
+  ASSERT_NE(before.RunId(), after.RunId());
+  for (int t = 18; t < 23; t++) {
+    before.Record(State(proto::MODE_HEAT, proto::FAN_LOW, t));
+    after.Record(State(proto::MODE_COOL, proto::FAN_HIGH, t));
+  }
+  for (uint64_t seq : {2, 5}) {
+    std::vector<proto::StateEvent> events;
+    after.ReadSince(before.RunId(), seq, &events);
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_TRUE(events[0].snapshot());
+    EXPECT_EQ(events[0].seq(), 5);
+    EXPECT_EQ(events[0].run_id(), after.RunId());
+    EXPECT_EQ(events[0].state().mode(), proto::MODE_COOL);
+    EXPECT_EQ(events[0].state().setpoint_temperature(), 22);
+  }
+  // Without a cursor the run does not matter.
+  std::vector<proto::StateEvent> events;
+  after.ReadSince(before.RunId(), 0, &events);
+  EXPECT_EQ(events.size(), 5);
+}
+
+}  // namespace fuji_iot
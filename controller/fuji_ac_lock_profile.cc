@@ -0,0 +1,206 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_lock_profile.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "controller/fuji_stack_trace.h"
+
+namespace fuji_iot {
+namespace {
+
+void AtomicMax(std::atomic<int64_t> *max, int64_t value) {
+  int64_t current = max->load(std::memory_order_relaxed);
+  while (value > current &&
+         !max->compare_exchange_weak(current, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+// Contention per distinct stack of the releasing thread, in a fixed table so
+// that the tracer neither allocates nor takes an absl::Mutex, which would
+// trace itself.
+constexpr int kMaxStacks = 1024;
+
+struct ContendedStack {
+  uint64_t hash = 0;
+  int depth = 0;
+  void *pcs[kMaxStackDepth];
+  int64_t cycles = 0;
+  int64_t count = 0;
+};
+
+std::mutex contention_mu;
+ContendedStack *contended_stacks = nullptr;
+// Contention of stacks that did not fit into the table.
+int64_t dropped_cycles = 0;
+int64_t dropped_count = 0;
+std::atomic<bool> contention_enabled{false};
+
+void TraceContention(const char *msg, const void *obj, int64_t wait_cycles) {
+  void *pcs[kMaxStackDepth];
+  int depth = CaptureStack(0, pcs);
+  uint64_t hash = StackHash(pcs, depth);
+  std::lock_guard<std::mutex> l(contention_mu);
+  for (int probe = 0; probe < kMaxStacks; ++probe) {
+    ContendedStack &stack = contended_stacks[(hash + probe) % kMaxStacks];
+    if (stack.count == 0) {
+      stack.hash = hash;
+      stack.depth = depth;
+      std::copy(pcs, pcs + depth, stack.pcs);
+    } else if (stack.hash != hash || stack.depth != depth ||
+               !std::equal(pcs, pcs + depth, stack.pcs)) {
+      continue;
+    }
+    stack.cycles += wait_cycles;
+    stack.count++;
+    return;
+  }
+  dropped_cycles += wait_cycles;
+  dropped_count++;
+}
+
+}  // namespace
+
+const char *LockSiteName(LockSite site) {
+  switch (site) {
+    case LockSite::BUS_LOOP:
+      return "bus_loop";
+    case LockSite::UPDATE:
+      return "update";
+    case LockSite::GET_STATUS:
+      return "get_status";
+  }
+  return "unknown";
+}
+
+void FujiDurationHistogram::Record(absl::Duration duration) {
+  const int64_t ns = absl::ToInt64Nanoseconds(duration);
+  const uint64_t us = ns / 1000;
+  // Index of the first power of two above us.
+  int bucket = 0;
+  while (bucket < kBuckets - 1 && us >= (1ull << bucket)) bucket++;
+  counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+  AtomicMax(&max_ns_, ns);
+}
+
+void FujiDurationHistogram::ToProto(proto::DurationHistogram *histogram) const {
+  for (int i = 0; i < kBuckets; ++i) {
+    if (i < kBuckets - 1) histogram->add_bounds_us(int64_t{1} << i);
+    histogram->add_counts(counts_[i].load(std::memory_order_relaxed));
+  }
+  histogram->set_count(count_.load(std::memory_order_relaxed));
+  histogram->set_sum_us(sum_ns_.load(std::memory_order_relaxed) / 1000);
+  histogram->set_max_us(max_ns_.load(std::memory_order_relaxed) / 1000);
+}
+
+void FujiLockProfile::ToProto(proto::LockMetrics *metrics) const {
+  for (int i = 0; i < kLockSites; ++i) {
+    proto::LockSiteMetrics *site = metrics->add_sites();
+    site->set_site(LockSiteName(static_cast<LockSite>(i)));
+    wait_[i].ToProto(site->mutable_wait());
+    hold_[i].ToProto(site->mutable_hold());
+  }
+}
+
+FujiProfiledLock::FujiProfiledLock(absl::Mutex *mu, FujiLockProfile *profile,
+                                   LockSite site)
+    : mu_(mu), profile_(profile), site_(site) {
+  if (profile_ == nullptr) {
+    mu_->Lock();
+    return;
+  }
+  absl::Time start = absl::Now();
+  mu_->Lock();
+  held_since_ = absl::Now();
+  profile_->RecordWait(site_, held_since_ - start);
+}
+
+FujiProfiledLock::~FujiProfiledLock() {
+  if (profile_ == nullptr) {
+    mu_->Unlock();
+    return;
+  }
+  absl::Duration hold = absl::Now() - held_since_;
+  mu_->Unlock();
+  // Recorded after unlocking, the histogram is lock-free.
+  profile_->RecordHold(site_, hold);
+}
+
+void FujiProfiledLock::EndHold() {
+  if (profile_ != nullptr) {
+    profile_->RecordHold(site_, absl::Now() - held_since_);
+  }
+}
+
+void FujiProfiledLock::Await(const absl::Condition &cond) {
+  if (cond.Eval()) return;
+  EndHold();
+  mu_->Await(cond);
+  if (profile_ != nullptr) held_since_ = absl::Now();
+}
+
+bool FujiProfiledLock::AwaitWithTimeout(const absl::Condition &cond,
+                                        absl::Duration timeout) {
+  if (cond.Eval()) return true;
+  EndHold();
+  bool met = mu_->AwaitWithTimeout(cond, timeout);
+  if (profile_ != nullptr) held_since_ = absl::Now();
+  return met;
+}
+
+void EnableContentionProfiling() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    contended_stacks = new ContendedStack[kMaxStacks];
+    PrepareStackCapture();
+    absl::RegisterMutexTracer(&TraceContention);
+    contention_enabled = true;
+  });
+}
+
+bool ContentionProfilingEnabled() { return contention_enabled; }
+
+std::string ContentionProfile() {
+  std::string profile = absl::StrFormat(
+      "--- contentionz \ncycles/second = %d\nsampling period = 1\n",
+      static_cast<int64_t>(absl::base_internal::CycleClock::Frequency()));
+  if (!contention_enabled) return profile;
+  {
+    std::lock_guard<std::mutex> l(contention_mu);
+    for (int i = 0; i < kMaxStacks; ++i) {
+      const ContendedStack &stack = contended_stacks[i];
+      if (stack.count == 0) continue;
+      absl::StrAppendFormat(&profile, "%d %d @", stack.cycles, stack.count);
+      for (int j = 0; j < stack.depth; ++j) {
+        absl::StrAppendFormat(&profile, " %p", stack.pcs[j]);
+      }
+      profile += "\n";
+    }
+    if (dropped_count > 0) {
+      absl::StrAppendFormat(&profile, "%d %d @ 0x0\n", dropped_cycles,
+                            dropped_count);
+    }
+  }
+  return profile + "--- Memory map: ---\n" + MemoryMap();
+}
+
+}  // namespace fuji_iot
@@ -0,0 +1,103 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_LOCK_PROFILE_H_
+#define FUJI_AC_LOCK_PROFILE_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "controller/fuji_ac_controller.pb.h"
+
+namespace fuji_iot {
+// Call sites of the controller state lock profiled separately.
+enum class LockSite { BUS_LOOP = 0, UPDATE = 1, GET_STATUS = 2 };
+constexpr int kLockSites = 3;
+
+const char *LockSiteName(LockSite site);
+
+// Histogram of durations. Bucket i counts durations below 2^i us, the last
+// one everything longer. Recording is lock-free and does not allocate.
+class FujiDurationHistogram {
+ public:
+  static constexpr int kBuckets = 22;
+
+  void Record(absl::Duration duration);
+  void ToProto(proto::DurationHistogram *histogram) const;
+
+ private:
+  std::array<std::atomic<uint64_t>, kBuckets> counts_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<int64_t> sum_ns_{0};
+  std::atomic<int64_t> max_ns_{0};
+};
+
+// Wait and hold times of a mutex per call site. Class is thread-safe.
+class FujiLockProfile {
+ public:
+  void RecordWait(LockSite site, absl::Duration wait) {
+    wait_[static_cast<int>(site)].Record(wait);
+  }
+  void RecordHold(LockSite site, absl::Duration hold) {
+    hold_[static_cast<int>(site)].Record(hold);
+  }
+  void ToProto(proto::LockMetrics *metrics) const;
+
+ private:
+  std::array<FujiDurationHistogram, kLockSites> wait_;
+  std::array<FujiDurationHistogram, kLockSites> hold_;
+};
+
+// Like absl::MutexLock, and records the time spent acquiring mu and holding
+// it to profile unless it is null. Waiting on a condition releases mu and
+// counts as neither.
+class ABSL_SCOPED_LOCKABLE FujiProfiledLock {
+ public:
+  FujiProfiledLock(absl::Mutex *mu, FujiLockProfile *profile, LockSite site)
+      ABSL_EXCLUSIVE_LOCK_FUNCTION(mu);
+  ~FujiProfiledLock() ABSL_UNLOCK_FUNCTION();
+
+  FujiProfiledLock(const FujiProfiledLock &) = delete;
+  FujiProfiledLock &operator=(const FujiProfiledLock &) = delete;
+
+  void Await(const absl::Condition &cond);
+  bool AwaitWithTimeout(const absl::Condition &cond, absl::Duration timeout);
+
+ private:
+  // Records hold time so far, before mu is released.
+  void EndHold();
+
+  absl::Mutex *const mu_;
+  FujiLockProfile *const profile_;
+  const LockSite site_;
+  absl::Time held_since_;
+};
+
+// Starts collecting contention of every absl::Mutex in the process: stacks
+// of threads releasing a mutex somebody waited for, with the time waited.
+// Stacks are only taken on contention. Safe to call more than once.
+void EnableContentionProfiling();
+bool ContentionProfilingEnabled();
+// Contention collected so far in the legacy text format of pprof
+// ("--- contentionz"), followed by the memory map for symbolization.
+std::string ContentionProfile();
+
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,118 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_lock_profile.h"
+
+#include <string>
+#include <thread>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace fuji_iot {
+namespace {
+
+TEST(FujiDurationHistogramTest, Buckets) {
+  FujiDurationHistogram histogram;
+  histogram.Record(absl::Nanoseconds(500));
+  histogram.Record(absl::Microseconds(3));
+  histogram.Record(absl::Microseconds(3));
+  histogram.Record(absl::Seconds(100));
+  proto::DurationHistogram proto;
+  histogram.ToProto(&proto);
+  ASSERT_EQ(proto.counts_size(), FujiDurationHistogram::kBuckets);
+  ASSERT_EQ(proto.bounds_us_size(), FujiDurationHistogram::kBuckets - 1);
+  EXPECT_EQ(proto.bounds_us(2), 4);
+  EXPECT_EQ(proto.counts(0), 1);
+  EXPECT_EQ(proto.counts(2), 2);
+  EXPECT_EQ(proto.counts(FujiDurationHistogram::kBuckets - 1), 1);
+  EXPECT_EQ(proto.count(), 4);
+  EXPECT_EQ(proto.max_us(), 100000000);
+  EXPECT_EQ(proto.sum_us(), 100000006);
+}
+
+TEST(FujiProfiledLockTest, RecordsWaitAndHold) {
+  absl::Mutex mu;
+  FujiLockProfile profile;
+  absl::Notification locked;
+  std::thread holder([&]() {
+    FujiProfiledLock l(&mu, &profile, LockSite::BUS_LOOP);
+    locked.Notify();
+    absl::SleepFor(absl::Milliseconds(20));
+  });
+  locked.WaitForNotification();
+  {
+    FujiProfiledLock l(&mu, &profile, LockSite::UPDATE);
+  }
+  holder.join();
+
+  proto::LockMetrics metrics;
+  profile.ToProto(&metrics);
+  ASSERT_EQ(metrics.sites_size(), kLockSites);
+  const proto::LockSiteMetrics &bus = metrics.sites(0);
+  const proto::LockSiteMetrics &update = metrics.sites(1);
+  EXPECT_EQ(bus.site(), "bus_loop");
+  EXPECT_EQ(update.site(), "update");
+  EXPECT_GE(bus.hold().max_us(), 20000);
+  EXPECT_GE(update.wait().max_us(), 10000);
+  EXPECT_EQ(update.hold().count(), 1);
+  EXPECT_EQ(metrics.sites(2).wait().count(), 0);
+}
+
+TEST(FujiProfiledLockTest, AwaitIsNotHeld) {
+  absl::Mutex mu;
+  FujiLockProfile profile;
+  bool ready = false;
+  std::thread setter([&]() {
+    absl::SleepFor(absl::Milliseconds(20));
+    absl::MutexLock l(&mu);
+    ready = true;
+  });
+  {
+    FujiProfiledLock l(&mu, &profile, LockSite::GET_STATUS);
+    l.Await(absl::Condition(&ready));
+  }
+  setter.join();
+  proto::LockMetrics metrics;
+  profile.ToProto(&metrics);
+  const proto::LockSiteMetrics &status = metrics.sites(2);
+  EXPECT_EQ(status.hold().count(), 2);
+  EXPECT_LT(status.hold().max_us(), 10000);
+}
+
+TEST(ContentionProfileTest, CollectsContendedStacks) {
+  EnableContentionProfiling();
+  ASSERT_TRUE(ContentionProfilingEnabled());
+  absl::Mutex mu;
+  absl::Notification locked;
+  std::thread holder([&]() {
+    absl::MutexLock l(&mu);
+    locked.Notify();
+    absl::SleepFor(absl::Milliseconds(20));
+  });
+  locked.WaitForNotification();
+  { absl::MutexLock l(&mu); }
+  holder.join();
+
+  std::string profile = ContentionProfile();
+  EXPECT_EQ(profile.rfind("--- contentionz \ncycles/second = ", 0), 0);
+  EXPECT_NE(profile.find(" @ 0x"), std::string::npos);
+  EXPECT_NE(profile.find("--- Memory map: ---\n"), std::string::npos);
+}
+
+}  // namespace
+}  // namespace fuji_iot
@@ -0,0 +1,141 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replaces the allocator entry points of glibc with ones reporting to the
+// heap sampler of fuji_ac_profiler.h, and forwarding to glibc. Outside of a
+// capture the overhead is a relaxed load. Only one set of replacements may
+// be linked into a binary, so everything needing to observe allocations goes
+// through this one. With FUJI_AC_COUNT_ALLOCATIONS, as built for tests and
+// benchmarks, allocations are also counted, see fuji_ac_malloc_hooks.h.
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "controller/fuji_ac_profiler.h"
+
+#ifdef FUJI_AC_COUNT_ALLOCATIONS
+#include <atomic>
+
+#include "controller/fuji_ac_malloc_hooks.h"
+
+namespace {
+std::atomic<uint64_t> process_allocations{0};
+// Initial-exec, so that access never allocates.
+thread_local uint64_t thread_allocations
+    __attribute__((tls_model("initial-exec"))) = 0;
+
+inline void CountAllocation() {
+  process_allocations.fetch_add(1, std::memory_order_relaxed);
+  thread_allocations++;
+}
+}  // namespace
+
+namespace fuji_iot {
+
+uint64_t ProcessAllocations() {
+  return process_allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t ThreadAllocations() { return thread_allocations; }
+
+}  // namespace fuji_iot
+#else
+namespace {
+inline void CountAllocation() {}
+}  // namespace
+#endif
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+  CountAllocation();
+  void *ptr = __libc_malloc(size);
+  fuji_iot::heap_sampler::OnAllocation(ptr, size);
+  return ptr;
+}
+
+void *calloc(size_t count, size_t size) {
+  CountAllocation();
+  void *ptr = __libc_calloc(count, size);
+  // Product is known not to overflow only once calloc succeeded.
+  if (ptr != nullptr) fuji_iot::heap_sampler::OnAllocation(ptr, count * size);
+  return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+  CountAllocation();
+  void *new_ptr = __libc_realloc(ptr, size);
+  // Failed realloc leaves the block in place. Zero size frees it.
+  if (new_ptr != nullptr || size == 0) fuji_iot::heap_sampler::OnFree(ptr);
+  fuji_iot::heap_sampler::OnAllocation(new_ptr, size);
+  return new_ptr;
+}
+
+void *memalign(size_t alignment, size_t size) {
+  CountAllocation();
+  void *ptr = __libc_memalign(alignment, size);
+  fuji_iot::heap_sampler::OnAllocation(ptr, size);
+  return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size) {
+  if (alignment == 0 || alignment % sizeof(void *) != 0 ||
+      (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  void *ptr = memalign(alignment, size);
+  if (ptr == nullptr) return ENOMEM;
+  *result = ptr;
+  return 0;
+}
+
+void *valloc(size_t size) {
+  CountAllocation();
+  void *ptr = __libc_valloc(size);
+  fuji_iot::heap_sampler::OnAllocation(ptr, size);
+  return ptr;
+}
+
+void *pvalloc(size_t size) {
+  CountAllocation();
+  void *ptr = __libc_pvalloc(size);
+  fuji_iot::heap_sampler::OnAllocation(ptr, size);
+  return ptr;
+}
+
+void free(void *ptr) {
+  fuji_iot::heap_sampler::OnFree(ptr);
+  __libc_free(ptr);
+}
+}
+
+namespace {
+const bool hooks_installed = []() {
+  fuji_iot::heap_sampler::MarkHooksInstalled();
+  return true;
+}();
+}  // namespace
+#endif
@@ -0,0 +1,33 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_MALLOC_HOOKS_H_
+#define FUJI_AC_MALLOC_HOOKS_H_
+
+#include <cstdint>
+
+namespace fuji_iot {
+// Allocations made since start through malloc, calloc, realloc or any of the
+// aligned allocators, and so through every form of operator new. Counted by
+// fuji_ac_counting_malloc_hooks, for tests and benchmarks only, which has to
+// be linked to use these.
+
+// By the whole process.
+uint64_t ProcessAllocations();
+// By the calling thread.
+uint64_t ThreadAllocations();
+
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,87 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_malloc_hooks.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <cstdint>
+#include <new>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace fuji_iot {
+namespace {
+
+// Keeps the compiler from eliding allocations that are freed right away.
+void *volatile sink;
+
+struct alignas(64) Aligned {
+  char data[64];
+};
+
+TEST(FujiAcMallocHooksTest, CountsEveryEntryPoint) {
+  uint64_t before = ThreadAllocations();
+  sink = malloc(16);
+  free(sink);
+  sink = calloc(4, 4);
+  sink = realloc(sink, 64);
+  free(sink);
+  sink = aligned_alloc(64, 64);
+  free(sink);
+  void *ptr = nullptr;
+  ASSERT_EQ(posix_memalign(&ptr, 64, 64), 0);
+  sink = ptr;
+  free(sink);
+  EXPECT_EQ(ThreadAllocations() - before, 5);
+
+  before = ThreadAllocations();
+  int *value = new int(1);
+  sink = value;
+  delete value;
+  Aligned *aligned = new Aligned();
+  sink = aligned;
+  delete aligned;
+  sink = ::operator new(32, std::align_val_t(128));
+  ::operator delete(sink, std::align_val_t(128));
+  EXPECT_EQ(ThreadAllocations() - before, 3);
+}
+
+TEST(FujiAcMallocHooksTest, PosixMemalignRejectsBadAlignment) {
+  void *ptr = nullptr;
+  for (size_t alignment : {0, 3, 24}) {
+    EXPECT_EQ(posix_memalign(&ptr, alignment, 64), EINVAL) << alignment;
+  }
+  EXPECT_EQ(ptr, nullptr);
+}
+
+TEST(FujiAcMallocHooksTest, ThreadCountIsPerThread) {
+  uint64_t thread_before = ThreadAllocations();
+  uint64_t process_before = ProcessAllocations();
+  std::thread other([]() {
+    for (int i = 0; i < 100; ++i) {
+      sink = malloc(16);
+      free(sink);
+    }
+  });
+  other.join();
+  EXPECT_GE(ProcessAllocations() - process_before, 100);
+  // Starting the thread may allocate here, the loop does not.
+  EXPECT_LT(ThreadAllocations() - thread_before, 100);
+}
+
+}  // namespace
+}  // namespace fuji_iot
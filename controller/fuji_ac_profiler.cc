@@ -0,0 +1,398 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_profiler.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "controller/fuji_stack_trace.h"
+#include "glog/logging.h"
+
+namespace fuji_iot {
+namespace {
+
+// Samples are aggregated per distinct stack in fixed tables, written from a
+// signal handler or from inside malloc, so neither may allocate nor lock.
+constexpr int kMaxStacks = 4096;
+// Hash of a slot being filled in. Stack hashes never take it nor zero.
+constexpr uint64_t kClaimed = 1;
+
+uint64_t SlotHash(void *const *pcs, int depth) {
+  uint64_t hash = StackHash(pcs, depth);
+  return hash > kClaimed ? hash : hash + 2;
+}
+
+struct SampledStack {
+  std::atomic<uint64_t> hash{0};
+  int depth = 0;
+  void *pcs[kMaxStackDepth];
+  std::atomic<int64_t> count{0};
+  std::atomic<int64_t> bytes{0};
+  std::atomic<int64_t> live_count{0};
+  std::atomic<int64_t> live_bytes{0};
+};
+
+// Returns slot of the stack, filling in a free one on first sight, or null if
+// the table is full. Threads racing to add the same stack may both add it,
+// pprof merges them.
+SampledStack *FindStack(SampledStack *table, void *const *pcs, int depth) {
+  const uint64_t hash = SlotHash(pcs, depth);
+  for (int probe = 0; probe < kMaxStacks; ++probe) {
+    SampledStack &stack = table[(hash + probe) % kMaxStacks];
+    uint64_t current = stack.hash.load(std::memory_order_acquire);
+    if (current == 0 &&
+        stack.hash.compare_exchange_strong(current, kClaimed,
+                                           std::memory_order_acquire)) {
+      stack.depth = depth;
+      std::copy(pcs, pcs + depth, stack.pcs);
+      stack.hash.store(hash, std::memory_order_release);
+      return &stack;
+    }
+    if (current == hash) return &stack;
+  }
+  return nullptr;
+}
+
+// Signal handlers and allocator hooks currently using a table. Tables are
+// cleared only once it drops to zero.
+std::atomic<int> table_users{0};
+
+void AwaitTableUsers() {
+  while (table_users.load(std::memory_order_acquire) > 0) {
+    std::this_thread::yield();
+  }
+}
+
+// Per thread, trivial types only so that no initialization runs in malloc,
+// and initial-exec so that access neither allocates nor is unsafe in a
+// signal handler, even from a shared library.
+//
+// Set while the thread samples an allocation, so that allocations of the
+// sampler itself are not sampled.
+thread_local bool in_hook __attribute__((tls_model("initial-exec"))) = false;
+thread_local int64_t bytes_until_sample
+    __attribute__((tls_model("initial-exec"))) = 0;
+thread_local uint64_t random_state
+    __attribute__((tls_model("initial-exec"))) = 0;
+
+// CPU samples, taken on SIGPROF.
+SampledStack cpu_stacks[kMaxStacks];
+std::atomic<bool> cpu_active{false};
+std::atomic<int64_t> cpu_dropped{0};
+
+void OnProfilingSignal(int signal, siginfo_t *info, void *context) {
+  int saved_errno = errno;
+  table_users.fetch_add(1, std::memory_order_acquire);
+  if (InStackCapture()) {
+    // Interrupted the unwinder, of a heap sample or a contention trace,
+    // which is not reentrant.
+    if (cpu_active.load(std::memory_order_relaxed)) {
+      cpu_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  } else if (cpu_active.load(std::memory_order_relaxed)) {
+    void *pcs[kMaxStackDepth];
+    // Leaves out the signal trampoline.
+    int depth = CaptureStack(1, pcs);
+    SampledStack *stack = FindStack(cpu_stacks, pcs, depth);
+    if (stack != nullptr) {
+      stack->count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      cpu_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  table_users.fetch_sub(1, std::memory_order_release);
+  errno = saved_errno;
+}
+
+void SetProfilingTimer(absl::Duration period) {
+  itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  timer.it_interval = absl::ToTimeval(period);
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+// Legacy CPU profile of pprof: words of the native size, a header, one record
+// per stack and a trailer, followed by the memory map.
+std::string CpuProfile(absl::Duration period) {
+  std::vector<uintptr_t> words = {
+      0, 3, 0, static_cast<uintptr_t>(absl::ToInt64Microseconds(period)), 0};
+  for (const SampledStack &stack : cpu_stacks) {
+    int64_t count = stack.count.load(std::memory_order_relaxed);
+    if (count == 0) continue;
+    words.push_back(count);
+    words.push_back(stack.depth);
+    for (int i = 0; i < stack.depth; ++i) {
+      words.push_back(reinterpret_cast<uintptr_t>(stack.pcs[i]));
+    }
+  }
+  if (cpu_dropped > 0) {
+    words.insert(words.end(), {static_cast<uintptr_t>(cpu_dropped.load()), 1,
+                               0});
+  }
+  words.insert(words.end(), {0, 1, 0});
+  std::string profile(reinterpret_cast<const char *>(words.data()),
+                      words.size() * sizeof(uintptr_t));
+  return profile + MemoryMap();
+}
+
+// Heap samples. Sampled blocks still in use are kept in an open addressing
+// table keyed by address, so that freeing them can be accounted for.
+constexpr int kMaxLiveBlocks = 1 << 16;
+// Address of a block that was freed, kept so that probing goes on.
+constexpr uintptr_t kFreedBlock = 1;
+
+struct LiveBlock {
+  std::atomic<uintptr_t> ptr{0};
+  int64_t size = 0;
+  SampledStack *stack = nullptr;
+};
+
+SampledStack heap_stacks[kMaxStacks];
+LiveBlock live_blocks[kMaxLiveBlocks];
+std::atomic<int> live_block_slots{0};
+std::atomic<int64_t> heap_sample_bytes{512 * 1024};
+std::atomic<bool> hooks_installed{false};
+
+
+// Exponentially distributed distance to the next sample, so that every byte
+// allocated is equally likely to be sampled.
+int64_t NextSampleDistance() {
+  if (random_state == 0) {
+    random_state = reinterpret_cast<uintptr_t>(&random_state) | 1;
+  }
+  // xorshift64.
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  double uniform = ((random_state >> 11) + 1) * 0x1.0p-53;
+  int64_t mean = heap_sample_bytes.load(std::memory_order_relaxed);
+  return static_cast<int64_t>(-std::log(uniform) * mean);
+}
+
+// Fibonacci hashing, top bits of the product are the best mixed.
+uint64_t BlockHash(uintptr_t ptr) {
+  return ((ptr >> 4) * 11400714819323198485ull) >> 40;
+}
+
+std::string HeapProfile(int64_t sample_bytes) {
+  std::string samples;
+  int64_t live_count = 0, live_bytes = 0, count = 0, bytes = 0;
+  for (const SampledStack &stack : heap_stacks) {
+    if (stack.count.load(std::memory_order_relaxed) == 0) continue;
+    absl::StrAppendFormat(&samples, "%d: %d [%d: %d] @",
+                          stack.live_count.load(), stack.live_bytes.load(),
+                          stack.count.load(), stack.bytes.load());
+    for (int i = 0; i < stack.depth; ++i) {
+      absl::StrAppendFormat(&samples, " %p", stack.pcs[i]);
+    }
+    samples += "\n";
+    live_count += stack.live_count;
+    live_bytes += stack.live_bytes;
+    count += stack.count;
+    bytes += stack.bytes;
+  }
+  return absl::StrFormat("heap profile: %d: %d [%d: %d] @ heap_v2/%d\n",
+                         live_count, live_bytes, count, bytes, sample_bytes) +
+         samples + "\nMAPPED_LIBRARIES:\n" + MemoryMap();
+}
+
+void ClearTables() {
+  for (SampledStack *table : {cpu_stacks, heap_stacks}) {
+    for (int i = 0; i < kMaxStacks; ++i) {
+      table[i].hash = 0;
+      table[i].count = 0;
+      table[i].bytes = 0;
+      table[i].live_count = 0;
+      table[i].live_bytes = 0;
+    }
+  }
+  for (LiveBlock &block : live_blocks) block.ptr = 0;
+  live_block_slots = 0;
+  cpu_dropped = 0;
+}
+
+absl::Status WriteProfile(const std::string &path, const std::string &data) {
+  std::ofstream out(path, std::ios::binary);
+  out << data;
+  out.close();
+  if (!out) {
+    return absl::InternalError(
+        absl::StrCat("Failed to write ", path, ": ", strerror(errno)));
+  }
+  LOG(INFO) << "Wrote profile " << path;
+  return absl::OkStatus();
+}
+
+std::mutex capture_mu;
+std::mutex enabled_mu;
+FujiProfilerOptions *enabled_options = nullptr;
+
+}  // namespace
+
+namespace heap_sampler {
+
+std::atomic<bool> active{false};
+
+void MarkHooksInstalled() { hooks_installed = true; }
+
+void SampleAllocation(void *ptr, size_t size) {
+  if (in_hook) return;
+  bytes_until_sample -= size;
+  if (bytes_until_sample > 0) return;
+  in_hook = true;
+  table_users.fetch_add(1, std::memory_order_acquire);
+  bytes_until_sample = NextSampleDistance();
+  void *pcs[kMaxStackDepth];
+  // Leaves out the allocator entry point.
+  int depth = CaptureStack(1, pcs);
+  SampledStack *stack = FindStack(heap_stacks, pcs, depth);
+  if (stack != nullptr) {
+    stack->count.fetch_add(1, std::memory_order_relaxed);
+    stack->bytes.fetch_add(size, std::memory_order_relaxed);
+    // Half of the table at most, keeping probes of frees short.
+    if (live_block_slots.fetch_add(1, std::memory_order_relaxed) <
+        kMaxLiveBlocks / 2) {
+      const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+      for (uint64_t i = BlockHash(address);; ++i) {
+        LiveBlock &block = live_blocks[i % kMaxLiveBlocks];
+        uintptr_t empty = 0;
+        if (block.ptr.load(std::memory_order_relaxed) != 0) continue;
+        block.size = size;
+        block.stack = stack;
+        // Published last, frees only look at blocks with their address.
+        if (!block.ptr.compare_exchange_strong(empty, address,
+                                               std::memory_order_release)) {
+          continue;
+        }
+        stack->live_count.fetch_add(1, std::memory_order_relaxed);
+        stack->live_bytes.fetch_add(size, std::memory_order_relaxed);
+        break;
+      }
+    }
+  }
+  table_users.fetch_sub(1, std::memory_order_release);
+  in_hook = false;
+}
+
+void SampleFree(void *ptr) {
+  if (live_block_slots.load(std::memory_order_relaxed) == 0) return;
+  table_users.fetch_add(1, std::memory_order_acquire);
+  const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+  for (uint64_t i = BlockHash(address);; ++i) {
+    LiveBlock &block = live_blocks[i % kMaxLiveBlocks];
+    uintptr_t current = block.ptr.load(std::memory_order_acquire);
+    if (current == 0) break;
+    if (current == address &&
+        block.ptr.compare_exchange_strong(current, kFreedBlock,
+                                          std::memory_order_acquire)) {
+      block.stack->live_count.fetch_sub(1, std::memory_order_relaxed);
+      block.stack->live_bytes.fetch_sub(block.size, std::memory_order_relaxed);
+      break;
+    }
+  }
+  table_users.fetch_sub(1, std::memory_order_release);
+}
+
+}  // namespace heap_sampler
+
+absl::Status CaptureProfiles(const FujiProfilerOptions &options,
+                             absl::Duration duration, std::string *cpu_path,
+                             std::string *heap_path) {
+  if (duration <= absl::ZeroDuration() || duration > kMaxProfileDuration) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Profile duration must be positive and at most ",
+                     absl::FormatDuration(kMaxProfileDuration)));
+  }
+  std::unique_lock<std::mutex> lock(capture_mu, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return absl::UnavailableError("Another profile is being captured.");
+  }
+  if (mkdir(options.dir.c_str(), 0755) < 0 && errno != EEXIST) {
+    return absl::InternalError(absl::StrCat("Failed to create ", options.dir,
+                                            ": ", strerror(errno)));
+  }
+  const bool sample_heap = hooks_installed.load();
+  PrepareStackCapture();
+  ClearTables();
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = &OnProfilingSignal;
+  action.sa_flags = SA_RESTART | SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, nullptr);
+  cpu_active = true;
+  heap_sample_bytes = options.heap_sample_bytes;
+  heap_sampler::active = sample_heap;
+  SetProfilingTimer(options.cpu_period);
+  LOG(INFO) << "Capturing profiles for " << duration;
+
+  absl::SleepFor(duration);
+
+  SetProfilingTimer(absl::ZeroDuration());
+  cpu_active = false;
+  heap_sampler::active = false;
+  // A signal may still be pending, the handler stays installed and ignores
+  // it. Default action would terminate the process.
+  AwaitTableUsers();
+
+  const std::string prefix = absl::StrCat(
+      options.dir, "/fuji_ac.",
+      absl::FormatTime("%Y%m%d-%H%M%E3S", absl::Now(), absl::LocalTimeZone()));
+  *cpu_path = prefix + ".cpu.prof";
+  absl::Status status = WriteProfile(*cpu_path, CpuProfile(options.cpu_period));
+  heap_path->clear();
+  if (status.ok() && sample_heap) {
+    *heap_path = prefix + ".heap.prof";
+    status = WriteProfile(*heap_path, HeapProfile(options.heap_sample_bytes));
+  }
+  return status;
+}
+
+void EnableProfileCapture(const FujiProfilerOptions &options) {
+  std::lock_guard<std::mutex> l(enabled_mu);
+  delete enabled_options;
+  enabled_options = new FujiProfilerOptions(options);
+}
+
+absl::Status CaptureProfiles(absl::Duration duration, std::string *cpu_path,
+                             std::string *heap_path) {
+  FujiProfilerOptions options;
+  {
+    std::lock_guard<std::mutex> l(enabled_mu);
+    if (enabled_options == nullptr) {
+      return absl::FailedPreconditionError(
+          "Profiling is disabled, see --profile_dir.");
+    }
+    options = *enabled_options;
+  }
+  return CaptureProfiles(options, duration, cpu_path, heap_path);
+}
+
+}  // namespace fuji_iot
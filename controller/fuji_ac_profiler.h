@@ -0,0 +1,85 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_PROFILER_H_
+#define FUJI_AC_PROFILER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+
+namespace fuji_iot {
+// Sampling profiler of the whole process, for capturing profiles of a running
+// daemon without restarting it.
+struct FujiProfilerOptions {
+  // Profiles are written there, created if missing.
+  std::string dir = "/var/log/fuji";
+  // CPU time between two CPU samples. Not shorter than the scheduler tick
+  // in practice.
+  absl::Duration cpu_period = absl::Milliseconds(10);
+  // Average number of bytes allocated between two heap samples.
+  int64_t heap_sample_bytes = 512 * 1024;
+};
+
+// Longest capture accepted.
+constexpr absl::Duration kMaxProfileDuration = absl::Minutes(5);
+
+// Samples CPU and heap of the process for duration, then writes the CPU
+// profile in the legacy binary format of pprof and the heap profile in its
+// heap_v2 text format to options.dir, and returns their paths. The heap
+// profile holds allocations made during the capture, and those still in use
+// at its end. It is only written if the allocator hooks
+// (fuji_ac_malloc_hooks) are linked, otherwise heap_path is left empty.
+// Blocks for the duration, only one capture runs at a time.
+absl::Status CaptureProfiles(const FujiProfilerOptions &options,
+                             absl::Duration duration, std::string *cpu_path,
+                             std::string *heap_path);
+
+// Lets the daemon capture profiles with the options on request, see below.
+void EnableProfileCapture(const FujiProfilerOptions &options);
+// Like above with options given to EnableProfileCapture. FailedPrecondition
+// if it was not called.
+absl::Status CaptureProfiles(absl::Duration duration, std::string *cpu_path,
+                             std::string *heap_path);
+
+// Hooks of the allocator, called by fuji_ac_malloc_hooks. Only do work while
+// a capture runs.
+namespace heap_sampler {
+
+extern std::atomic<bool> active;
+
+void MarkHooksInstalled();
+void SampleAllocation(void *ptr, size_t size);
+void SampleFree(void *ptr);
+
+inline void OnAllocation(void *ptr, size_t size) {
+  if (active.load(std::memory_order_relaxed) && ptr != nullptr) {
+    SampleAllocation(ptr, size);
+  }
+}
+
+inline void OnFree(void *ptr) {
+  if (active.load(std::memory_order_relaxed) && ptr != nullptr) {
+    SampleFree(ptr);
+  }
+}
+
+}  // namespace heap_sampler
+}  // namespace fuji_iot
+
+#endif
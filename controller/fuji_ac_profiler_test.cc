@@ -0,0 +1,135 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_profiler.h"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "controller/fuji_ac_lock_profile.h"
+#include "gtest/gtest.h"
+
+namespace fuji_iot {
+namespace {
+
+std::string ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream data;
+  data << in.rdbuf();
+  return data.str();
+}
+
+FujiProfilerOptions TestOptions() {
+  FujiProfilerOptions options;
+  options.dir = ::testing::TempDir() + "/profiles";
+  options.cpu_period = absl::Milliseconds(10);
+  options.heap_sample_bytes = 4096;
+  return options;
+}
+
+TEST(FujiProfilerTest, RejectsBadDuration) {
+  std::string cpu_path, heap_path;
+  EXPECT_TRUE(absl::IsInvalidArgument(CaptureProfiles(
+      TestOptions(), absl::ZeroDuration(), &cpu_path, &heap_path)));
+  EXPECT_TRUE(absl::IsInvalidArgument(
+      CaptureProfiles(TestOptions(), kMaxProfileDuration + absl::Seconds(1),
+                      &cpu_path, &heap_path)));
+}
+
+TEST(FujiProfilerTest, CapturesCpuAndHeap) {
+  std::atomic<bool> done{false};
+  std::thread worker([&]() {
+    std::vector<std::unique_ptr<char[]>> kept;
+    volatile uint64_t sum = 0;
+    while (!done) {
+      std::unique_ptr<char[]> block(new char[1024]);
+      for (int i = 0; i < 1024; ++i) sum += i * i;
+      if (kept.size() < 1000) kept.push_back(std::move(block));
+    }
+  });
+  std::string cpu_path, heap_path;
+  absl::Status status = CaptureProfiles(TestOptions(), absl::Milliseconds(300),
+                                        &cpu_path, &heap_path);
+  done = true;
+  worker.join();
+  ASSERT_TRUE(status.ok()) << status;
+
+  std::string cpu = ReadFile(cpu_path);
+  ASSERT_GT(cpu.size(), 8 * sizeof(uintptr_t));
+  const uintptr_t *words = reinterpret_cast<const uintptr_t *>(cpu.data());
+  EXPECT_EQ(words[0], 0);
+  EXPECT_EQ(words[1], 3);
+  EXPECT_EQ(words[3], 10000);
+  // Some samples were taken.
+  EXPECT_GT(words[5], 0);
+  EXPECT_NE(cpu.find("[stack]"), std::string::npos);
+
+  ASSERT_FALSE(heap_path.empty());
+  std::string heap = ReadFile(heap_path);
+  EXPECT_EQ(heap.rfind("heap profile: ", 0), 0);
+  EXPECT_NE(heap.find("@ heap_v2/4096\n"), std::string::npos);
+  EXPECT_NE(heap.find("] @ 0x"), std::string::npos);
+  EXPECT_NE(heap.find("\nMAPPED_LIBRARIES:\n"), std::string::npos);
+}
+
+// CPU samples land in contention traces, which unwind the stack too.
+TEST(FujiProfilerTest, CapturesDuringContentionTraces) {
+  EnableContentionProfiling();
+  absl::Mutex mu;
+  std::atomic<bool> done{false};
+  std::vector<std::thread> workers;
+  for (int i = 0; i < 4; ++i) {
+    workers.emplace_back([&]() {
+      volatile uint64_t sum = 0;
+      while (!done) {
+        absl::MutexLock l(&mu);
+        for (int j = 0; j < 1000; ++j) sum += j;
+      }
+    });
+  }
+  std::string cpu_path, heap_path;
+  absl::Status status = CaptureProfiles(TestOptions(), absl::Milliseconds(300),
+                                        &cpu_path, &heap_path);
+  done = true;
+  for (std::thread &worker : workers) worker.join();
+  ASSERT_TRUE(status.ok()) << status;
+  EXPECT_NE(ContentionProfile().find("cycles/second"), std::string::npos);
+}
+
+TEST(FujiProfilerTest, OneCaptureAtATime) {
+  std::string cpu_path, heap_path;
+  absl::Status first;
+  std::thread capture([&]() {
+    std::string cpu, heap;
+    first = CaptureProfiles(TestOptions(), absl::Milliseconds(200), &cpu,
+                            &heap);
+  });
+  absl::SleepFor(absl::Milliseconds(50));
+  EXPECT_TRUE(absl::IsUnavailable(CaptureProfiles(
+      TestOptions(), absl::Milliseconds(10), &cpu_path, &heap_path)));
+  capture.join();
+  EXPECT_TRUE(first.ok()) << first;
+}
+
+}  // namespace
+}  // namespace fuji_iot
@@ -0,0 +1,84 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_realtime.h"
+
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+
+namespace fuji_iot {
+namespace {
+
+absl::Status ErrnoStatus(const std::string &what, int err) {
+  return absl::PermissionDeniedError(absl::StrCat(what, ": ", strerror(err)));
+}
+
+// Touches stack pages below the current frame. With MCL_FUTURE in effect
+// they stay resident for the lifetime of the thread.
+void PrefaultStack(size_t bytes) {
+  volatile char *stack = static_cast<volatile char *>(alloca(bytes));
+  for (size_t i = 0; i < bytes; i += 4096) stack[i] = 0;
+}
+
+}  // namespace
+
+absl::Status ApplyRealtimeOptions(const RealtimeOptions &options) {
+  absl::Status status;
+  if (!options.enabled) return status;
+
+  if (options.lock_memory) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+      status.Update(ErrnoStatus("mlockall", errno));
+    } else {
+      PrefaultStack(options.stack_prefault_bytes);
+    }
+  }
+
+  if (options.cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(options.cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+      status.Update(ErrnoStatus(absl::StrCat("affinity cpu ", options.cpu), err));
+    }
+  }
+
+  sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = options.priority;
+  int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err != 0) {
+    status.Update(ErrnoStatus(
+        absl::StrCat("SCHED_FIFO priority ", options.priority), err));
+  }
+
+  if (status.ok()) {
+    LOG(INFO) << "Bus thread running with SCHED_FIFO priority "
+              << options.priority;
+  }
+  return status;
+}
+
+}  // namespace fuji_iot
@@ -0,0 +1,47 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_REALTIME_H_
+#define FUJI_AC_REALTIME_H_
+
+#include <cstddef>
+
+#include "absl/status/status.h"
+
+namespace fuji_iot {
+// Scheduling parameters for the thread that talks to the AC unit. Main unit
+// expects the reply within a short window after its own frame, so on a busy
+// host the bus thread may be promoted to real-time scheduling.
+struct RealtimeOptions {
+  // When false, none of the settings below are applied.
+  bool enabled = false;
+  // SCHED_FIFO priority (1-99).
+  int priority = 50;
+  // CPU the thread is pinned to, -1 leaves affinity unchanged.
+  int cpu = -1;
+  // Locks current and future pages of the process in memory.
+  bool lock_memory = true;
+  // Amount of stack touched up front, so that page faults do not happen
+  // while replying. Only effective together with lock_memory.
+  size_t stack_prefault_bytes = 128 * 1024;
+};
+
+// Applies options to the calling thread. Every step is attempted, error
+// describes the first one that failed (usually because of missing
+// CAP_SYS_NICE or CAP_IPC_LOCK).
+absl::Status ApplyRealtimeOptions(const RealtimeOptions &options);
+
+}  // namespace fuji_iot
+
+#endif
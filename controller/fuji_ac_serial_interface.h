@@ -15,6 +15,8 @@
 #ifndef FUJI_AC_SERIAL_INTERFACE_H_
 #define FUJI_AC_SERIAL_INTERFACE_H_
 
+#include <bits/stdint-uintn.h>
+
 #include <memory>
 
 #include "absl/types/optional.h"
@@ -22,12 +24,41 @@
 
 namespace fuji_iot
 {
+    // Counters describing quality of the serial line.
+    struct FujiLineStats
+    {
+        // Raw bytes read from the device, including parity marks.
+        uint64_t bytes_received = 0;
+        // Bytes received with parity or framing error.
+        uint64_t parity_errors = 0;
+        uint64_t frames_received = 0;
+        // Frames dropped because of parity errors.
+        uint64_t frames_dropped = 0;
+        // Frames dropped because line went silent before 8 bytes arrived.
+        uint64_t frames_incomplete = 0;
+        // Bytes of our own transmissions removed from the received stream.
+        uint64_t echo_bytes_suppressed = 0;
+        // True if transmitted frames are echoed back and get suppressed.
+        bool echo_suppression_active = false;
+        // Times connection to a network serial bridge was established.
+        uint64_t connects = 0;
+    };
+
     // Virtual interface for reading and writing communication frames.
     class FujiAcSerialInterface
     {
     public:
+        virtual ~FujiAcSerialInterface() = default;
+        // Should return once the frame was transmitted, time spent here counts
+        // towards the reply window.
         virtual void WriteControllerFrame(const FujiControllerFrame &frame) = 0;
         virtual absl::optional<FujiMasterFrame> ReadMasterFrame() = 0;
+        // Returns line quality counters, empty if the interface does not
+        // collect them. May be called from any thread.
+        virtual absl::optional<FujiLineStats> LineStats() const
+        {
+            return absl::optional<FujiLineStats>();
+        }
     };
 
 } // namespace fuji_iot
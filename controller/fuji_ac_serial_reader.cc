@@ -23,7 +23,9 @@
 #undef termio
 #undef winsize
 
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <termios.h>
 #include <unistd.h>
 #include <sys/file.h>
@@ -38,9 +40,16 @@
 namespace fuji_iot
 {
 
-    FujiAcSerialReader::FujiAcSerialReader(const int fd)
+    // Time given to echo of a transmitted frame to show up during the
+    // self-test. UART receive FIFO may hold bytes for a few character times,
+    // which is tens of milliseconds at 500 baud.
+    constexpr int kEchoProbeTimeoutMs = 100;
+
+    FujiAcSerialReader::FujiAcSerialReader(const int fd, FujiEchoSuppressor::Mode echo_mode)
+        : echo_(echo_mode)
     {
         fd_ = fd;
+        echo_suppression_active_ = echo_.Active();
     }
 
     FujiAcSerialReader::~FujiAcSerialReader()
@@ -48,7 +57,8 @@ namespace fuji_iot
         close(fd_);
     }
 
-    std::unique_ptr<FujiAcSerialReader> FujiAcSerialReader::Build(const std::string &device_name)
+    std::unique_ptr<FujiAcSerialReader> FujiAcSerialReader::Build(
+        const std::string &device_name, FujiEchoSuppressor::Mode echo_mode)
     {
         VLOG(3) << "Attempting to open " << device_name;
         int fd = open(device_name.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
@@ -56,7 +66,7 @@ namespace fuji_iot
         {
             PLOG(FATAL) << "Failed to open device: " << device_name;
         }
-        std::unique_ptr<FujiAcSerialReader> reader(new FujiAcSerialReader(fd));
+        std::unique_ptr<FujiAcSerialReader> reader(new FujiAcSerialReader(fd, echo_mode));
         VLOG(3) << "Exclusively locking " << device_name;
         if (flock(fd, LOCK_EX | LOCK_NB) < 0)
         {
@@ -75,15 +85,16 @@ namespace fuji_iot
         tty.c_oflag &= ~(OPOST | ONLCR | OCRNL);
         tty.c_iflag &= ~(INLCR | IGNCR | ICRNL | IGNBRK);
         tty.c_iflag &= ~IUCLC;
-        tty.c_iflag &= ~PARMRK;
 
         // 8 byte word
         tty.c_cflag &= ~CSIZE;
         tty.c_cflag |= CS8;
         // One stop bit.
         tty.c_cflag &= ~(CSTOPB);
-        // Parity even.
-        tty.c_iflag &= ~(INPCK | ISTRIP);
+        // Parity even. Bytes with parity errors are marked by the kernel
+        // (see FujiParityMarkDecoder) so that corrupted frames can be dropped.
+        tty.c_iflag &= ~(IGNPAR | ISTRIP);
+        tty.c_iflag |= (INPCK | PARMRK);
         tty.c_cflag &= ~(PARODD | CMSPAR);
         tty.c_cflag |= (PARENB);
         // No flow control
@@ -135,32 +146,96 @@ namespace fuji_iot
         {
             data[i] ^= 0xFF;
         }
+        echo_.OnTransmit(data.data(), data.size());
         VLOG(3) << "Writing to device";
         if (write(fd_, data.data(), 8) != 8)
         {
             PLOG(FATAL) << "Failed to write to device";
         }
+        // Return only after the frame was physically transmitted, so that
+        // caller can tell whether reply fit into the response window.
+        if (tcdrain(fd_) < 0)
+        {
+            PLOG(FATAL) << "Failed to drain device";
+        }
+        if (echo_.Probing())
+        {
+            // Self-test: echo, if present, arrives right after transmission.
+            // Received bytes are left for ReadMasterFrame to match.
+            struct pollfd pfd = {fd_, POLLIN, 0};
+            int ready;
+            // Interrupted by SIGPROF while a profile is being captured.
+            do
+            {
+                ready = poll(&pfd, 1, kEchoProbeTimeoutMs);
+            } while (ready < 0 && errno == EINTR);
+            if (ready < 0)
+            {
+                PLOG(FATAL) << "Failed to poll device";
+            }
+            if (ready == 0)
+            {
+                echo_.OnSilence();
+                echo_suppression_active_ = echo_.Active();
+            }
+        }
         VLOG(3) << "Succesfully wrote frame to device";
     }
 
     absl::optional<FujiMasterFrame> FujiAcSerialReader::ReadMasterFrame()
     {
         std::array<uint8_t, 8> data;
+        size_t bytes = 0;
+        size_t errors = 0;
         VLOG(3) << "reading from tty device";
-        int bytes = read(fd_, data.data(), 8);
-        if (bytes < 0)
+        while (bytes < data.size())
         {
-            PLOG(FATAL) << "Failed to read from device";
+            // Every decoded byte takes at least one raw byte, so reading no
+            // more than what is missing never consumes the next frame.
+            std::array<uint8_t, 8> raw;
+            int raw_bytes = read(fd_, raw.data(), data.size() - bytes);
+            if (raw_bytes < 0)
+            {
+                PLOG(FATAL) << "Failed to read from device";
+            }
+            if (raw_bytes == 0)
+            {
+                // Line went silent.
+                break;
+            }
+            bytes_received_ += raw_bytes;
+            size_t decoded = decoder_.Decode(raw.data(), raw_bytes, data.data() + bytes, &errors);
+            if (echo_.Pending())
+            {
+                size_t kept = echo_.Filter(data.data() + bytes, decoded);
+                echo_bytes_suppressed_ += decoded - kept;
+                echo_suppression_active_ = echo_.Active();
+                decoded = kept;
+            }
+            bytes += decoded;
         }
+        decoder_.Reset();
         VLOG(3) << "read " << bytes << " bytes";
         absl::SleepFor(absl::Milliseconds(30));
+        if (errors > 0)
+        {
+            parity_errors_ += errors;
+            frames_dropped_++;
+            VLOG(3) << "Dropping frame with " << errors << " parity errors";
+            return absl::optional<FujiMasterFrame>();
+        }
         if (bytes < 8)
         {
+            if (bytes > 0)
+            {
+                frames_incomplete_++;
+            }
             VLOG(3) << "Skipping incomplete frame: " << bytes;
             return absl::optional<FujiMasterFrame>();
         }
         else
         {
+            frames_received_++;
             for (int i = 0; i < 8; i++)
             {
                 data[i] ^= 0xFF;
@@ -170,4 +245,17 @@ namespace fuji_iot
             return f;
         }
     }
+
+    absl::optional<FujiLineStats> FujiAcSerialReader::LineStats() const
+    {
+        FujiLineStats stats;
+        stats.bytes_received = bytes_received_;
+        stats.parity_errors = parity_errors_;
+        stats.frames_received = frames_received_;
+        stats.frames_dropped = frames_dropped_;
+        stats.frames_incomplete = frames_incomplete_;
+        stats.echo_bytes_suppressed = echo_bytes_suppressed_;
+        stats.echo_suppression_active = echo_suppression_active_;
+        return stats;
+    }
 } // namespace fuji_iot
@@ -15,11 +15,14 @@
 #ifndef FUJI_AC_SERIAL_READER_H_
 #define FUJI_AC_SERIAL_READER_H_
 
+#include <atomic>
 #include <memory>
 #include <string>
 
 #include "absl/types/optional.h"
 #include "controller/fuji_ac_serial_interface.h"
+#include "controller/fuji_echo_suppressor.h"
+#include "controller/fuji_parity_mark_decoder.h"
 
 namespace fuji_iot
 {
@@ -28,14 +31,27 @@ namespace fuji_iot
     {
     public:
         // Creates the interface over device_name tty and configures communication parameters.
-        static std::unique_ptr<FujiAcSerialReader> Build(const std::string &device_name);
+        // echo_mode selects whether our own transmissions are expected to be read back.
+        static std::unique_ptr<FujiAcSerialReader> Build(
+            const std::string &device_name,
+            FujiEchoSuppressor::Mode echo_mode = FujiEchoSuppressor::Mode::AUTO);
         ~FujiAcSerialReader();
         virtual void WriteControllerFrame(const FujiControllerFrame &frame) override;
         virtual absl::optional<FujiMasterFrame> ReadMasterFrame() override;
+        virtual absl::optional<FujiLineStats> LineStats() const override;
 
     private:
-        FujiAcSerialReader(const int fd);
+        FujiAcSerialReader(const int fd, FujiEchoSuppressor::Mode echo_mode);
         int fd_;
+        FujiParityMarkDecoder decoder_;
+        FujiEchoSuppressor echo_;
+        std::atomic<uint64_t> bytes_received_{0};
+        std::atomic<uint64_t> parity_errors_{0};
+        std::atomic<uint64_t> frames_received_{0};
+        std::atomic<uint64_t> frames_dropped_{0};
+        std::atomic<uint64_t> frames_incomplete_{0};
+        std::atomic<uint64_t> echo_bytes_suppressed_{0};
+        std::atomic<bool> echo_suppression_active_{false};
     };
 
 } // namespace fuji_iot
@@ -16,132 +16,150 @@
 #include <memory>
 #include <string>
 
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
 #include "controller/fuji_ac_controller.grpc.pb.h"
 #include "controller/fuji_ac_controller.h"
+#include "controller/fuji_ac_lock_profile.h"
+#include "controller/fuji_ac_profiler.h"
 #include "controller/fuji_ac_serial_reader.h"
+#include "controller/fuji_ac_service.h"
+#include "controller/fuji_ac_tcp_serial.h"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "grpcpp/grpcpp.h"
-#include "sim/fuji_ac_unit_sim.h"
+#include "sim/fuji_ac_room_sim.h"
+#include "sim/fuji_ac_sim_serial.h"
 
 DEFINE_string(serial_port, "/dev/ttyAMA0",
               "Port to use with AC Unit communication");
+DEFINE_string(serial_bridge, "",
+              "host:port of a raw TCP serial bridge (e.g. ser2net) attached "
+              "to the AC Unit, used instead of --serial_port when set");
 DEFINE_bool(sim, false, "If true uses simulated AC Unit.");
+DEFINE_double(sim_room_speedup, 0,
+              "With --sim, a heated room with a working household is "
+              "simulated this many times faster than real time, its "
+              "occupants changing the unit with the IR remote. 0 keeps the "
+              "simulated unit unchanged.");
 DEFINE_string(bind_address, "",
               "Specifies bind address, all interfaces by default");
 DEFINE_int32(bind_port, 12345, "Specifies bind port");
+DEFINE_bool(realtime, false,
+            "If true, bus thread runs with SCHED_FIFO priority and locked "
+            "memory. Requires CAP_SYS_NICE and CAP_IPC_LOCK.");
+DEFINE_int32(realtime_priority, 50, "SCHED_FIFO priority of the bus thread");
+DEFINE_int32(realtime_cpu, -1,
+             "CPU the bus thread is pinned to, -1 to leave it unpinned");
+DEFINE_int32(reply_window_ms, 300,
+             "Replies completed later than this after master frame are "
+             "counted as late");
+DEFINE_string(echo_suppression, "auto",
+              "One of auto, on, off. Whether frames transmitted to AC unit "
+              "are read back on the shared wire and have to be skipped. auto "
+              "detects it with first transmitted frames.");
+DEFINE_double(update_rate_limit, 1,
+              "Updates per second a single client may make on average, 0 "
+              "disables the limit. Clients over the limit get "
+              "RESOURCE_EXHAUSTED.");
+DEFINE_double(update_burst, 5,
+              "Updates a client may make at once before the rate limit "
+              "applies.");
+DEFINE_string(trusted_gateway_peers, "",
+              "Comma separated addresses of gateways, e.g. "
+              "ipv4:192.168.1.2, whose calls are charged to the client they "
+              "forward rather than to the gateway. Other callers are told "
+              "apart by address.");
+DEFINE_bool(listen_only, false,
+            "If true never transmits, only follows traffic of an AC unit "
+            "that already has a wired controller. Updates are rejected.");
+DEFINE_bool(yield_to_foreign_controller, true,
+            "If true, changes made on another wired controller sharing the "
+            "bus win over ours made at the same time.");
+DEFINE_bool(lock_profiling, false,
+            "If true, records wait and hold times of the controller state "
+            "lock, reported by GetMetrics, and contention of all mutexes, "
+            "served by GetContentionProfile in pprof format.");
+DEFINE_string(profile_dir, "",
+              "Directory CaptureProfile writes CPU and heap profiles to, "
+              "e.g. /var/log/fuji. Empty disables CaptureProfile, which "
+              "anyone reaching the port could otherwise call.");
+DEFINE_string(session_file, "",
+              "File keeping the login session across restarts, so that the "
+              "controller is usable sooner after one. Empty disables it.");
 
 namespace fuji_iot {
 
-class FujiACControllerSimServiceImpl final
-    : public proto::FujiACControllerService::Service,
-      FujiAcSerialInterface {
- public:
-  FujiACControllerSimServiceImpl() {
-    sim_ = std::unique_ptr<sim::FujiAcUnitSim>(new sim::FujiAcUnitSim());
-    controller_ = std::move(FujiAcController::MakeFujiAcController(this));
-  }
-
-  virtual void WriteControllerFrame(const FujiControllerFrame &frame) {
-    sim_->PushControllerFrame(frame);
-  }
+FujiAcControllerOptions ControllerOptionsFromFlags() {
+  FujiAcControllerOptions options;
+  options.realtime.enabled = FLAGS_realtime;
+  options.realtime.priority = FLAGS_realtime_priority;
+  options.realtime.cpu = FLAGS_realtime_cpu;
+  options.reply_window = absl::Milliseconds(FLAGS_reply_window_ms);
+  options.update_rate_limit = FLAGS_update_rate_limit;
+  options.update_burst = FLAGS_update_burst;
+  options.trusted_gateway_peers =
+      absl::StrSplit(FLAGS_trusted_gateway_peers, ',', absl::SkipEmpty());
+  options.listen_only = FLAGS_listen_only;
+  options.yield_to_foreign_controller = FLAGS_yield_to_foreign_controller;
+  options.session_file = FLAGS_session_file;
+  options.lock_profiling = FLAGS_lock_profiling;
+  return options;
+}
 
-  virtual absl::optional<FujiMasterFrame> ReadMasterFrame() override {
-    absl::SleepFor(absl::Seconds(1));
-    return sim_->GetNextMasterFrame();
+FujiEchoSuppressor::Mode EchoModeFromFlags() {
+  if (FLAGS_echo_suppression == "on") return FujiEchoSuppressor::Mode::ON;
+  if (FLAGS_echo_suppression == "off") return FujiEchoSuppressor::Mode::OFF;
+  if (FLAGS_echo_suppression != "auto") {
+    LOG(FATAL) << "Invalid --echo_suppression: " << FLAGS_echo_suppression;
   }
+  return FujiEchoSuppressor::Mode::AUTO;
+}
 
-  ::grpc::Status GetStatus(::grpc::ServerContext *context,
-                           const proto::StatusRequest *request,
-                           proto::StatusResponse *response) {
-    VLOG(3) << "GetStatus query";
-    auto state = controller_->GetStatus();
-    VLOG(3) << "Responding with state: " << state.DebugString();
-    *response->mutable_state() = state;
-    return ::grpc::Status::OK;
+FujiAcTcpSerialOptions TcpSerialOptionsFromFlags() {
+  FujiAcTcpSerialOptions options;
+  size_t colon = FLAGS_serial_bridge.rfind(':');
+  if (colon == std::string::npos ||
+      !absl::SimpleAtoi(FLAGS_serial_bridge.substr(colon + 1), &options.port)) {
+    LOG(FATAL) << "Invalid --serial_bridge: " << FLAGS_serial_bridge;
   }
+  options.host = FLAGS_serial_bridge.substr(0, colon);
+  return options;
+}
 
-  ::grpc::Status Update(::grpc::ServerContext *context,
-                        const proto::UpdateRequest *request,
-                        proto::StatusResponse *response) {
-    LOG(INFO) << "Update query request: " << request->DebugString();
-    auto status = controller_->Update(request->new_state());
-    if (status.ok()) {
-      LOG(INFO) << "Update successful";
-      *response->mutable_state() = controller_->GetStatus();
-      return ::grpc::Status::OK;
+// Creates serial interface selected by --sim, --serial_bridge and
+// --serial_port flags.
+std::unique_ptr<FujiAcSerialInterface> SerialFromFlags() {
+  if (FLAGS_sim) {
+    std::unique_ptr<sim::FujiAcSimSerial> serial(new sim::FujiAcSimSerial());
+    if (FLAGS_sim_room_speedup > 0) {
+      // Master frames of the simulated unit are one second apart.
+      serial->AttachRoom(sim::MakeWorkdayRoomSim(),
+                         absl::Seconds(FLAGS_sim_room_speedup));
     }
-    LOG(ERROR) << "Update failed: " << status;
-    return ::grpc::Status(grpc::StatusCode::INTERNAL,
-                          "Failed to update the controller.");
-  }
-
- private:
-  std::unique_ptr<FujiAcController> controller_;
-  std::unique_ptr<sim::FujiAcUnitSim> sim_;
-};
-
-class FujiACControllerRealServiceImpl final
-    : public proto::FujiACControllerService::Service,
-      FujiAcSerialInterface {
- public:
-  FujiACControllerRealServiceImpl() {
-    reader_ = FujiAcSerialReader::Build(FLAGS_serial_port);
-    controller_ = std::move(FujiAcController::MakeFujiAcController(this));
-  }
-
-  virtual void WriteControllerFrame(const FujiControllerFrame &frame) {
-    reader_->WriteControllerFrame(frame);
+    return serial;
   }
-
-  virtual absl::optional<FujiMasterFrame> ReadMasterFrame() override {
-    return reader_->ReadMasterFrame();
-  }
-
-  ::grpc::Status GetStatus(::grpc::ServerContext *context,
-                           const proto::StatusRequest *request,
-                           proto::StatusResponse *response) {
-    VLOG(3) << "GetStatus query";
-    auto state = controller_->GetStatus();
-    VLOG(3) << "Responding with state: " << state.DebugString();
-    *response->mutable_state() = state;
-    return ::grpc::Status::OK;
-  }
-
-  ::grpc::Status Update(::grpc::ServerContext *context,
-                        const proto::UpdateRequest *request,
-                        proto::StatusResponse *response) {
-    LOG(INFO) << "Update query request: " << request->DebugString();
-    auto status = controller_->Update(request->new_state());
-    if (status.ok()) {
-      LOG(INFO) << "Update successful";
-      *response->mutable_state() = controller_->GetStatus();
-      return ::grpc::Status::OK;
-    }
-    LOG(ERROR) << "Update failed: " << status;
-    return ::grpc::Status(grpc::StatusCode::INTERNAL,
-                          "Failed to update the controller.");
+  if (!FLAGS_serial_bridge.empty()) {
+    return FujiAcTcpSerial::Build(TcpSerialOptionsFromFlags());
   }
+  return FujiAcSerialReader::Build(FLAGS_serial_port, EchoModeFromFlags());
+}
 
- private:
-  std::unique_ptr<FujiAcController> controller_;
-  std::unique_ptr<FujiAcSerialReader> reader_;
-};
-
-// Will run server with either real controller or simulated one based on --sim
-// flag.
+// Will run server with simulated controller, network serial bridge or local
+// serial port based on --sim and --serial_bridge flags.
 void RunServer() {
+  if (FLAGS_lock_profiling) EnableContentionProfiling();
+  if (!FLAGS_profile_dir.empty()) {
+    FujiProfilerOptions profiler_options;
+    profiler_options.dir = FLAGS_profile_dir;
+    EnableProfileCapture(profiler_options);
+  }
   std::string server_address =
       absl::StrFormat("%s:%d", FLAGS_bind_address, FLAGS_bind_port);
-  std::unique_ptr<proto::FujiACControllerService::Service> service;
-  if (FLAGS_sim) {
-    service = std::unique_ptr<FujiACControllerSimServiceImpl>(
-        new FujiACControllerSimServiceImpl());
-  } else {
-    service = std::unique_ptr<FujiACControllerRealServiceImpl>(
-        new FujiACControllerRealServiceImpl());
-  }
+  std::unique_ptr<proto::FujiACControllerService::Service> service(
+      new FujiACControllerServiceImpl(SerialFromFlags(),
+                                      ControllerOptionsFromFlags()));
 
   grpc::ServerBuilder builder;
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
@@ -0,0 +1,215 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_service.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "controller/fuji_ac_client_id.h"
+#include "controller/fuji_ac_trace.h"
+#include "glog/logging.h"
+
+namespace fuji_iot {
+namespace {
+
+// How often streaming calls check whether the client went away.
+constexpr absl::Duration kWatchCancelCheckInterval = absl::Milliseconds(500);
+
+void LineStatsToProto(const FujiLineStats &stats,
+                      proto::LineQualityMetrics *line) {
+  line->set_bytes_received(stats.bytes_received);
+  line->set_parity_errors(stats.parity_errors);
+  line->set_frames_received(stats.frames_received);
+  line->set_frames_dropped(stats.frames_dropped);
+  line->set_frames_incomplete(stats.frames_incomplete);
+  if (stats.bytes_received > 0) {
+    line->set_error_rate(static_cast<double>(stats.parity_errors) /
+                         stats.bytes_received);
+  }
+  line->set_echo_bytes_suppressed(stats.echo_bytes_suppressed);
+  line->set_echo_suppression_active(stats.echo_suppression_active);
+  line->set_connects(stats.connects);
+}
+
+// Returns false for requests setting no field, which are status queries.
+bool ChangesState(const proto::UpdateRequest &request) {
+  if (request.has_update_mask()) return request.update_mask().paths_size() > 0;
+  const proto::ACUnitState &state = request.new_state();
+  return state.mode() != proto::MODE_UNKNOWN ||
+         state.fan() != proto::FAN_UNKNOWN ||
+         state.setpoint_temperature() != 0;
+}
+
+}  // namespace
+
+FujiACControllerServiceImpl::FujiACControllerServiceImpl(
+    std::unique_ptr<FujiAcSerialInterface> serial,
+    const FujiAcControllerOptions &options)
+    : serial_(std::move(serial)),
+      trusted_gateway_peers_(options.trusted_gateway_peers) {
+  controller_ = FujiAcController::MakeFujiAcController(serial_.get(), options);
+}
+
+FujiACControllerServiceImpl::~FujiACControllerServiceImpl() {
+  controller_->Shutdown();
+}
+
+::grpc::Status FujiACControllerServiceImpl::GetStatus(
+    ::grpc::ServerContext *context, const proto::StatusRequest *request,
+    proto::StatusResponse *response) {
+  VLOG(3) << "GetStatus query";
+  *response = *controller_->GetSharedStatus();
+  FUJI_AC_TRACE(get_status_served, response->version());
+  VLOG(3) << "Responding with state: " << response->DebugString();
+  return ::grpc::Status::OK;
+}
+
+::grpc::Status FujiACControllerServiceImpl::Update(
+    ::grpc::ServerContext *context, const proto::UpdateRequest *request,
+    proto::StatusResponse *response) {
+  LOG(INFO) << "Update query request: " << request->DebugString();
+  absl::Status status;
+  // Status queries cost no bus cycle and are not charged.
+  if (ChangesState(*request)) {
+    status = controller_->AdmitUpdate(
+        ClientId(*context, trusted_gateway_peers_));
+  }
+  if (!status.ok()) {
+    LOG(INFO) << "Update rejected: " << status;
+    return ::grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                          std::string(status.message()));
+  }
+  if (request->has_update_mask() || request->has_expected_version()) {
+    absl::optional<uint64_t> expected_version;
+    if (request->has_expected_version()) {
+      expected_version = request->expected_version();
+    }
+    status = controller_->Update(request->new_state(), request->update_mask(),
+                                 expected_version);
+  } else {
+    status = controller_->Update(request->new_state());
+  }
+  if (status.ok()) {
+    LOG(INFO) << "Update successful";
+    *response = *controller_->GetSharedStatus();
+    return ::grpc::Status::OK;
+  }
+  // Conflicts, bad requests, updates in listen-only mode and during shutdown
+  // are reported as they are, absl and gRPC status codes share values.
+  if (absl::IsAborted(status) || absl::IsInvalidArgument(status) ||
+      absl::IsFailedPrecondition(status) || absl::IsUnavailable(status)) {
+    LOG(INFO) << "Update rejected: " << status;
+    return ::grpc::Status(static_cast<grpc::StatusCode>(status.code()),
+                          std::string(status.message()));
+  }
+  LOG(ERROR) << "Update failed: " << status;
+  return ::grpc::Status(grpc::StatusCode::INTERNAL,
+                        "Failed to update the controller.");
+}
+
+::grpc::Status FujiACControllerServiceImpl::GetMetrics(
+    ::grpc::ServerContext *context, const proto::MetricsRequest *request,
+    proto::MetricsResponse *response) {
+  *response->mutable_reply_timing() = controller_->GetReplyTimingMetrics();
+  *response->mutable_bus() = controller_->GetBusMetrics();
+  *response->mutable_session() = controller_->GetSessionMetrics();
+  proto::LockMetrics locks = controller_->GetLockMetrics();
+  if (locks.sites_size() > 0) *response->mutable_locks() = std::move(locks);
+  absl::optional<FujiLineStats> stats = serial_->LineStats();
+  if (stats.has_value()) {
+    LineStatsToProto(stats.value(), response->mutable_line_quality());
+  }
+  return ::grpc::Status::OK;
+}
+
+::grpc::Status FujiACControllerServiceImpl::GetBusDevices(
+    ::grpc::ServerContext *context, const proto::BusDevicesRequest *request,
+    proto::BusDevicesResponse *response) {
+  *response = controller_->GetBusDevices();
+  return ::grpc::Status::OK;
+}
+
+::grpc::Status FujiACControllerServiceImpl::GetContentionProfile(
+    ::grpc::ServerContext *context,
+    const proto::ContentionProfileRequest *request,
+    proto::ContentionProfileResponse *response) {
+  if (!ContentionProfilingEnabled()) {
+    return ::grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                          "Lock profiling is disabled, see --lock_profiling.");
+  }
+  response->set_profile(ContentionProfile());
+  return ::grpc::Status::OK;
+}
+
+::grpc::Status FujiACControllerServiceImpl::CaptureProfile(
+    ::grpc::ServerContext *context, const proto::CaptureProfileRequest *request,
+    proto::CaptureProfileResponse *response) {
+  LOG(INFO) << "Profile requested for " << request->seconds() << "s";
+  std::string cpu_path, heap_path;
+  absl::Status status = CaptureProfiles(absl::Seconds(request->seconds()),
+                                        &cpu_path, &heap_path);
+  if (!status.ok()) {
+    LOG(ERROR) << "Profile capture failed: " << status;
+    // absl and gRPC status codes share values.
+    return ::grpc::Status(static_cast<grpc::StatusCode>(status.code()),
+                          std::string(status.message()));
+  }
+  response->set_cpu_profile(cpu_path);
+  response->set_heap_profile(heap_path);
+  return ::grpc::Status::OK;
+}
+
+::grpc::Status FujiACControllerServiceImpl::WatchStatus(
+    ::grpc::ServerContext *context, const proto::WatchStatusRequest *request,
+    ::grpc::ServerWriter<proto::StatusResponse> *writer) {
+  VLOG(3) << "WatchStatus started";
+  auto status = controller_->GetSharedStatus();
+  while (writer->Write(*status)) {
+    while (!controller_->AwaitStatusChange(status->version(),
+                                           kWatchCancelCheckInterval)) {
+      if (context->IsCancelled()) return ::grpc::Status::CANCELLED;
+    }
+    status = controller_->GetSharedStatus();
+  }
+  VLOG(3) << "WatchStatus client went away";
+  return ::grpc::Status::OK;
+}
+
+::grpc::Status FujiACControllerServiceImpl::Subscribe(
+    ::grpc::ServerContext *context, const proto::SubscribeRequest *request,
+    ::grpc::ServerWriter<proto::StateEvent> *writer) {
+  VLOG(3) << "Subscribe started from seq " << request->from_seq() << " of run "
+          << request->run_id();
+  uint64_t run_id = request->run_id();
+  uint64_t seq = request->from_seq();
+  std::vector<proto::StateEvent> events;
+  while (!context->IsCancelled()) {
+    events.clear();
+    controller_->AwaitEvents(run_id, seq, kWatchCancelCheckInterval, &events);
+    for (const auto &event : events) {
+      if (!writer->Write(event)) {
+        VLOG(3) << "Subscribe client went away";
+        return ::grpc::Status::OK;
+      }
+      run_id = event.run_id();
+      seq = event.seq();
+    }
+  }
+  return ::grpc::Status::CANCELLED;
+}
+
+}  // namespace fuji_iot
@@ -0,0 +1,76 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_SERVICE_H_
+#define FUJI_AC_SERVICE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "controller/fuji_ac_controller.grpc.pb.h"
+#include "controller/fuji_ac_controller.h"
+#include "controller/fuji_ac_lock_profile.h"
+#include "controller/fuji_ac_profiler.h"
+#include "controller/fuji_ac_serial_interface.h"
+#include "grpcpp/grpcpp.h"
+
+namespace fuji_iot {
+// RPC handlers of a daemon serving a single AC unit over the given serial
+// interface. Line quality metrics are reported if the interface collects
+// them.
+class FujiACControllerServiceImpl final
+    : public proto::FujiACControllerService::Service {
+ public:
+  FujiACControllerServiceImpl(std::unique_ptr<FujiAcSerialInterface> serial,
+                              const FujiAcControllerOptions &options);
+  ~FujiACControllerServiceImpl();
+
+  ::grpc::Status GetStatus(::grpc::ServerContext *context,
+                           const proto::StatusRequest *request,
+                           proto::StatusResponse *response) override;
+  ::grpc::Status Update(::grpc::ServerContext *context,
+                        const proto::UpdateRequest *request,
+                        proto::StatusResponse *response) override;
+  ::grpc::Status GetMetrics(::grpc::ServerContext *context,
+                            const proto::MetricsRequest *request,
+                            proto::MetricsResponse *response) override;
+  ::grpc::Status GetBusDevices(::grpc::ServerContext *context,
+                               const proto::BusDevicesRequest *request,
+                               proto::BusDevicesResponse *response) override;
+  ::grpc::Status GetContentionProfile(
+      ::grpc::ServerContext *context,
+      const proto::ContentionProfileRequest *request,
+      proto::ContentionProfileResponse *response) override;
+  ::grpc::Status CaptureProfile(
+      ::grpc::ServerContext *context,
+      const proto::CaptureProfileRequest *request,
+      proto::CaptureProfileResponse *response) override;
+  ::grpc::Status WatchStatus(
+      ::grpc::ServerContext *context, const proto::WatchStatusRequest *request,
+      ::grpc::ServerWriter<proto::StatusResponse> *writer) override;
+  ::grpc::Status Subscribe(
+      ::grpc::ServerContext *context, const proto::SubscribeRequest *request,
+      ::grpc::ServerWriter<proto::StateEvent> *writer) override;
+
+ private:
+  // Declared first, so that controller stops using it before it is destroyed.
+  std::unique_ptr<FujiAcSerialInterface> serial_;
+  std::unique_ptr<FujiAcController> controller_;
+  const std::vector<std::string> trusted_gateway_peers_;
+};
+
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,79 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_session_file.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "glog/logging.h"
+
+namespace fuji_iot {
+
+absl::optional<FujiLoginSession> LoadLoginSession(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) return absl::nullopt;
+  std::stringstream contents;
+  contents << in.rdbuf();
+  std::vector<std::string> fields =
+      absl::StrSplit(contents.str(), ' ', absl::SkipWhitespace());
+  FujiLoginSession session;
+  int present = 0;
+  bool ok = fields.size() == session.login_register.size() + 1;
+  for (size_t i = 0; ok && i < session.login_register.size(); i++) {
+    uint32_t byte = 0;
+    ok = fields[i].size() == 2 && absl::SimpleHexAtoi(fields[i], &byte);
+    session.login_register[i] = byte;
+  }
+  if (!ok || !absl::SimpleAtoi(fields.back(), &present) ||
+      (present != 0 && present != 1)) {
+    LOG(WARNING) << "Ignoring malformed login session in " << path;
+    return absl::nullopt;
+  }
+  session.controller_present = present == 1;
+  return session;
+}
+
+absl::Status SaveLoginSession(const std::string &path,
+                              const FujiLoginSession &session) {
+  const std::array<uint8_t, 5> &r = session.login_register;
+  std::string contents =
+      absl::StrFormat("%02x %02x %02x %02x %02x %d\n", r[0], r[1], r[2], r[3],
+                      r[4], session.controller_present ? 1 : 0);
+  std::string tmp = absl::StrCat(path, ".tmp");
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    out << contents;
+    out.close();
+    if (!out) {
+      return absl::UnavailableError(absl::StrCat("Cannot write ", tmp));
+    }
+  }
+  if (rename(tmp.c_str(), path.c_str()) < 0) {
+    return absl::UnavailableError(
+        absl::StrCat("rename to ", path, ": ", strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace fuji_iot
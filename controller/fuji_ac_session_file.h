@@ -0,0 +1,39 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_SESSION_FILE_H_
+#define FUJI_AC_SESSION_FILE_H_
+
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/types/optional.h"
+#include "protocol/fuji_ac_protocol_handler.h"
+
+namespace fuji_iot {
+// Login session kept in a small text file, so that a restarted controller
+// can skip the login exchange. The file holds the login register bytes in hex
+// followed by 1 if main unit listed us as its controller, e.g.
+// "1f 1f 05 01 00 1".
+
+// Returns the saved session, none if the file is missing or malformed.
+absl::optional<FujiLoginSession> LoadLoginSession(const std::string &path);
+// Replaces the file with the session. The new contents are written to a
+// temporary file first, so a crash never leaves a partial one behind.
+absl::Status SaveLoginSession(const std::string &path,
+                              const FujiLoginSession &session);
+
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,56 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_session_file.h"
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace fuji_iot {
+
+std::string TestPath(const std::string &name) {
+  const char *dir = getenv("TEST_TMPDIR");
+  return std::string(dir != nullptr ? dir : "/tmp") + "/" + name;
+}
+
+TEST(FujiAcSessionFileTest, SaveAndLoad) {
+  std::string path = TestPath("session");
+  FujiLoginSession session{{0x1f, 0x1f, 0x05, 0x01, 0x00}, true};
+  ASSERT_TRUE(SaveLoginSession(path, session).ok());
+  absl::optional<FujiLoginSession> loaded = LoadLoginSession(path);
+  ASSERT_TRUE(loaded.has_value());
+  EXPECT_EQ(session.login_register, loaded->login_register);
+  EXPECT_TRUE(loaded->controller_present);
+
+  session.controller_present = false;
+  ASSERT_TRUE(SaveLoginSession(path, session).ok());
+  EXPECT_FALSE(LoadLoginSession(path)->controller_present);
+}
+
+TEST(FujiAcSessionFileTest, MissingOrMalformed) {
+  EXPECT_FALSE(LoadLoginSession(TestPath("no_such_session")).has_value());
+  std::string path = TestPath("bad_session");
+  for (const char *contents :
+       {"", "1f 1f 05 01 1\n", "1f 1f 05 01 zz 1\n", "1f 1f 05 01 00 2\n",
+        "1f1f050100 1\n"}) {
+    std::ofstream(path, std::ios::trunc) << contents;
+    EXPECT_FALSE(LoadLoginSession(path).has_value()) << contents;
+  }
+}
+
+}  // namespace fuji_iot
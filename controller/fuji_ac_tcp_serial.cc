@@ -0,0 +1,209 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_ac_tcp_serial.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <string>
+
+#include "absl/time/clock.h"
+#include "glog/logging.h"
+
+namespace fuji_iot {
+namespace {
+
+// Timeout for establishing connection and for writing a reply.
+constexpr absl::Duration kSocketTimeout = absl::Seconds(1);
+
+int PollTimeoutMs(absl::Duration timeout) {
+  if (timeout <= absl::ZeroDuration()) return 0;
+  return static_cast<int>(
+      absl::ToInt64Milliseconds(absl::Ceil(timeout, absl::Milliseconds(1))));
+}
+
+}  // namespace
+
+FujiAcTcpSerial::FujiAcTcpSerial(const FujiAcTcpSerialOptions &options)
+    : options_(options), backoff_(options.min_backoff) {}
+
+FujiAcTcpSerial::~FujiAcTcpSerial() { Disconnect(); }
+
+std::unique_ptr<FujiAcTcpSerial> FujiAcTcpSerial::Build(
+    const FujiAcTcpSerialOptions &options) {
+  if (options.host.empty() || options.port <= 0) {
+    LOG(FATAL) << "Invalid serial bridge address: " << options.host << ":"
+               << options.port;
+  }
+  return std::unique_ptr<FujiAcTcpSerial>(new FujiAcTcpSerial(options));
+}
+
+bool FujiAcTcpSerial::EnsureConnected() {
+  if (fd_ >= 0) return true;
+  absl::Time now = absl::Now();
+  if (now < next_attempt_) {
+    absl::SleepFor(std::min(next_attempt_ - now, options_.read_timeout));
+    if (absl::Now() < next_attempt_) return false;
+  }
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = nullptr;
+  std::string port = std::to_string(options_.port);
+  int err = getaddrinfo(options_.host.c_str(), port.c_str(), &hints, &addresses);
+  if (err != 0) {
+    LOG(WARNING) << "Failed to resolve " << options_.host << ": "
+                 << gai_strerror(err);
+  } else {
+    timeval tv = absl::ToTimeval(kSocketTimeout);
+    for (addrinfo *a = addresses; a != nullptr && fd_ < 0; a = a->ai_next) {
+      int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd < 0) continue;
+      // Also bounds connect() on Linux.
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+      if (connect(fd, a->ai_addr, a->ai_addrlen) < 0) {
+        PLOG(WARNING) << "Failed to connect to " << options_.host << ":"
+                      << options_.port;
+        close(fd);
+        continue;
+      }
+      fd_ = fd;
+    }
+    freeaddrinfo(addresses);
+  }
+  if (fd_ < 0) {
+    next_attempt_ = absl::Now() + backoff_;
+    backoff_ = std::min(backoff_ * 2, options_.max_backoff);
+    return false;
+  }
+
+  // Frames are tiny and latency sensitive, never wait to coalesce them.
+  int one = 1;
+  if (setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+    PLOG(WARNING) << "Failed to set TCP_NODELAY";
+  }
+  if (setsockopt(fd_, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one)) < 0) {
+    PLOG(WARNING) << "Failed to set SO_KEEPALIVE";
+  }
+  backoff_ = options_.min_backoff;
+  buffered_ = 0;
+  connects_++;
+  LOG(INFO) << "Connected to serial bridge " << options_.host << ":"
+            << options_.port;
+  return true;
+}
+
+void FujiAcTcpSerial::Disconnect() {
+  if (fd_ < 0) return;
+  close(fd_);
+  fd_ = -1;
+  buffered_ = 0;
+  next_attempt_ = absl::Now() + backoff_;
+}
+
+void FujiAcTcpSerial::WriteControllerFrame(const FujiControllerFrame &frame) {
+  if (fd_ < 0) {
+    VLOG(3) << "Not connected, dropping frame " << frame;
+    return;
+  }
+  std::array<uint8_t, 8> data = frame.FullFrame();
+  for (int i = 0; i < 8; i++) {
+    data[i] ^= 0xFF;
+  }
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = send(fd_, data.data() + written, data.size() - written,
+                     MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      PLOG(WARNING) << "Failed to write to serial bridge";
+      Disconnect();
+      return;
+    }
+    written += n;
+  }
+  VLOG(3) << "Succesfully wrote frame to serial bridge";
+}
+
+absl::optional<FujiMasterFrame> FujiAcTcpSerial::ReadMasterFrame() {
+  if (!EnsureConnected()) return absl::optional<FujiMasterFrame>();
+  absl::Time deadline = absl::Now() + options_.read_timeout;
+  while (buffered_ < buffer_.size()) {
+    absl::Time now = absl::Now();
+    if (buffered_ > 0 && now >= last_byte_ + options_.frame_gap) {
+      VLOG(3) << "Dropping incomplete frame: " << buffered_;
+      frames_incomplete_++;
+      buffered_ = 0;
+    }
+    if (buffered_ == 0 && now >= deadline) {
+      return absl::optional<FujiMasterFrame>();
+    }
+    absl::Time wake =
+        buffered_ > 0 ? last_byte_ + options_.frame_gap : deadline;
+    pollfd pfd = {fd_, POLLIN, 0};
+    int ready = poll(&pfd, 1, PollTimeoutMs(wake - now));
+    if (ready < 0 && errno != EINTR) {
+      PLOG(FATAL) << "Failed to poll serial bridge";
+    }
+    if (ready <= 0) continue;
+    // Reading no more than what is missing leaves the next frame in the
+    // socket buffer.
+    ssize_t n = recv(fd_, buffer_.data() + buffered_,
+                     buffer_.size() - buffered_, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      if (n == 0) {
+        LOG(WARNING) << "Serial bridge closed connection";
+      } else {
+        PLOG(WARNING) << "Failed to read from serial bridge";
+      }
+      Disconnect();
+      return absl::optional<FujiMasterFrame>();
+    }
+    bytes_received_ += n;
+    buffered_ += n;
+    last_byte_ = absl::Now();
+  }
+  buffered_ = 0;
+  frames_received_++;
+  absl::SleepFor(options_.reply_delay);
+  std::array<uint8_t, 8> data = buffer_;
+  for (int i = 0; i < 8; i++) {
+    data[i] ^= 0xFF;
+  }
+  FujiMasterFrame f(data);
+  VLOG(3) << "Got master frame: " << f;
+  return f;
+}
+
+absl::optional<FujiLineStats> FujiAcTcpSerial::LineStats() const {
+  FujiLineStats stats;
+  stats.bytes_received = bytes_received_;
+  stats.frames_received = frames_received_;
+  stats.frames_incomplete = frames_incomplete_;
+  stats.connects = connects_;
+  return stats;
+}
+
+}  // namespace fuji_iot
@@ -0,0 +1,82 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_TCP_SERIAL_H_
+#define FUJI_AC_TCP_SERIAL_H_
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "controller/fuji_ac_serial_interface.h"
+
+namespace fuji_iot {
+
+struct FujiAcTcpSerialOptions {
+  // Address of a raw TCP serial bridge (e.g. ser2net "raw" port) attached to
+  // the AC unit bus. Bridge is responsible for 500 baud 8E1 line settings.
+  std::string host;
+  int port = 0;
+  // Bytes separated by longer silence do not belong to the same frame. Partial
+  // frame is dropped once the gap passes, which realigns the stream.
+  absl::Duration frame_gap = absl::Milliseconds(100);
+  // ReadMasterFrame gives up after this long without data, same as VTIME on
+  // a tty.
+  absl::Duration read_timeout = absl::Milliseconds(300);
+  // Pause after every received frame, same pacing as FujiAcSerialReader.
+  absl::Duration reply_delay = absl::Milliseconds(30);
+  // Reconnect attempts back off exponentially between these bounds.
+  absl::Duration min_backoff = absl::Milliseconds(100);
+  absl::Duration max_backoff = absl::Seconds(10);
+};
+
+// Implements FujiAcSerialInterface over a TCP connection to a serial bridge.
+// Connection is established lazily and re-established whenever it breaks.
+// While disconnected, frames are not delivered and replies are dropped.
+class FujiAcTcpSerial : public FujiAcSerialInterface {
+ public:
+  static std::unique_ptr<FujiAcTcpSerial> Build(
+      const FujiAcTcpSerialOptions &options);
+  ~FujiAcTcpSerial();
+  virtual void WriteControllerFrame(const FujiControllerFrame &frame) override;
+  virtual absl::optional<FujiMasterFrame> ReadMasterFrame() override;
+  virtual absl::optional<FujiLineStats> LineStats() const override;
+
+ private:
+  explicit FujiAcTcpSerial(const FujiAcTcpSerialOptions &options);
+  // Returns true if connected. Otherwise attempts to connect, waiting for the
+  // backoff but never longer than read_timeout.
+  bool EnsureConnected();
+  void Disconnect();
+
+  const FujiAcTcpSerialOptions options_;
+  int fd_ = -1;
+  absl::Duration backoff_;
+  absl::Time next_attempt_ = absl::InfinitePast();
+  // Partially received frame.
+  std::array<uint8_t, 8> buffer_;
+  size_t buffered_ = 0;
+  absl::Time last_byte_;
+  std::atomic<uint64_t> bytes_received_{0};
+  std::atomic<uint64_t> frames_received_{0};
+  std::atomic<uint64_t> frames_incomplete_{0};
+  std::atomic<uint64_t> connects_{0};
+};
+
+}  // namespace fuji_iot
+
+#endif
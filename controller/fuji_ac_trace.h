@@ -0,0 +1,66 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_TRACE_H_
+#define FUJI_AC_TRACE_H_
+
+// Static tracepoints (USDT) of the daemon, provider fuji_ac. When
+// <sys/sdt.h> (systemtap-sdt-dev) is found at build time, every tracepoint
+// is a single nop in the code and a note in the binary, which perf and
+// bpftrace attach to:
+//
+//   bpftrace -l 'usdt:/usr/bin/fuji_ac_server:fuji_ac:*'
+//
+// Otherwise, or with FUJI_AC_NO_TRACEPOINTS defined, they compile to
+// nothing. Arguments are evaluated whether a tracer is attached or not, so
+// they should be values at hand, not computed just for the tracepoint.
+//
+// Tracepoints and their arguments:
+//   master_frame(source, destination, register_type)
+//       Bus thread got a master frame.
+//   handler_decision(register_type, reply_register, write_bit)
+//       Protocol handler processed it. reply_register is -1 if no reply is
+//       sent.
+//   controller_frame_written(reply_register, write_bit, turnaround_ns)
+//       Reply is on the wire, turnaround counted from master_frame.
+//   update_enqueued(update, version)
+//       Update changed the local state, it waits for the unit now. update
+//       counts updates since start.
+//   update_acknowledged(update, version)
+//       The unit took the state in.
+//   get_status_served(version)
+//       GetStatus RPC answered.
+
+#if !defined(FUJI_AC_NO_TRACEPOINTS) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define FUJI_AC_HAVE_TRACEPOINTS 1
+#endif
+#endif
+
+#ifdef FUJI_AC_HAVE_TRACEPOINTS
+#define FUJI_AC_TRACE(name, ...) STAP_PROBEV(fuji_ac, name, __VA_ARGS__)
+#else
+namespace fuji_iot {
+// Keeps arguments used, so that values only traced raise no warnings.
+template <typename... Args>
+inline void IgnoreTraceArgs(const Args &...) {}
+}  // namespace fuji_iot
+#define FUJI_AC_TRACE(name, ...)                         \
+  do {                                                   \
+    if (false) ::fuji_iot::IgnoreTraceArgs(__VA_ARGS__); \
+  } while (0)
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_echo_suppressor.h"
+
+#include <algorithm>
+
+#include "glog/logging.h"
+
+namespace fuji_iot {
+
+FujiEchoSuppressor::FujiEchoSuppressor(Mode mode)
+    : mode_(mode), echo_present_(mode != Mode::OFF) {}
+
+void FujiEchoSuppressor::OnTransmit(const uint8_t *data, size_t size) {
+  if (!echo_present_) return;
+  expected_size_ = std::min(size, expected_.size());
+  std::copy(data, data + expected_size_, expected_.begin());
+  matched_ = 0;
+}
+
+void FujiEchoSuppressor::OnSilence() {
+  if (!Pending()) return;
+  expected_size_ = 0;
+  FinishProbe(false);
+}
+
+size_t FujiEchoSuppressor::Filter(uint8_t *data, size_t size) {
+  size_t skipped = 0;
+  while (Pending() && skipped < size) {
+    if (data[skipped] != expected_[matched_]) {
+      // Not our echo (or it got corrupted), leave the rest intact.
+      VLOG(3) << "Echo mismatch after " << matched_ << " bytes";
+      expected_size_ = 0;
+      FinishProbe(false);
+      break;
+    }
+    skipped++;
+    if (++matched_ == expected_size_) {
+      expected_size_ = 0;
+      FinishProbe(true);
+    }
+  }
+  suppressed_bytes_ += skipped;
+  std::copy(data + skipped, data + size, data);
+  return size - skipped;
+}
+
+void FujiEchoSuppressor::FinishProbe(bool echoed) {
+  if (!Probing()) return;
+  probes_++;
+  if (echoed) echoes_seen_++;
+  if (probes_ < kProbes) return;
+  echo_present_ = echoes_seen_ * 2 > kProbes;
+  LOG(INFO) << "Echo self-test: " << echoes_seen_ << " of " << kProbes
+            << " frames echoed, suppression "
+            << (echo_present_ ? "enabled" : "disabled");
+}
+
+bool FujiEchoSuppressor::Active() const { return echo_present_; }
+
+bool FujiEchoSuppressor::Probing() const {
+  return mode_ == Mode::AUTO && probes_ < kProbes;
+}
+
+bool FujiEchoSuppressor::Pending() const { return matched_ < expected_size_; }
+
+uint64_t FujiEchoSuppressor::SuppressedBytes() const {
+  return suppressed_bytes_;
+}
+
+}  // namespace fuji_iot
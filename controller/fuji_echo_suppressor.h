@@ -0,0 +1,72 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_ECHO_SUPPRESSOR_H_
+#define FUJI_ECHO_SUPPRESSOR_H_
+
+#include <bits/stdint-uintn.h>
+
+#include <array>
+#include <cstddef>
+
+namespace fuji_iot {
+// AC unit bus is a single wire shared for Tx/Rx, depending on wiring bytes we
+// transmit may be read back on Rx. This class tracks bytes in flight and
+// removes their echo from the received stream.
+//
+// In AUTO mode first few transmissions are used as a self-test: if they are
+// echoed back, suppression stays enabled, otherwise it is turned off.
+class FujiEchoSuppressor {
+ public:
+  enum class Mode {
+    OFF,
+    ON,
+    AUTO,
+  };
+
+  explicit FujiEchoSuppressor(Mode mode);
+  // Should be called with bytes exactly as they were written to the line.
+  void OnTransmit(const uint8_t *data, size_t size);
+  // Should be called if nothing was received shortly after transmission.
+  void OnSilence();
+  // Removes echo of transmitted bytes from the beginning of data, returns
+  // number of remaining bytes (moved to the beginning of data).
+  size_t Filter(uint8_t *data, size_t size);
+  // Returns true if transmitted bytes are expected to be echoed.
+  bool Active() const;
+  // Returns true while AUTO mode has not decided yet.
+  bool Probing() const;
+  // Returns true if echo is still expected for the last transmission.
+  bool Pending() const;
+  uint64_t SuppressedBytes() const;
+
+ private:
+  // Number of transmissions AUTO mode uses to detect echo.
+  static constexpr int kProbes = 3;
+
+  void FinishProbe(bool echoed);
+
+  Mode mode_;
+  bool echo_present_;
+  int probes_ = 0;
+  int echoes_seen_ = 0;
+  std::array<uint8_t, 8> expected_;
+  size_t expected_size_ = 0;
+  size_t matched_ = 0;
+  uint64_t suppressed_bytes_ = 0;
+};
+
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,121 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_echo_suppressor.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace fuji_iot {
+
+const std::vector<uint8_t> kReply = {0xdf, 0x7f, 0xfd, 0xff,
+                                     0xff, 0xff, 0xff, 0xff};
+const std::vector<uint8_t> kMaster = {0xff, 0xdf, 0xfe, 0xfa,
+                                      0x5f, 0xe3, 0xff, 0xff};
+
+std::vector<uint8_t> Concat(std::vector<uint8_t> a,
+                            const std::vector<uint8_t> &b) {
+  a.insert(a.end(), b.begin(), b.end());
+  return a;
+}
+
+class FujiEchoSuppressorTest : public testing::Test {
+ protected:
+  std::vector<uint8_t> Filter(FujiEchoSuppressor *echo,
+                              std::vector<uint8_t> in) {
+    in.resize(echo->Filter(in.data(), in.size()));
+    return in;
+  }
+
+  void Transmit(FujiEchoSuppressor *echo) {
+    echo->OnTransmit(kReply.data(), kReply.size());
+  }
+};
+
+TEST_F(FujiEchoSuppressorTest, OffPassesEverything) {
+  FujiEchoSuppressor echo(FujiEchoSuppressor::Mode::OFF);
+  Transmit(&echo);
+  EXPECT_FALSE(echo.Pending());
+  EXPECT_EQ(kReply, Filter(&echo, kReply));
+  EXPECT_EQ(0, echo.SuppressedBytes());
+}
+
+TEST_F(FujiEchoSuppressorTest, RemovesEchoFollowedByFrame) {
+  FujiEchoSuppressor echo(FujiEchoSuppressor::Mode::ON);
+  Transmit(&echo);
+  EXPECT_EQ(kMaster, Filter(&echo, Concat(kReply, kMaster)));
+  EXPECT_FALSE(echo.Pending());
+  EXPECT_EQ(8, echo.SuppressedBytes());
+}
+
+TEST_F(FujiEchoSuppressorTest, EchoSplitAcrossReads) {
+  FujiEchoSuppressor echo(FujiEchoSuppressor::Mode::ON);
+  Transmit(&echo);
+  EXPECT_TRUE(Filter(&echo, {0xdf, 0x7f, 0xfd}).empty());
+  EXPECT_TRUE(echo.Pending());
+  EXPECT_EQ(std::vector<uint8_t>({0xff, 0xdf}),
+            Filter(&echo, {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xdf}));
+  EXPECT_FALSE(echo.Pending());
+}
+
+TEST_F(FujiEchoSuppressorTest, MissingEchoKeepsFrame) {
+  FujiEchoSuppressor echo(FujiEchoSuppressor::Mode::ON);
+  Transmit(&echo);
+  EXPECT_EQ(kMaster, Filter(&echo, kMaster));
+  EXPECT_FALSE(echo.Pending());
+  EXPECT_TRUE(echo.Active());
+}
+
+TEST_F(FujiEchoSuppressorTest, AutoDetectsEcho) {
+  FujiEchoSuppressor echo(FujiEchoSuppressor::Mode::AUTO);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(echo.Probing());
+    Transmit(&echo);
+    EXPECT_EQ(kMaster, Filter(&echo, Concat(kReply, kMaster)));
+  }
+  EXPECT_FALSE(echo.Probing());
+  EXPECT_TRUE(echo.Active());
+  Transmit(&echo);
+  EXPECT_TRUE(echo.Pending());
+}
+
+TEST_F(FujiEchoSuppressorTest, AutoDetectsNoEcho) {
+  FujiEchoSuppressor echo(FujiEchoSuppressor::Mode::AUTO);
+  Transmit(&echo);
+  echo.OnSilence();
+  Transmit(&echo);
+  EXPECT_EQ(kMaster, Filter(&echo, kMaster));
+  Transmit(&echo);
+  echo.OnSilence();
+  EXPECT_FALSE(echo.Probing());
+  EXPECT_FALSE(echo.Active());
+  Transmit(&echo);
+  EXPECT_FALSE(echo.Pending());
+  EXPECT_EQ(kReply, Filter(&echo, kReply));
+}
+
+TEST_F(FujiEchoSuppressorTest, AutoMajorityVote) {
+  FujiEchoSuppressor echo(FujiEchoSuppressor::Mode::AUTO);
+  Transmit(&echo);
+  EXPECT_TRUE(Filter(&echo, kReply).empty());
+  Transmit(&echo);
+  echo.OnSilence();
+  Transmit(&echo);
+  EXPECT_TRUE(Filter(&echo, kReply).empty());
+  EXPECT_FALSE(echo.Probing());
+  EXPECT_TRUE(echo.Active());
+}
+
+}  // namespace fuji_iot
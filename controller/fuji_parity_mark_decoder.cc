@@ -0,0 +1,61 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_parity_mark_decoder.h"
+
+namespace fuji_iot {
+
+size_t FujiParityMarkDecoder::Decode(const uint8_t *in, size_t size,
+                                     uint8_t *out, size_t *errors) {
+  size_t written = 0;
+  for (size_t i = 0; i < size; i++) {
+    const uint8_t byte = in[i];
+    switch (state_) {
+      case State::DATA:
+        if (byte == 0xFF) {
+          state_ = State::ESCAPE;
+        } else {
+          out[written++] = byte;
+        }
+        break;
+      case State::ESCAPE:
+        if (byte == 0xFF) {
+          // Escaped literal \377.
+          out[written++] = 0xFF;
+          state_ = State::DATA;
+        } else if (byte == 0x00) {
+          state_ = State::MARKED;
+        } else {
+          // Not a valid sequence, should not happen with PARMRK. Treat as
+          // corrupted data.
+          (*errors)++;
+          out[written++] = byte;
+          state_ = State::DATA;
+        }
+        break;
+      case State::MARKED:
+        (*errors)++;
+        out[written++] = byte;
+        state_ = State::DATA;
+        break;
+    }
+  }
+  return written;
+}
+
+void FujiParityMarkDecoder::Reset() { state_ = State::DATA; }
+
+bool FujiParityMarkDecoder::Pending() const { return state_ != State::DATA; }
+
+}  // namespace fuji_iot
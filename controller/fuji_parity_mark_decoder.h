@@ -0,0 +1,51 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_PARITY_MARK_DECODER_H_
+#define FUJI_PARITY_MARK_DECODER_H_
+
+#include <bits/stdint-uintn.h>
+
+#include <cstddef>
+
+namespace fuji_iot {
+// Decodes byte stream of a tty configured with INPCK and PARMRK (and without
+// IGNPAR/ISTRIP). Kernel marks bytes received with parity or framing error as
+// \377 \0 <byte> and escapes literal \377 as \377 \377. Escape sequences may
+// span multiple read() calls, so decoder keeps state between calls.
+class FujiParityMarkDecoder {
+ public:
+  // Decodes size raw bytes from in and writes at most size bytes to out.
+  // Returns number of bytes written. Bytes that were received with error are
+  // still written to out, and *errors is incremented for each of them.
+  size_t Decode(const uint8_t *in, size_t size, uint8_t *out, size_t *errors);
+  // Drops partially received escape sequence, for example after a timeout.
+  void Reset();
+  // Returns true if last call ended in the middle of an escape sequence.
+  bool Pending() const;
+
+ private:
+  enum class State {
+    DATA,
+    // \377 received.
+    ESCAPE,
+    // \377 \0 received, next byte is the one with error.
+    MARKED,
+  };
+  State state_ = State::DATA;
+};
+
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,77 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_parity_mark_decoder.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace fuji_iot {
+
+class FujiParityMarkDecoderTest : public testing::Test {
+ protected:
+  std::vector<uint8_t> Decode(std::vector<uint8_t> in) {
+    std::vector<uint8_t> out(in.size());
+    out.resize(decoder_.Decode(in.data(), in.size(), out.data(), &errors_));
+    return out;
+  }
+
+  FujiParityMarkDecoder decoder_;
+  size_t errors_ = 0;
+};
+
+TEST_F(FujiParityMarkDecoderTest, PlainData) {
+  EXPECT_EQ(std::vector<uint8_t>({0x00, 0x5f, 0xdf, 0xb9}),
+            Decode({0x00, 0x5f, 0xdf, 0xb9}));
+  EXPECT_EQ(0, errors_);
+}
+
+TEST_F(FujiParityMarkDecoderTest, EscapedLiteral) {
+  // Inverted zero bytes are common on the bus, those arrive escaped.
+  EXPECT_EQ(std::vector<uint8_t>({0xFF, 0x5f, 0xFF}),
+            Decode({0xFF, 0xFF, 0x5f, 0xFF, 0xFF}));
+  EXPECT_EQ(0, errors_);
+  EXPECT_FALSE(decoder_.Pending());
+}
+
+TEST_F(FujiParityMarkDecoderTest, ParityError) {
+  EXPECT_EQ(std::vector<uint8_t>({0x12, 0x34, 0x56}),
+            Decode({0x12, 0xFF, 0x00, 0x34, 0x56}));
+  EXPECT_EQ(1, errors_);
+}
+
+TEST_F(FujiParityMarkDecoderTest, MarkedEscapeCharacter) {
+  EXPECT_EQ(std::vector<uint8_t>({0xFF}), Decode({0xFF, 0x00, 0xFF}));
+  EXPECT_EQ(1, errors_);
+}
+
+TEST_F(FujiParityMarkDecoderTest, SequenceSplitAcrossReads) {
+  EXPECT_EQ(std::vector<uint8_t>({0x12}), Decode({0x12, 0xFF}));
+  EXPECT_TRUE(decoder_.Pending());
+  EXPECT_EQ(std::vector<uint8_t>({}), Decode({0x00}));
+  EXPECT_TRUE(decoder_.Pending());
+  EXPECT_EQ(std::vector<uint8_t>({0x34, 0xFF}), Decode({0x34, 0xFF, 0xFF}));
+  EXPECT_FALSE(decoder_.Pending());
+  EXPECT_EQ(1, errors_);
+}
+
+TEST_F(FujiParityMarkDecoderTest, Reset) {
+  Decode({0xFF, 0x00});
+  decoder_.Reset();
+  EXPECT_EQ(std::vector<uint8_t>({0x12}), Decode({0x12}));
+  EXPECT_EQ(0, errors_);
+}
+
+}  // namespace fuji_iot
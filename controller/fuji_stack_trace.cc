@@ -0,0 +1,77 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "controller/fuji_stack_trace.h"
+
+#include <execinfo.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+#include "absl/base/attributes.h"
+
+namespace fuji_iot {
+namespace {
+
+// Initial-exec, so that signal handlers can read it without allocating.
+thread_local bool in_capture __attribute__((tls_model("initial-exec"))) =
+    false;
+
+}  // namespace
+
+void PrepareStackCapture() {
+  void *pc;
+  backtrace(&pc, 1);
+}
+
+ABSL_ATTRIBUTE_NOINLINE int CaptureStack(int skip, void **pcs) {
+  constexpr int kMaxSkip = 4;
+  void *frames[kMaxStackDepth + kMaxSkip];
+  // This function and the caller.
+  skip = std::min(skip + 2, kMaxSkip);
+  // Signal handlers of this thread see the flag set before unwinding starts.
+  in_capture = true;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  // Unwinds with DWARF info, unlike absl::GetStackTrace it does not need
+  // frame pointers, which the default build omits.
+  int depth = std::max(backtrace(frames, kMaxStackDepth + skip) - skip, 0);
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  in_capture = false;
+  std::copy(frames + skip, frames + skip + depth, pcs);
+  return depth;
+}
+
+bool InStackCapture() {
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  return in_capture;
+}
+
+uint64_t StackHash(void *const *pcs, int depth) {
+  uint64_t hash = 14695981039346656037ull;
+  for (int i = 0; i < depth; ++i) {
+    hash = (hash ^ reinterpret_cast<uintptr_t>(pcs[i])) * 1099511628211ull;
+  }
+  return hash;
+}
+
+std::string MemoryMap() {
+  std::ifstream maps("/proc/self/maps");
+  std::stringstream text;
+  text << maps.rdbuf();
+  return text.str();
+}
+
+}  // namespace fuji_iot
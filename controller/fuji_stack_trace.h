@@ -0,0 +1,51 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_STACK_TRACE_H_
+#define FUJI_STACK_TRACE_H_
+
+#include <cstdint>
+#include <string>
+
+namespace fuji_iot {
+// Stack capture shared by the profilers, for stacks aggregated in fixed
+// tables and written out in pprof formats.
+
+// Deepest stack captured.
+constexpr int kMaxStackDepth = 32;
+
+// Loads the unwinder, which allocates on first use. Has to be called before
+// capturing from places that must not allocate: signal handlers, mutex
+// tracers or malloc. Safe to call more than once.
+void PrepareStackCapture();
+
+// Stores up to kMaxStackDepth program counters of the caller's stack in pcs,
+// leaving out the caller itself and skip more frames above it, and returns
+// their number. Does not allocate nor lock after PrepareStackCapture.
+int CaptureStack(int skip, void **pcs);
+
+// True while the calling thread is in CaptureStack. The unwinder is not
+// reentrant, signal handlers must not capture while it is set.
+bool InStackCapture();
+
+// FNV-1a over the program counters.
+uint64_t StackHash(void *const *pcs, int depth);
+
+// Contents of /proc/self/maps, which pprof needs after the samples to
+// symbolize program counters.
+std::string MemoryMap();
+
+}  // namespace fuji_iot
+
+#endif
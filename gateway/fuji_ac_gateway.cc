@@ -0,0 +1,422 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gateway/fuji_ac_gateway.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "controller/fuji_ac_client_id.h"
+#include "glog/logging.h"
+
+namespace fuji_iot {
+namespace gateway {
+namespace {
+
+// Watch streams are reopened with exponential backoff between these bounds.
+constexpr absl::Duration kMinBackoff = absl::Milliseconds(100);
+constexpr absl::Duration kMaxBackoff = absl::Seconds(30);
+// How often WatchStatus checks whether the client went away.
+constexpr absl::Duration kWatchCancelCheckInterval = absl::Milliseconds(500);
+
+void SetResult(const ::grpc::Status &status, proto::UnitResult *result) {
+  result->set_code(status.error_code());
+  result->set_error_message(status.error_message());
+  if (!status.ok()) result->clear_status();
+}
+
+// Runs fn(i) for every i in [0, n) on its own thread and waits for all.
+// Callers keep n within the number of units. If no more threads can be
+// started, the rest run one after another on the calling thread.
+void ParallelFor(size_t n, const std::function<void(size_t)> &fn) {
+  if (n == 0) return;
+  std::vector<std::thread> threads;
+  size_t i = 1;
+  for (; i < n; i++) {
+    try {
+      threads.emplace_back(fn, i);
+    } catch (const std::system_error &e) {
+      LOG(WARNING) << "Could not start thread: " << e.what();
+      break;
+    }
+  }
+  fn(0);
+  for (; i < n; i++) {
+    fn(i);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+// Tells the daemon who the call is made for, so that its per-client limits
+// do not lump all clients of the gateway together. kClientMetadataKey sent
+// by the caller is not passed on, the caller is named by its address.
+void ForwardClient(const ::grpc::ServerContext &context,
+                   grpc::ClientContext *client_context) {
+  client_context->AddMetadata(kClientMetadataKey, PeerAddress(context));
+}
+
+}  // namespace
+
+FujiAcGateway::FujiAcGateway(
+    const std::map<std::string, std::shared_ptr<grpc::ChannelInterface>>
+        &backends) {
+  for (const auto &it : backends) {
+    std::unique_ptr<Backend> backend(new Backend());
+    backend->unit = it.first;
+    backend->stub = proto::FujiACControllerService::NewStub(it.second);
+    backends_[it.first] = std::move(backend);
+  }
+  // Threads are started once the map is complete, it is read-only afterwards.
+  for (auto &it : backends_) {
+    Backend *backend = it.second.get();
+    backend->watcher = std::thread(&FujiAcGateway::Watch, this, backend);
+  }
+}
+
+FujiAcGateway::~FujiAcGateway() {
+  shutdown_.Notify();
+  for (auto &it : backends_) {
+    absl::MutexLock l(&it.second->mu);
+    if (it.second->watch_context != nullptr) {
+      it.second->watch_context->TryCancel();
+    }
+  }
+  for (auto &it : backends_) {
+    it.second->watcher.join();
+  }
+}
+
+FujiAcGateway::Backend *FujiAcGateway::FindBackend(
+    const std::string &unit, ::grpc::Status *error) const {
+  if (unit.empty()) {
+    if (backends_.size() == 1) return backends_.begin()->second.get();
+    *error = ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT,
+                            "Unit has to be specified.");
+    return nullptr;
+  }
+  auto it = backends_.find(unit);
+  if (it == backends_.end()) {
+    *error = ::grpc::Status(::grpc::StatusCode::NOT_FOUND,
+                            absl::StrCat("Unknown unit: ", unit));
+    return nullptr;
+  }
+  return it->second.get();
+}
+
+void FujiAcGateway::StoreStatus(Backend *backend,
+                                const proto::StatusResponse &status) {
+  if (backend->status.has_value() &&
+      backend->status->version() > status.version()) {
+    return;
+  }
+  backend->status = status;
+  backend->status->set_unit(backend->unit);
+  backend->changes++;
+}
+
+void FujiAcGateway::Watch(Backend *backend) {
+  absl::Duration backoff = kMinBackoff;
+  while (!shutdown_.HasBeenNotified()) {
+    grpc::ClientContext context;
+    {
+      absl::MutexLock l(&backend->mu);
+      backend->watch_context = &context;
+    }
+    // Destructor may have missed the context above.
+    if (shutdown_.HasBeenNotified()) context.TryCancel();
+    watch_starts_++;
+    auto reader =
+        backend->stub->WatchStatus(&context, proto::WatchStatusRequest());
+    proto::StatusResponse response;
+    bool first = true;
+    while (reader->Read(&response)) {
+      watch_updates_++;
+      absl::MutexLock l(&backend->mu);
+      if (first) {
+        // Versions of a restarted daemon start over, trust the new stream.
+        backend->status.reset();
+        backend->watching = true;
+        first = false;
+        backoff = kMinBackoff;
+      }
+      StoreStatus(backend, response);
+    }
+    ::grpc::Status status = reader->Finish();
+    {
+      absl::MutexLock l(&backend->mu);
+      backend->watching = false;
+      backend->watch_context = nullptr;
+    }
+    if (shutdown_.HasBeenNotified()) break;
+    LOG(WARNING) << "Watch of unit " << backend->unit
+                 << " ended: " << status.error_message() << ", retrying in "
+                 << backoff;
+    shutdown_.WaitForNotificationWithTimeout(backoff);
+    backoff = std::min(backoff * 2, kMaxBackoff);
+  }
+}
+
+bool FujiAcGateway::CachedStatus(Backend *backend,
+                                 proto::StatusResponse *response) {
+  absl::MutexLock l(&backend->mu);
+  if (!backend->watching || !backend->status.has_value()) return false;
+  cache_hits_++;
+  *response = backend->status.value();
+  return true;
+}
+
+::grpc::Status FujiAcGateway::BackendStatus(
+    const ::grpc::ServerContext &context, Backend *backend,
+    proto::StatusResponse *response) {
+  backend_calls_++;
+  auto client_context = grpc::ClientContext::FromServerContext(context);
+  proto::StatusRequest request;
+  request.set_unit(backend->unit);
+  ::grpc::Status status =
+      backend->stub->GetStatus(client_context.get(), request, response);
+  if (status.ok()) response->set_unit(backend->unit);
+  return status;
+}
+
+::grpc::Status FujiAcGateway::BackendUpdate(
+    const ::grpc::ServerContext &context, Backend *backend,
+    const proto::UpdateRequest &request, proto::StatusResponse *response) {
+  backend_calls_++;
+  auto client_context = grpc::ClientContext::FromServerContext(context);
+  ForwardClient(context, client_context.get());
+  ::grpc::Status status =
+      backend->stub->Update(client_context.get(), request, response);
+  if (!status.ok()) return status;
+  response->set_unit(backend->unit);
+  absl::MutexLock l(&backend->mu);
+  // Watch stream will deliver the same state, but GetStatus right after
+  // Update should already see it.
+  if (backend->watching) StoreStatus(backend, *response);
+  return status;
+}
+
+::grpc::Status FujiAcGateway::GetStatus(::grpc::ServerContext *context,
+                                        const proto::StatusRequest *request,
+                                        proto::StatusResponse *response) {
+  ::grpc::Status error;
+  Backend *backend = FindBackend(request->unit(), &error);
+  if (backend == nullptr) return error;
+  if (CachedStatus(backend, response)) return ::grpc::Status::OK;
+  // Cache is stale, ask the daemon directly.
+  return BackendStatus(*context, backend, response);
+}
+
+::grpc::Status FujiAcGateway::Update(::grpc::ServerContext *context,
+                                     const proto::UpdateRequest *request,
+                                     proto::StatusResponse *response) {
+  ::grpc::Status error;
+  Backend *backend = FindBackend(request->unit(), &error);
+  if (backend == nullptr) return error;
+  return BackendUpdate(*context, backend, *request, response);
+}
+
+::grpc::Status FujiAcGateway::GetMetrics(::grpc::ServerContext *context,
+                                         const proto::MetricsRequest *request,
+                                         proto::MetricsResponse *response) {
+  ::grpc::Status error;
+  Backend *backend = FindBackend(request->unit(), &error);
+  if (backend == nullptr) return error;
+  backend_calls_++;
+  auto client_context = grpc::ClientContext::FromServerContext(*context);
+  return backend->stub->GetMetrics(client_context.get(), *request, response);
+}
+
+::grpc::Status FujiAcGateway::GetBusDevices(
+    ::grpc::ServerContext *context, const proto::BusDevicesRequest *request,
+    proto::BusDevicesResponse *response) {
+  ::grpc::Status error;
+  Backend *backend = FindBackend(request->unit(), &error);
+  if (backend == nullptr) return error;
+  backend_calls_++;
+  auto client_context = grpc::ClientContext::FromServerContext(*context);
+  return backend->stub->GetBusDevices(client_context.get(), *request,
+                                      response);
+}
+
+::grpc::Status FujiAcGateway::GetContentionProfile(
+    ::grpc::ServerContext *context,
+    const proto::ContentionProfileRequest *request,
+    proto::ContentionProfileResponse *response) {
+  ::grpc::Status error;
+  Backend *backend = FindBackend(request->unit(), &error);
+  if (backend == nullptr) return error;
+  backend_calls_++;
+  auto client_context = grpc::ClientContext::FromServerContext(*context);
+  return backend->stub->GetContentionProfile(client_context.get(), *request,
+                                             response);
+}
+
+::grpc::Status FujiAcGateway::CaptureProfile(
+    ::grpc::ServerContext *context, const proto::CaptureProfileRequest *request,
+    proto::CaptureProfileResponse *response) {
+  ::grpc::Status error;
+  Backend *backend = FindBackend(request->unit(), &error);
+  if (backend == nullptr) return error;
+  backend_calls_++;
+  auto client_context = grpc::ClientContext::FromServerContext(*context);
+  return backend->stub->CaptureProfile(client_context.get(), *request,
+                                       response);
+}
+
+::grpc::Status FujiAcGateway::WatchStatus(
+    ::grpc::ServerContext *context, const proto::WatchStatusRequest *request,
+    ::grpc::ServerWriter<proto::StatusResponse> *writer) {
+  ::grpc::Status error;
+  Backend *backend = FindBackend(request->unit(), &error);
+  if (backend == nullptr) return error;
+  uint64_t seen = 0;
+  while (true) {
+    proto::StatusResponse response;
+    {
+      absl::MutexLock l(&backend->mu);
+      auto changed = [backend, seen]()
+                         ABSL_EXCLUSIVE_LOCKS_REQUIRED(backend->mu) {
+                           return backend->status.has_value() &&
+                                  backend->changes != seen;
+                         };
+      while (!backend->mu.AwaitWithTimeout(absl::Condition(&changed),
+                                           kWatchCancelCheckInterval)) {
+        if (context->IsCancelled()) return ::grpc::Status::CANCELLED;
+      }
+      seen = backend->changes;
+      response = backend->status.value();
+    }
+    if (!writer->Write(response)) return ::grpc::Status::OK;
+  }
+}
+
+::grpc::Status FujiAcGateway::Subscribe(
+    ::grpc::ServerContext *context, const proto::SubscribeRequest *request,
+    ::grpc::ServerWriter<proto::StateEvent> *writer) {
+  ::grpc::Status error;
+  Backend *backend = FindBackend(request->unit(), &error);
+  if (backend == nullptr) return error;
+  // Sequence numbers belong to the daemon, so the stream is relayed as is
+  // and resuming works the same through the gateway.
+  backend_calls_++;
+  auto client_context = grpc::ClientContext::FromServerContext(*context);
+  auto reader = backend->stub->Subscribe(client_context.get(), *request);
+  proto::StateEvent event;
+  while (reader->Read(&event)) {
+    if (!writer->Write(event)) {
+      client_context->TryCancel();
+      break;
+    }
+  }
+  return reader->Finish();
+}
+
+::grpc::Status FujiAcGateway::GetStatusMany(
+    ::grpc::ServerContext *context, const proto::GetStatusManyRequest *request,
+    proto::GetStatusManyResponse *response) {
+  if (request->units().empty()) {
+    for (const auto &it : backends_) {
+      response->add_results()->set_unit(it.first);
+    }
+  } else {
+    for (const std::string &unit : request->units()) {
+      response->add_results()->set_unit(unit);
+    }
+  }
+  // Units with fresh cache and unknown units are answered right away, the
+  // rest go to their daemons in parallel, once per unit however many times
+  // it is listed.
+  std::map<Backend *, std::vector<proto::UnitResult *>> stale;
+  for (proto::UnitResult &result : *response->mutable_results()) {
+    ::grpc::Status status;
+    Backend *backend = FindBackend(result.unit(), &status);
+    if (backend != nullptr) {
+      if (!CachedStatus(backend, result.mutable_status())) {
+        stale[backend].push_back(&result);
+        continue;
+      }
+    }
+    SetResult(status, &result);
+  }
+  std::vector<std::pair<Backend *, std::vector<proto::UnitResult *>>> calls(
+      stale.begin(), stale.end());
+  ParallelFor(calls.size(), [&](size_t i) {
+    const std::vector<proto::UnitResult *> &results = calls[i].second;
+    proto::UnitResult *result = results[0];
+    SetResult(BackendStatus(*context, calls[i].first, result->mutable_status()),
+              result);
+    for (size_t j = 1; j < results.size(); j++) {
+      *results[j] = *result;
+    }
+  });
+  return ::grpc::Status::OK;
+}
+
+::grpc::Status FujiAcGateway::UpdateMany(::grpc::ServerContext *context,
+                                         const proto::UpdateManyRequest *request,
+                                         proto::UpdateManyResponse *response) {
+  std::set<std::string> units;
+  for (const proto::UpdateRequest &update : request->updates()) {
+    if (update.unit().empty() || !units.insert(update.unit()).second) {
+      return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT,
+                            "Every update has to name a different unit.");
+    }
+    response->add_results()->set_unit(update.unit());
+  }
+  // Unknown units fail right away, so that at most one update per daemon is
+  // left.
+  std::vector<std::pair<Backend *, int>> known;
+  for (int i = 0; i < request->updates_size(); i++) {
+    ::grpc::Status status;
+    Backend *backend = FindBackend(request->updates(i).unit(), &status);
+    if (backend == nullptr) {
+      SetResult(status, response->mutable_results(i));
+    } else {
+      known.emplace_back(backend, i);
+    }
+  }
+  // Every unit has its own bus, so the whole batch takes about as long as
+  // the slowest unit.
+  ParallelFor(known.size(), [&](size_t i) {
+    const int index = known[i].second;
+    proto::UnitResult *result = response->mutable_results(index);
+    SetResult(BackendUpdate(*context, known[i].first, request->updates(index),
+                            result->mutable_status()),
+              result);
+  });
+  return ::grpc::Status::OK;
+}
+
+FujiAcGatewayStats FujiAcGateway::Stats() const {
+  FujiAcGatewayStats stats;
+  stats.cache_hits = cache_hits_;
+  stats.backend_calls = backend_calls_;
+  stats.watch_updates = watch_updates_;
+  stats.watch_starts = watch_starts_;
+  return stats;
+}
+
+}  // namespace gateway
+}  // namespace fuji_iot
@@ -0,0 +1,140 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_GATEWAY_H_
+#define FUJI_AC_GATEWAY_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/types/optional.h"
+#include "controller/fuji_ac_controller.grpc.pb.h"
+#include "grpcpp/grpcpp.h"
+
+namespace fuji_iot {
+namespace gateway {
+
+struct FujiAcGatewayStats {
+  // GetStatus requests answered from the cache.
+  uint64_t cache_hits = 0;
+  // Unary RPCs sent to backend daemons.
+  uint64_t backend_calls = 0;
+  // Status updates received over watch streams.
+  uint64_t watch_updates = 0;
+  // Times a watch stream was opened, including reconnects.
+  uint64_t watch_starts = 0;
+};
+
+// Serves FujiACControllerService for many units, each of them handled by its
+// own daemon. Gateway keeps one channel and one WatchStatus stream per
+// daemon, streamed states are cached so that GetStatus never waits for a
+// backend. Other calls are forwarded to the daemon of the unit named in the
+// request; calls to different units proceed concurrently. Class is
+// thread-safe.
+class FujiAcGateway final : public proto::FujiACControllerService::Service {
+ public:
+  // backends maps unit name to the channel of its daemon.
+  explicit FujiAcGateway(
+      const std::map<std::string, std::shared_ptr<grpc::ChannelInterface>>
+          &backends);
+  ~FujiAcGateway();
+
+  ::grpc::Status GetStatus(::grpc::ServerContext *context,
+                           const proto::StatusRequest *request,
+                           proto::StatusResponse *response) override;
+  ::grpc::Status Update(::grpc::ServerContext *context,
+                        const proto::UpdateRequest *request,
+                        proto::StatusResponse *response) override;
+  ::grpc::Status GetMetrics(::grpc::ServerContext *context,
+                            const proto::MetricsRequest *request,
+                            proto::MetricsResponse *response) override;
+  ::grpc::Status GetBusDevices(::grpc::ServerContext *context,
+                               const proto::BusDevicesRequest *request,
+                               proto::BusDevicesResponse *response) override;
+  ::grpc::Status GetContentionProfile(
+      ::grpc::ServerContext *context,
+      const proto::ContentionProfileRequest *request,
+      proto::ContentionProfileResponse *response) override;
+  ::grpc::Status CaptureProfile(
+      ::grpc::ServerContext *context,
+      const proto::CaptureProfileRequest *request,
+      proto::CaptureProfileResponse *response) override;
+  ::grpc::Status WatchStatus(
+      ::grpc::ServerContext *context, const proto::WatchStatusRequest *request,
+      ::grpc::ServerWriter<proto::StatusResponse> *writer) override;
+  ::grpc::Status Subscribe(
+      ::grpc::ServerContext *context, const proto::SubscribeRequest *request,
+      ::grpc::ServerWriter<proto::StateEvent> *writer) override;
+  ::grpc::Status GetStatusMany(::grpc::ServerContext *context,
+                               const proto::GetStatusManyRequest *request,
+                               proto::GetStatusManyResponse *response) override;
+  ::grpc::Status UpdateMany(::grpc::ServerContext *context,
+                            const proto::UpdateManyRequest *request,
+                            proto::UpdateManyResponse *response) override;
+
+  FujiAcGatewayStats Stats() const;
+
+ private:
+  struct Backend {
+    std::string unit;
+    std::unique_ptr<proto::FujiACControllerService::Stub> stub;
+    absl::Mutex mu;
+    // Last known status of the unit.
+    absl::optional<proto::StatusResponse> status ABSL_GUARDED_BY(mu);
+    // Incremented whenever status is replaced.
+    uint64_t changes ABSL_GUARDED_BY(mu) = 0;
+    // True while the watch stream is open, status is fresh only then.
+    bool watching ABSL_GUARDED_BY(mu) = false;
+    // Context of the open watch stream, lets destructor cancel it.
+    grpc::ClientContext *watch_context ABSL_GUARDED_BY(mu) = nullptr;
+    std::thread watcher;
+  };
+
+  // Returns backend serving the unit, or nullptr and sets error. Empty unit
+  // name selects the only backend.
+  Backend *FindBackend(const std::string &unit, ::grpc::Status *error) const;
+  // Copies cached status to response, returns false if cache is stale.
+  bool CachedStatus(Backend *backend, proto::StatusResponse *response);
+  // Asks the daemon for status, bypassing the cache.
+  ::grpc::Status BackendStatus(const ::grpc::ServerContext &context,
+                               Backend *backend,
+                               proto::StatusResponse *response);
+  ::grpc::Status BackendUpdate(const ::grpc::ServerContext &context,
+                               Backend *backend,
+                               const proto::UpdateRequest &request,
+                               proto::StatusResponse *response);
+  // Keeps the watch stream of backend open until destruction.
+  void Watch(Backend *backend);
+  // Replaces cached status unless the cached one is newer.
+  void StoreStatus(Backend *backend, const proto::StatusResponse &status)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(backend->mu);
+
+  std::map<std::string, std::unique_ptr<Backend>> backends_;
+  absl::Notification shutdown_;
+  std::atomic<uint64_t> cache_hits_{0};
+  std::atomic<uint64_t> backend_calls_{0};
+  std::atomic<uint64_t> watch_updates_{0};
+  std::atomic<uint64_t> watch_starts_{0};
+};
+
+}  // namespace gateway
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,81 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "gateway/fuji_ac_gateway.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "grpcpp/grpcpp.h"
+
+DEFINE_string(backends, "",
+              "Comma separated list of unit=host:port, one for each "
+              "fuji_ac_server daemon");
+DEFINE_string(bind_address, "",
+              "Specifies bind address, all interfaces by default");
+DEFINE_int32(bind_port, 12346, "Specifies bind port");
+
+namespace fuji_iot {
+namespace gateway {
+
+std::map<std::string, std::shared_ptr<grpc::ChannelInterface>>
+BackendsFromFlags() {
+  std::map<std::string, std::shared_ptr<grpc::ChannelInterface>> backends;
+  for (absl::string_view backend :
+       absl::StrSplit(FLAGS_backends, ',', absl::SkipEmpty())) {
+    std::pair<std::string, std::string> unit =
+        absl::StrSplit(backend, absl::MaxSplits('=', 1));
+    if (unit.first.empty() || unit.second.empty() ||
+        backends.count(unit.first) > 0) {
+      LOG(FATAL) << "Invalid backend: " << backend;
+    }
+    LOG(INFO) << "Unit " << unit.first << " served by " << unit.second;
+    backends[unit.first] =
+        grpc::CreateChannel(unit.second, grpc::InsecureChannelCredentials());
+  }
+  if (backends.empty()) {
+    LOG(FATAL) << "At least one backend has to be specified with --backends";
+  }
+  return backends;
+}
+
+void RunServer() {
+  std::string server_address =
+      absl::StrFormat("%s:%d", FLAGS_bind_address, FLAGS_bind_port);
+  FujiAcGateway service(BackendsFromFlags());
+
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+  builder.RegisterService(&service);
+  std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+  if (server.get() != nullptr) {
+    server->Wait();
+  } else {
+    LOG(FATAL) << "Failed to create server";
+  }
+}
+
+}  // namespace gateway
+}  // namespace fuji_iot
+
+int main(int argc, char **argv) {
+  google::ParseCommandLineFlags(&argc, &argv, false);
+  google::InitGoogleLogging(argv[0]);
+  fuji_iot::gateway::RunServer();
+  return 0;
+}
@@ -18,21 +18,61 @@
 
 #include "absl/types/optional.h"
 #include "fuji_ac_state.h"
+#include "fuji_register.h"
 
 namespace fuji_iot {
+namespace {
+
+// Main unit is the only device sending from this address.
+constexpr uint8_t kMainUnitAddr = 0;
+constexpr uint8_t kOwnAddr =
+    static_cast<uint8_t>(DestinationAddr::WIRED_CONTROLLER_ADDR);
+
+// Resolves one field of a foreign status write. base is the value in the
+// last status of main unit, written is what we wrote since (if anything).
+struct FieldArbiter {
+  bool merged;
+  bool has_write;
+  // Local value was overridden by a foreign change.
+  int yielded = 0;
+  // Foreign write reverted a change we have just written.
+  bool reverted = false;
+
+  template <typename T, typename Setter>
+  void Field(T foreign, T base, T local, T written, Setter set) {
+    if (foreign != base) {
+      T ours = has_write ? written : local;
+      if ((has_write || !merged) && ours != base && ours != foreign) yielded++;
+      if (local != foreign && (has_write || !merged)) set(foreign);
+    } else if (has_write && written != base) {
+      reverted = true;
+    }
+  }
+};
+
+}  // namespace
 
 FujiAcProtocolHandler::FujiAcProtocolHandler(
-    std::unique_ptr<FujiAcState> state) {
+    std::unique_ptr<FujiAcState> state, bool yield_to_foreign_controller)
+    : yield_to_foreign_controller_(yield_to_foreign_controller) {
   ac_state_ = std::move(state);
 }
 
 absl::optional<FujiControllerFrame> FujiAcProtocolHandler::HandleMasterFrame(
     const FujiMasterFrame &master_frame) {
+  // Frames sent by other controllers on the bus (our own may be echoed back
+  // and are skipped).
+  const uint8_t source = master_frame.FullFrame()[0];
+  if (source != kMainUnitAddr) {
+    if (source != kOwnAddr) HandleForeignFrame(master_frame);
+    return absl::nullopt;
+  }
   // It seems that some of the frames sent over the wire are not intended for
   // wired controller and are simply ignored
   if (master_frame.Destination() != DestinationAddr::WIRED_CONTROLLER_ADDR) {
     return absl::nullopt;
   }
+  frames_++;
 
   // There are several types of frames, they represent separate registers that
   // hold diffrent type of information.
@@ -44,15 +84,23 @@ absl::optional<FujiControllerFrame> FujiAcProtocolHandler::HandleMasterFrame(
       // changes to it, local state takes precedence and we ignore incoming
       // data.
       if (ac_state_->Merged()) UpdateFromMasterStatusRegister(master_frame);
+      last_status_ = master_frame.Payload();
+      last_write_.reset();
       break;
     case RegisterType::LOGIN:
       // At the very beggining of the communication, wired-controller
       // "registers" itself with the main unit. This frame is sent only once
       // upon successful registration.
+      session_ = FujiLoginSession{master_frame.Payload(),
+                                  ac_state_->ControllerPresent()};
+      fast_login_failed_ = false;
       return SendLoggedInFrame();
     case RegisterType::ERROR:
       // Error register holds information about recent errors in the system.
+      // Main unit keeps sending the register queried last, so the reply has
+      // to ask for status again.
       UpdateFromMasterErrorRegister(master_frame);
+      return SendStatusFrame();
     default:
       // This should log an error.
       return absl::nullopt;
@@ -63,6 +111,13 @@ absl::optional<FujiControllerFrame> FujiAcProtocolHandler::HandleMasterFrame(
     // This happens only at the begging of communication, so we clear the flag.
     // During the next cycle, we should receive RegisterType::LOGIN frame.
     login_read_ = false;
+    if (session_.has_value() && !fast_login_failed_) {
+      // Login register is known already, go straight to its last step.
+      fast_login_sent_ = true;
+      fast_logins_++;
+      return SendLoggedInFrame();
+    }
+    full_logins_++;
     return SendLoginFrame();
   }
   if (error_read_) {
@@ -90,26 +145,16 @@ FujiControllerFrame FujiAcProtocolHandler::SendErrorQueryFrame() {
 }
 
 FujiControllerFrame FujiAcProtocolHandler::SendStatusFrame() {
-  // First, we initialize empty controller frame.
-  FujiControllerFrame f;
-  std::array<uint8_t, 5> payload;
-  payload.fill(0);
-  FujiStatusRegister status(payload.data());
-  // Third byte of controller status frame is value from
-  // wired-controller temperature sensor (I think it's in Celsius multiplied by
-  // 2). AC unit ignores this value unless it's configured to use external
-  // sensor.
-  // TODO: remove this magic and implement temp. sensor one day.
-  payload[3] = 47;
-  // Next, let's build response frame based on our local-state.
-  ac_state_->BuildStatusRegisterResponse(&status);
-  f.WithPayload(payload);
-  // We want next frame to be of type STATUS too.
-  f.WithQueryRegister(RegisterType::STATUS);
+  // In steady state (nothing to write) reply was built during idle time.
+  const FujiControllerFrame *prepared =
+      LookupPreparedReply(RegisterType::STATUS);
+  if (prepared != nullptr) return *prepared;
+  FujiControllerFrame f = BuildStatusFrame(false);
   if (!ac_state_->Merged()) {
     // If data was not merged, we want AC unit to use our local
     // version.
     f.WithWriteBit(true);
+    last_write_ = f.Payload();
     if (ac_state_->SwingStep()) {
       // If swing step is used, main unit will automatically clear it
       // next cycle.
@@ -124,20 +169,57 @@ FujiControllerFrame FujiAcProtocolHandler::SendStatusFrame() {
 }
 
 FujiControllerFrame FujiAcProtocolHandler::SendLoggedInFrame() {
+  const FujiControllerFrame *prepared =
+      LookupPreparedReply(RegisterType::LOGIN);
+  if (prepared != nullptr) return *prepared;
   // This is effectively same as above, but no state change occurs.
+  return BuildStatusFrame(true);
+}
+
+FujiControllerFrame FujiAcProtocolHandler::BuildStatusFrame(bool login) const {
+  // First, we initialize empty controller frame.
   FujiControllerFrame f;
   std::array<uint8_t, 5> payload;
   payload.fill(0);
-  f.WithLoginBit(true);
+  f.WithLoginBit(login);
   FujiStatusRegister status(payload.data());
-  // TODO: remove this magic.
+  // Third byte of controller status frame is value from
+  // wired-controller temperature sensor (I think it's in Celsius multiplied by
+  // 2). AC unit ignores this value unless it's configured to use external
+  // sensor.
+  // TODO: remove this magic and implement temp. sensor one day.
   payload[3] = 47;
+  // Next, let's build response frame based on our local-state.
   ac_state_->BuildStatusRegisterResponse(&status);
   f.WithPayload(payload);
+  // We want next frame to be of type STATUS too.
   f.WithQueryRegister(RegisterType::STATUS);
   return f;
 }
 
+void FujiAcProtocolHandler::PrepareReplies() {
+  // Frames that write local changes have side effects on state, those are
+  // always built on demand.
+  if (!ac_state_->Merged()) return;
+  for (RegisterType type : {RegisterType::STATUS, RegisterType::LOGIN}) {
+    PreparedReply &reply = prepared_[static_cast<int>(type)];
+    if (reply.valid && reply.generation == ac_state_->Generation()) continue;
+    reply.frame = BuildStatusFrame(type == RegisterType::LOGIN);
+    reply.generation = ac_state_->Generation();
+    reply.valid = true;
+  }
+}
+
+const FujiControllerFrame *FujiAcProtocolHandler::LookupPreparedReply(
+    RegisterType type) const {
+  const PreparedReply &reply = prepared_[static_cast<int>(type)];
+  if (!reply.valid || !ac_state_->Merged() ||
+      reply.generation != ac_state_->Generation()) {
+    return nullptr;
+  }
+  return &reply.frame;
+}
+
 void FujiAcProtocolHandler::UpdateFromMasterStatusRegister(
     const FujiMasterFrame &master_frame) {
   std::array<uint8_t, 5> payload = master_frame.Payload();
@@ -148,11 +230,104 @@ void FujiAcProtocolHandler::UpdateFromMasterStatusRegister(
     error_read_ = true;
   }
   ac_state_->MergeFromMasterStatusRegister(status);
-  if (!ac_state_->ControllerPresent()) {
-    // If controller is not registered with main unit, set flag and query for
-    // Login register next cycle.
-    login_read_ = true;
+  const bool present = ac_state_->ControllerPresent();
+  if (session_.has_value()) session_->controller_present = present;
+  if (present) {
+    fast_login_sent_ = false;
+    if (frames_to_confirm_ == 0) frames_to_confirm_ = frames_;
+    return;
   }
+  if (fast_login_sent_) {
+    // Main unit did not take the logged-in frame alone.
+    fast_login_sent_ = false;
+    fast_login_failed_ = true;
+  }
+  // If controller is not registered with main unit, set flag and query for
+  // Login register next cycle.
+  login_read_ = true;
+}
+
+void FujiAcProtocolHandler::ResumeSession(const FujiLoginSession &session) {
+  session_ = session;
+  // Only wait for the first status if main unit listed us when the session
+  // was saved, otherwise it needs to be told again.
+  login_read_ = !session.controller_present;
+}
+
+absl::optional<FujiLoginSession> FujiAcProtocolHandler::Session() const {
+  return session_;
+}
+
+bool FujiAcProtocolHandler::Confirmed() const {
+  return frames_to_confirm_ != 0;
+}
+
+uint64_t FujiAcProtocolHandler::FramesToConfirm() const {
+  return frames_to_confirm_;
+}
+
+uint64_t FujiAcProtocolHandler::FullLogins() const { return full_logins_; }
+
+uint64_t FujiAcProtocolHandler::FastLogins() const { return fast_logins_; }
+
+void FujiAcProtocolHandler::HandleForeignFrame(const FujiMasterFrame &frame) {
+  foreign_present_ = true;
+  FujiControllerFrame controller_frame(frame.FullFrame());
+  if (controller_frame.QueryRegister() != RegisterType::STATUS ||
+      !controller_frame.WriteBit()) {
+    return;
+  }
+  foreign_writes_++;
+  if (yield_to_foreign_controller_) {
+    ArbitrateWithForeignWrite(controller_frame.Payload());
+  }
+}
+
+void FujiAcProtocolHandler::ArbitrateWithForeignWrite(
+    const std::array<uint8_t, 5> &foreign) {
+  // Nothing to compare against before the first status.
+  if (!last_status_.has_value()) return;
+  std::array<uint8_t, 5> foreign_payload = foreign;
+  std::array<uint8_t, 5> base_payload = last_status_.value();
+  std::array<uint8_t, 5> written_payload = last_write_.value_or(base_payload);
+  FujiStatusRegister f(foreign_payload.data());
+  FujiStatusRegister b(base_payload.data());
+  FujiStatusRegister w(written_payload.data());
+  FujiAcState *s = ac_state_.get();
+  const bool merged = s->Merged();
+  FieldArbiter arbiter{merged, last_write_.has_value()};
+  arbiter.Field(f.Enabled(), b.Enabled(), s->Enabled(), w.Enabled(),
+                [s](bool v) { s->SetEnabled(v); });
+  arbiter.Field(f.Mode(), b.Mode(), s->Mode(), w.Mode(),
+                [s](mode_t v) { s->SetMode(v); });
+  arbiter.Field(f.Fan(), b.Fan(), s->Fan(), w.Fan(),
+                [s](fan_t v) { s->SetFan(v); });
+  arbiter.Field(f.Economy(), b.Economy(), s->Economy(), w.Economy(),
+                [s](bool v) { s->SetEconomy(v); });
+  arbiter.Field(f.Temperature(), b.Temperature(), s->Temperature(),
+                w.Temperature(), [s](uint8_t v) { s->SetTemperature(v); });
+  arbiter.Field(f.Swing(), b.Swing(), s->Swing(), w.Swing(),
+                [s](bool v) { s->SetSwing(v); });
+  yielded_changes_ += arbiter.yielded;
+  if (arbiter.reverted) {
+    // Write local state again, it already includes the foreign changes.
+    s->SetMerged(false);
+  } else if (merged) {
+    // Main unit reports foreign changes with the next status anyway.
+    s->SetMerged(true);
+  }
+}
+
+bool FujiAcProtocolHandler::ForeignControllerPresent() const {
+  return foreign_present_;
+}
+
+uint64_t FujiAcProtocolHandler::ForeignWrites() const {
+  return foreign_writes_;
+}
+
+uint64_t FujiAcProtocolHandler::YieldedChanges() const {
+  return yielded_changes_;
 }
 
 void FujiAcProtocolHandler::UpdateFromMasterErrorRegister(
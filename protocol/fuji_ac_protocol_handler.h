@@ -17,6 +17,7 @@
 
 #include <gtest/gtest_prod.h>
 
+#include <array>
 #include <memory>
 
 #include "absl/types/optional.h"
@@ -24,6 +25,14 @@
 #include "fuji_frame.h"
 
 namespace fuji_iot {
+// Login state worth keeping across restarts of the controller.
+struct FujiLoginSession {
+  // Payload of the login register of main unit.
+  std::array<uint8_t, 5> login_register = {};
+  // Main unit listed us as its wired controller when the session was saved.
+  bool controller_present = false;
+};
+
 // This class is entry point for protocol handling. It is virtual equivalent of
 // wired controller. AC unit communicates with the wired controller via serial
 // interface. On hardware layer it is implemented using single wire connection
@@ -36,11 +45,21 @@ namespace fuji_iot {
 // Remainder of the cycle is silent. The process resumes with next master_frame
 // and is periodic. Main unit will repeat master_frame indefinately (even if
 // there is not state change) and will treat lack of responses as an error.
+//
+// Another wired controller (e.g. original remote) may share the bus. Its
+// writes carry the whole state too, so both controllers would keep reverting
+// each other's changes. Fields that differ between its write and the last
+// status are treated as its changes and win over our pending ones; fields
+// it merely copied from an older status do not override what we have just
+// written, those are written again next cycle.
 class FujiAcProtocolHandler {
  public:
   // Takes ownership of state object, but caller should keep it reference to
-  // read and modify AC unit state.
-  FujiAcProtocolHandler(std::unique_ptr<FujiAcState> state);
+  // read and modify AC unit state. With yield_to_foreign_controller false
+  // local changes always take precedence, as if no other controller was
+  // present.
+  FujiAcProtocolHandler(std::unique_ptr<FujiAcState> state,
+                        bool yield_to_foreign_controller = true);
   // Processes data from main unit, updates state object with master_frame data
   // and optionally returns a controller frame that should be sent back to main
   // unit. If state was modified in between the calls (for example to change AC
@@ -48,18 +67,79 @@ class FujiAcProtocolHandler {
   // reflected in returned controller frame.
   absl::optional<FujiControllerFrame> HandleMasterFrame(
       const FujiMasterFrame &master_frame);
+  // Builds replies for the master frames expected next, so that
+  // HandleMasterFrame can answer them with a lookup. Should be called while
+  // the bus is idle. Prepared replies are dropped once state changes.
+  void PrepareReplies();
+  // True once frames of another controller were seen on the bus.
+  bool ForeignControllerPresent() const;
+  // Number of status writes of other controllers seen.
+  uint64_t ForeignWrites() const;
+  // Number of local changes dropped because another controller changed the
+  // same field at the same time.
+  uint64_t YieldedChanges() const;
+  // Continues a session saved by a previous run, should be called before the
+  // first frame. If main unit still lists us, the full login exchange is
+  // skipped; if not, the logged-in frame is sent right away. Full login is
+  // used if main unit does not accept that.
+  void ResumeSession(const FujiLoginSession &session);
+  // Session learned from the bus (or resumed), none before login register is
+  // known.
+  absl::optional<FujiLoginSession> Session() const;
+  // True once a status frame confirmed us as the wired controller.
+  bool Confirmed() const;
+  // Master frames addressed to us until the first confirmation, 0 before.
+  uint64_t FramesToConfirm() const;
+  // Login exchanges done, full ones and logged-in frames sent right away.
+  uint64_t FullLogins() const;
+  uint64_t FastLogins() const;
 
  private:
+  // Reply built ahead of time, valid as long as state generation matches.
+  struct PreparedReply {
+    bool valid = false;
+    uint64_t generation = 0;
+    FujiControllerFrame frame;
+  };
+
+  // Returns prepared reply for master register type, if it is still current.
+  const FujiControllerFrame *LookupPreparedReply(RegisterType type) const;
+  FujiControllerFrame BuildStatusFrame(bool login) const;
   FujiControllerFrame SendLoginFrame();
   FujiControllerFrame SendErrorQueryFrame();
   FujiControllerFrame SendStatusFrame();
   FujiControllerFrame SendLoggedInFrame();
   void UpdateFromMasterStatusRegister(const FujiMasterFrame &master_frame);
   void UpdateFromMasterErrorRegister(const FujiMasterFrame &master_frame);
+  void HandleForeignFrame(const FujiMasterFrame &frame);
+  // Resolves a status write of another controller against local changes.
+  void ArbitrateWithForeignWrite(const std::array<uint8_t, 5> &foreign);
 
   std::unique_ptr<FujiAcState> ac_state_;
   bool error_read_ = false;
   bool login_read_ = true;
+  absl::optional<FujiLoginSession> session_;
+  // Logged-in frame was sent without the login exchange, next status shows
+  // whether main unit took it.
+  bool fast_login_sent_ = false;
+  // Main unit did not take it, full login is needed.
+  bool fast_login_failed_ = false;
+  uint64_t frames_ = 0;
+  uint64_t frames_to_confirm_ = 0;
+  uint64_t full_logins_ = 0;
+  uint64_t fast_logins_ = 0;
+  // Indexed by RegisterType of the master frame being answered.
+  std::array<PreparedReply, 3> prepared_;
+
+  const bool yield_to_foreign_controller_;
+  bool foreign_present_ = false;
+  uint64_t foreign_writes_ = 0;
+  uint64_t yielded_changes_ = 0;
+  // Payload of the last status frame of main unit.
+  absl::optional<std::array<uint8_t, 5>> last_status_;
+  // Payload we wrote since that status frame.
+  absl::optional<std::array<uint8_t, 5>> last_write_;
+  FRIEND_TEST(FujiAcProtocolHandlerTest, ErrorRegisterRead);
   FRIEND_TEST(FujiAcProtocolHandlerTest, RemoteTurnOnTurnOff);
   FRIEND_TEST(FujiAcProtocolHandlerTest, TestGolden);
   FRIEND_TEST(FujiAcProtocolHandlerTest, TurnOn);
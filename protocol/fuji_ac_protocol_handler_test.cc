@@ -23,12 +23,14 @@ namespace fuji_iot {
 class FujiAcProtocolHandlerTest : public testing::Test {
  protected:
   void ExpectResponse(std::array<uint8_t, 8> mf, std::array<uint8_t, 8> resp) {
+    if (prepare_) handler_->PrepareReplies();
     auto r = handler_->HandleMasterFrame(FujiMasterFrame(mf));
     EXPECT_EQ(r.has_value(), true);
     EXPECT_EQ(r.value().BuildFrame(), resp);
   }
 
   void ExpectNull(std::array<uint8_t, 8> mf) {
+    if (prepare_) handler_->PrepareReplies();
     auto r = handler_->HandleMasterFrame(FujiMasterFrame(mf));
     EXPECT_EQ(r.has_value(), false);
   }
@@ -41,6 +43,8 @@ class FujiAcProtocolHandlerTest : public testing::Test {
 
   std::unique_ptr<FujiAcProtocolHandler> handler_;
   FujiAcState *state_;
+  // If true, replies are prepared in advance before every master frame.
+  bool prepare_ = false;
 };
 
 // This communication was captured immediately after power-on (by circuit
@@ -463,4 +467,117 @@ TEST_F(FujiAcProtocolHandlerTest, WiredControlGolden) {
                  {0x20, 0x81, 0x00, 0x07, 0x16, 0x00, 0x2f, 0x00});
 }
 
-}  // namespace fuji_iot
\ No newline at end of file
+// Replies prepared during idle time must be identical to the ones built on
+// demand.
+TEST_F(FujiAcProtocolHandlerTest, PreparedStartup) {
+  prepare_ = true;
+  ExpectNull({0x00, 0x81, 0x00, 0x46, 0x12, 0xa0, 0x00, 0x20});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x00, 0x20},
+                 {0x20, 0x81, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x20, 0x1f, 0x1f, 0x05, 0x01, 0x00},
+                 {0x20, 0xa1, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+}
+
+// Prepared reply is dropped when state is changed either locally or by the
+// main unit.
+TEST_F(FujiAcProtocolHandlerTest, PreparedReplyInvalidation) {
+  prepare_ = true;
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x00, 0x20},
+                 {0x20, 0x81, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x20, 0x1f, 0x1f, 0x05, 0x01, 0x00},
+                 {0x20, 0xa1, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  // Local change after replies were prepared.
+  handler_->PrepareReplies();
+  state_->SetTemperature(22);
+  EXPECT_EQ(handler_->HandleMasterFrame(FujiMasterFrame(
+                                            {0x00, 0xa0, 0x00, 0x46, 0x12,
+                                             0xa0, 0x01, 0x20}))
+                ->BuildFrame(),
+            (std::array<uint8_t, 8>{0x20, 0x81, 0x08, 0x46, 0x16, 0x00,
+                                    0x2f, 0x00}));
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x16, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x46, 0x16, 0x00, 0x2f, 0x00});
+  // Remote change.
+  ExpectResponse({0x00, 0xa0, 0x00, 0x47, 0x16, 0x40, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x47, 0x16, 0x00, 0x2f, 0x00});
+  EXPECT_EQ(true, state_->Enabled());
+}
+
+// Error bit in status is followed by a read of the error register, after
+// which main unit is asked for status again.
+TEST_F(FujiAcProtocolHandlerTest, ErrorRegisterRead) {
+  handler_->login_read_ = false;
+  ExpectResponse({0x00, 0xa0, 0x00, 0x47, 0x16, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x47, 0x16, 0x00, 0x2f, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x00, 0xc7, 0x16, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00},
+                 {0x20, 0x81, 0x00, 0x47, 0x16, 0x00, 0x2f, 0x00});
+  EXPECT_TRUE(state_->ErrorFlag());
+}
+
+// Login register is remembered once read, so that the session can be saved.
+TEST_F(FujiAcProtocolHandlerTest, SessionLearned) {
+  EXPECT_FALSE(handler_->Session().has_value());
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x00, 0x20},
+                 {0x20, 0x81, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x20, 0x1f, 0x1f, 0x05, 0x01, 0x00},
+                 {0x20, 0xa1, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  EXPECT_FALSE(handler_->Confirmed());
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  ASSERT_TRUE(handler_->Session().has_value());
+  EXPECT_EQ((std::array<uint8_t, 5>{0x1f, 0x1f, 0x05, 0x01, 0x00}),
+            handler_->Session()->login_register);
+  EXPECT_TRUE(handler_->Session()->controller_present);
+  EXPECT_EQ(3, handler_->FramesToConfirm());
+  EXPECT_EQ(1, handler_->FullLogins());
+}
+
+// Main unit still lists us after restart, first status is answered as usual.
+TEST_F(FujiAcProtocolHandlerTest, ResumeSession) {
+  handler_->ResumeSession({{0x1f, 0x1f, 0x05, 0x01, 0x00}, true});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  EXPECT_TRUE(handler_->Confirmed());
+  EXPECT_EQ(1, handler_->FramesToConfirm());
+  EXPECT_EQ(0, handler_->FullLogins());
+  EXPECT_EQ(0, handler_->FastLogins());
+}
+
+// Main unit dropped us, logged-in frame is sent without querying login
+// register.
+TEST_F(FujiAcProtocolHandlerTest, ResumeSessionFastLogin) {
+  handler_->ResumeSession({{0x1f, 0x1f, 0x05, 0x01, 0x00}, true});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x00, 0x20},
+                 {0x20, 0xa1, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  EXPECT_EQ(2, handler_->FramesToConfirm());
+  EXPECT_EQ(0, handler_->FullLogins());
+  EXPECT_EQ(1, handler_->FastLogins());
+}
+
+// If the logged-in frame alone is not accepted, full login follows.
+TEST_F(FujiAcProtocolHandlerTest, ResumeSessionFallback) {
+  handler_->ResumeSession({{0x1f, 0x1f, 0x05, 0x01, 0x00}, true});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x00, 0x20},
+                 {0x20, 0xa1, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x00, 0x20},
+                 {0x20, 0x81, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x20, 0x1f, 0x1f, 0x05, 0x01, 0x00},
+                 {0x20, 0xa1, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  ExpectResponse({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x01, 0x20},
+                 {0x20, 0x81, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  EXPECT_EQ(4, handler_->FramesToConfirm());
+  EXPECT_EQ(1, handler_->FullLogins());
+  EXPECT_EQ(1, handler_->FastLogins());
+}
+
+}  // namespace fuji_iot
@@ -21,6 +21,7 @@ namespace fuji_iot {
 mode_t FujiAcState::Mode() const { return mode_; }
 
 void FujiAcState::SetMode(mode_t mode) {
+  if (mode_ != mode) generation_++;
   mode_ = mode;
   merged_ = false;
 }
@@ -28,6 +29,7 @@ void FujiAcState::SetMode(mode_t mode) {
 bool FujiAcState::Enabled() const { return enabled_; }
 
 void FujiAcState::SetEnabled(bool enabled) {
+  if (enabled_ != enabled) generation_++;
   enabled_ = enabled;
   merged_ = false;
 }
@@ -35,6 +37,7 @@ void FujiAcState::SetEnabled(bool enabled) {
 fan_t FujiAcState::Fan() const { return fan_; }
 
 void FujiAcState::SetFan(fan_t fan) {
+  if (fan_ != fan) generation_++;
   fan_ = fan;
   merged_ = false;
 }
@@ -42,12 +45,14 @@ void FujiAcState::SetFan(fan_t fan) {
 bool FujiAcState::ErrorFlag() const { return error_flag_; }
 
 void FujiAcState::SetErrorFlag(bool error_flag) {
+  if (error_flag_ != error_flag) generation_++;
   error_flag_ = error_flag;
   merged_ = false;
 }
 
 bool FujiAcState::Economy() const { return economy_; }
 void FujiAcState::SetEconomy(bool economy) {
+  if (economy_ != economy) generation_++;
   economy_ = economy;
   merged_ = false;
 }
@@ -55,6 +60,7 @@ void FujiAcState::SetEconomy(bool economy) {
 uint8_t FujiAcState::Temperature() const { return temperature_; }
 
 void FujiAcState::SetTemperature(uint8_t temp) {
+  if (temperature_ != temp) generation_++;
   temperature_ = temp;
   merged_ = false;
 }
@@ -62,6 +68,7 @@ void FujiAcState::SetTemperature(uint8_t temp) {
 bool FujiAcState::Swing() const { return swing_; }
 
 void FujiAcState::SetSwing(bool swing) {
+  if (swing_ != swing) generation_++;
   swing_ = swing;
   merged_ = false;
 }
@@ -69,6 +76,7 @@ void FujiAcState::SetSwing(bool swing) {
 bool FujiAcState::FujiAcState::SwingStep() const { return swing_step_; }
 
 void FujiAcState::SetSwingStep(bool swing_step) {
+  if (swing_step_ != swing_step) generation_++;
   swing_step_ = swing_step;
   merged_ = false;
 }
@@ -76,6 +84,7 @@ void FujiAcState::SetSwingStep(bool swing_step) {
 bool FujiAcState::ControllerPresent() const { return controller_present_; }
 
 void FujiAcState::SetControllerPresent(bool controller_present) {
+  if (controller_present_ != controller_present) generation_++;
   controller_present_ = controller_present;
   merged_ = false;
 }
@@ -84,6 +93,8 @@ bool FujiAcState::Merged() const { return merged_; }
 
 void FujiAcState::SetMerged(bool merged) { merged_ = merged; }
 
+uint64_t FujiAcState::Generation() const { return generation_; }
+
 void FujiAcState::BuildStatusRegisterResponse(
     FujiStatusRegister *status) const {
   status->SetEnabled(enabled_);
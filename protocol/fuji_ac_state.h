@@ -43,6 +43,9 @@ class FujiAcState {
   // main unit.
   bool Merged() const;
   void SetMerged(bool merged);
+  // Incremented whenever any of the values above actually changes. Objects
+  // derived from the state can compare generations to tell they are stale.
+  uint64_t Generation() const;
 
   // Returns true if wired-controller was registered with the main unit.
   bool ControllerPresent() const;
@@ -66,6 +69,7 @@ class FujiAcState {
   bool swing_ = false;
   bool swing_step_ = false;
   bool merged_ = true;
+  uint64_t generation_ = 0;
 };
 
 }  // namespace fuji_iot
@@ -0,0 +1,79 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fuji_bus_sniffer.h"
+
+#include "fuji_register.h"
+
+namespace fuji_iot {
+namespace {
+
+// Main unit is the only device sending from this address.
+constexpr uint8_t kMainUnitAddr = 0;
+
+}  // namespace
+
+void FujiBusSniffer::HandleFrame(const std::array<uint8_t, 8> &frame) {
+  if (frame[0] == kMainUnitAddr) {
+    FujiMasterFrame master_frame(frame);
+    // Only status register is meaningful without taking part in the login
+    // and error query exchange.
+    if (master_frame.Type() != RegisterType::STATUS) return;
+    std::array<uint8_t, 5> payload = master_frame.Payload();
+    FujiStatusRegister status(payload.data());
+    Shadow &shadow = shadows_[frame[1] & 0b01111111];
+    shadow.state.MergeFromMasterStatusRegister(status);
+    shadow.frames++;
+    return;
+  }
+  // Frame of a controller. It carries its status only when writing a change,
+  // otherwise main unit's next status frame tells the same.
+  FujiControllerFrame controller_frame(frame);
+  if (controller_frame.QueryRegister() != RegisterType::STATUS ||
+      !controller_frame.WriteBit()) {
+    return;
+  }
+  // Only fields a controller may change are taken, the rest of its payload
+  // is not meaningful.
+  std::array<uint8_t, 5> payload = controller_frame.Payload();
+  FujiStatusRegister status(payload.data());
+  Shadow &shadow = shadows_[frame[0]];
+  shadow.state.SetEnabled(status.Enabled());
+  shadow.state.SetMode(status.Mode());
+  shadow.state.SetFan(status.Fan());
+  shadow.state.SetEconomy(status.Economy());
+  shadow.state.SetTemperature(status.Temperature());
+  shadow.state.SetSwing(status.Swing());
+  shadow.frames++;
+}
+
+std::vector<uint8_t> FujiBusSniffer::Addresses() const {
+  std::vector<uint8_t> ret;
+  for (const auto &it : shadows_) {
+    ret.push_back(it.first);
+  }
+  return ret;
+}
+
+const FujiAcState *FujiBusSniffer::State(uint8_t address) const {
+  auto it = shadows_.find(address);
+  return it == shadows_.end() ? nullptr : &it->second.state;
+}
+
+uint64_t FujiBusSniffer::Frames(uint8_t address) const {
+  auto it = shadows_.find(address);
+  return it == shadows_.end() ? 0 : it->second.frames;
+}
+
+}  // namespace fuji_iot
@@ -0,0 +1,58 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_BUS_SNIFFER_H_
+#define FUJI_BUS_SNIFFER_H_
+
+#include <bits/stdint-uintn.h>
+
+#include <array>
+#include <map>
+#include <vector>
+
+#include "fuji_ac_state.h"
+#include "fuji_frame.h"
+
+namespace fuji_iot {
+// Decodes traffic of a bus without taking part in it. Unlike
+// FujiAcProtocolHandler, which answers only frames addressed to the wired
+// controller, the sniffer follows the main unit's status frames to every
+// address, and status writes of controllers already present on the bus, and
+// keeps a shadow state for each address seen.
+//
+// [source, destination, register_type, payload (5-byte)]
+//
+// Main unit sends frames from address 0, controllers from their own address.
+class FujiBusSniffer {
+ public:
+  // Processes a single frame seen on the bus.
+  void HandleFrame(const std::array<uint8_t, 8> &frame);
+  // Addresses that had a status seen so far, in increasing order.
+  std::vector<uint8_t> Addresses() const;
+  // Returns shadow state of the address, nullptr if none was seen.
+  const FujiAcState *State(uint8_t address) const;
+  // Number of frames that updated the shadow state of the address.
+  uint64_t Frames(uint8_t address) const;
+
+ private:
+  struct Shadow {
+    FujiAcState state;
+    uint64_t frames = 0;
+  };
+  std::map<uint8_t, Shadow> shadows_;
+};
+
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,68 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fuji_bus_sniffer.h"
+
+#include "gtest/gtest.h"
+
+namespace fuji_iot {
+// Frames below come from captures used by FujiAcProtocolHandlerTest.
+
+TEST(FujiBusSnifferTest, FollowsEveryAddress) {
+  FujiBusSniffer sniffer;
+  EXPECT_EQ(nullptr, sniffer.State(32));
+  sniffer.HandleFrame({0x00, 0x81, 0x00, 0x46, 0x12, 0xa0, 0x00, 0x20});
+  sniffer.HandleFrame({0x00, 0xa0, 0x00, 0x47, 0x16, 0xa0, 0x01, 0x20});
+  EXPECT_EQ(std::vector<uint8_t>({1, 32}), sniffer.Addresses());
+
+  const FujiAcState *other = sniffer.State(1);
+  ASSERT_NE(nullptr, other);
+  EXPECT_FALSE(other->Enabled());
+  EXPECT_EQ(18, other->Temperature());
+
+  const FujiAcState *wired = sniffer.State(32);
+  ASSERT_NE(nullptr, wired);
+  EXPECT_TRUE(wired->Enabled());
+  EXPECT_EQ(mode_t::COOL, wired->Mode());
+  EXPECT_EQ(fan_t::MAX, wired->Fan());
+  EXPECT_EQ(22, wired->Temperature());
+  EXPECT_TRUE(wired->ControllerPresent());
+  EXPECT_EQ(1, sniffer.Frames(32));
+}
+
+TEST(FujiBusSnifferTest, IgnoresLoginAndErrorRegisters) {
+  FujiBusSniffer sniffer;
+  sniffer.HandleFrame({0x00, 0xa0, 0x20, 0x1f, 0x1f, 0x05, 0x01, 0x00});
+  sniffer.HandleFrame({0x00, 0xa0, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00});
+  EXPECT_TRUE(sniffer.Addresses().empty());
+}
+
+TEST(FujiBusSnifferTest, FollowsWritesOfExistingController) {
+  FujiBusSniffer sniffer;
+  sniffer.HandleFrame({0x00, 0xa0, 0x00, 0x46, 0x12, 0xa0, 0x01, 0x20});
+  // Plain status reply and query frames carry nothing new.
+  sniffer.HandleFrame({0x20, 0x81, 0x00, 0x46, 0x12, 0x00, 0x2f, 0x00});
+  sniffer.HandleFrame({0x20, 0x81, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00});
+  EXPECT_EQ(1, sniffer.Frames(32));
+  EXPECT_FALSE(sniffer.State(32)->Enabled());
+
+  // Remote turns the unit on, before main unit confirms it.
+  sniffer.HandleFrame({0x20, 0x81, 0x08, 0x47, 0x16, 0x00, 0x2f, 0x00});
+  EXPECT_EQ(2, sniffer.Frames(32));
+  EXPECT_TRUE(sniffer.State(32)->Enabled());
+  EXPECT_EQ(22, sniffer.State(32)->Temperature());
+  EXPECT_TRUE(sniffer.State(32)->ControllerPresent());
+}
+
+}  // namespace fuji_iot
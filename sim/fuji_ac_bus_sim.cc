@@ -0,0 +1,188 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sim/fuji_ac_bus_sim.h"
+
+#include <glog/logging.h>
+
+namespace fuji_iot {
+namespace sim {
+namespace {
+
+template <typename Status>
+std::array<int, 6> FieldsOf(const Status &s) {
+  return {s.Enabled(),
+          static_cast<int>(s.Mode()),
+          static_cast<int>(s.Fan()),
+          s.Economy(),
+          s.Temperature(),
+          s.Swing()};
+}
+
+std::array<int, 6> FieldsOf(std::array<uint8_t, 5> payload) {
+  return FieldsOf(FujiStatusRegister(payload.data()));
+}
+
+}  // namespace
+
+FujiForeignControllerSim::FujiForeignControllerSim(uint8_t address)
+    : address_(address) {}
+
+FujiControllerFrame FujiForeignControllerSim::HandleStatus(
+    const std::array<uint8_t, 5> &status) {
+  std::array<uint8_t, 5> current = status;
+  FujiStatusRegister current_status(current.data());
+  if (!ApplyPending(&current_status)) ClearPending();
+
+  // Reply is built from the previous status, as the remote prepares it ahead.
+  std::array<uint8_t, 5> payload = view_.value_or(status);
+  basis_ = payload;
+  view_ = status;
+  FujiControllerFrame f({address_, 129, 0, 0, 0, 0, 0, 0});
+  f.WithQueryRegister(RegisterType::STATUS);
+  FujiStatusRegister reply(payload.data());
+  if (Pending()) {
+    if (attempts_ < kMaxAttempts) {
+      ApplyPending(&reply);
+      f.WithWriteBit(true);
+      attempts_++;
+    } else {
+      VLOG(1) << "Foreign controller gave up a change";
+      abandoned_++;
+      ClearPending();
+    }
+  }
+  f.WithPayload(payload);
+  return f;
+}
+
+bool FujiForeignControllerSim::ApplyPending(FujiStatusRegister *status) const {
+  bool changed = false;
+  if (enabled_.has_value() && status->Enabled() != *enabled_) {
+    status->SetEnabled(*enabled_);
+    changed = true;
+  }
+  if (mode_.has_value() && status->Mode() != *mode_) {
+    status->SetMode(*mode_);
+    changed = true;
+  }
+  if (fan_.has_value() && status->Fan() != *fan_) {
+    status->SetFan(*fan_);
+    changed = true;
+  }
+  if (temperature_.has_value() && status->Temperature() != *temperature_) {
+    status->SetTemperature(*temperature_);
+    changed = true;
+  }
+  return changed;
+}
+
+void FujiForeignControllerSim::ClearPending() {
+  enabled_.reset();
+  mode_.reset();
+  fan_.reset();
+  temperature_.reset();
+  attempts_ = 0;
+}
+
+void FujiForeignControllerSim::SetEnabled(bool enabled) { enabled_ = enabled; }
+
+void FujiForeignControllerSim::SetMode(mode_t mode) { mode_ = mode; }
+
+void FujiForeignControllerSim::SetFan(fan_t fan) { fan_ = fan; }
+
+void FujiForeignControllerSim::SetTemperature(uint8_t temp) {
+  temperature_ = temp;
+}
+
+bool FujiForeignControllerSim::Pending() const {
+  return enabled_.has_value() || mode_.has_value() || fan_.has_value() ||
+         temperature_.has_value();
+}
+
+uint64_t FujiForeignControllerSim::Abandoned() const { return abandoned_; }
+
+std::array<uint8_t, 5> FujiForeignControllerSim::Basis() const {
+  return basis_;
+}
+
+FujiAcBusSim::FujiAcBusSim(FujiAcUnitSim *unit,
+                           FujiForeignControllerSim *foreign,
+                           bool foreign_first)
+    : unit_(unit), foreign_(foreign), foreign_first_(foreign_first) {}
+
+void FujiAcBusSim::Cycle(FujiAcProtocolHandler *handler) {
+  if (foreign_first_) {
+    ForeignSlot(handler);
+    HandlerSlot(handler);
+  } else {
+    HandlerSlot(handler);
+    ForeignSlot(handler);
+  }
+  cycles_++;
+}
+
+void FujiAcBusSim::HandlerSlot(FujiAcProtocolHandler *handler) {
+  FujiMasterFrame status = unit_->GetNextMasterFrame();
+  absl::optional<FujiControllerFrame> reply =
+      handler->HandleMasterFrame(status);
+  if (!reply.has_value()) return;
+  std::array<int, kFields> before = FieldsOf(*unit_);
+  unit_->PushControllerFrame(*reply);
+  Record(*reply, Writer::HANDLER, before, FieldsOf(status.Payload()));
+}
+
+void FujiAcBusSim::ForeignSlot(FujiAcProtocolHandler *handler) {
+  FujiControllerFrame reply = foreign_->HandleStatus(unit_->StatusPayload());
+  // The handler hears the frame too.
+  handler->HandleMasterFrame(FujiMasterFrame(reply.FullFrame()));
+  std::array<int, kFields> before = FieldsOf(*unit_);
+  unit_->ApplyControllerWrite(reply);
+  Record(reply, Writer::FOREIGN, before, FieldsOf(foreign_->Basis()));
+}
+
+void FujiAcBusSim::Record(const FujiControllerFrame &frame, Writer writer,
+                          const std::array<int, kFields> &before,
+                          const std::array<int, kFields> &basis) {
+  if (frame.QueryRegister() != RegisterType::STATUS || !frame.WriteBit()) {
+    return;
+  }
+  (writer == Writer::HANDLER ? writes_ : foreign_writes_)++;
+  std::array<int, kFields> after = FieldsOf(*unit_);
+  for (int i = 0; i < kFields; ++i) {
+    if (after[i] == before[i]) continue;
+    FieldHistory &h = history_[i];
+    if (h.writer != Writer::NONE && h.writer != writer &&
+        cycles_ - h.cycle <= kCollisionWindow && after[i] == h.previous) {
+      VLOG(1) << "Write collision on field " << i;
+      collisions_++;
+    }
+    // Values copied from an outdated status are not changes of the writer.
+    if (after[i] == basis[i]) continue;
+    h.writer = writer;
+    h.cycle = cycles_;
+    h.previous = before[i];
+  }
+}
+
+uint64_t FujiAcBusSim::Cycles() const { return cycles_; }
+
+uint64_t FujiAcBusSim::Writes() const { return writes_; }
+
+uint64_t FujiAcBusSim::ForeignWrites() const { return foreign_writes_; }
+
+uint64_t FujiAcBusSim::Collisions() const { return collisions_; }
+
+}  // namespace sim
+}  // namespace fuji_iot
@@ -0,0 +1,122 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_BUS_SIM_H_
+#define FUJI_AC_BUS_SIM_H_
+
+#include <array>
+#include <cstdint>
+
+#include "absl/types/optional.h"
+#include "protocol/fuji_ac_protocol_handler.h"
+#include "protocol/fuji_frame.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace sim {
+// Simulates a second wired controller (e.g. UTY remote) on the same bus.
+// Like the real one, it writes its whole view of the state, which is built
+// from the status received in the previous cycle. Changes are written until
+// main unit confirms them, at most kMaxAttempts times.
+class FujiForeignControllerSim {
+ public:
+  static constexpr uint8_t kDefaultAddr = 33;
+  static constexpr int kMaxAttempts = 8;
+
+  explicit FujiForeignControllerSim(uint8_t address = kDefaultAddr);
+  // Answers status of main unit.
+  FujiControllerFrame HandleStatus(const std::array<uint8_t, 5> &status);
+
+  // Changes made with the buttons of the remote.
+  void SetEnabled(bool enabled);
+  void SetMode(mode_t mode);
+  void SetFan(fan_t fan);
+  void SetTemperature(uint8_t temp);
+  // True while some change was not confirmed by main unit yet.
+  bool Pending() const;
+  // Number of changes abandoned after kMaxAttempts.
+  uint64_t Abandoned() const;
+  // Status the last reply was built from.
+  std::array<uint8_t, 5> Basis() const;
+
+ private:
+  // Applies pending changes to the register, returns false if none differ.
+  bool ApplyPending(FujiStatusRegister *status) const;
+  void ClearPending();
+
+  const uint8_t address_;
+  absl::optional<std::array<uint8_t, 5>> view_;
+  std::array<uint8_t, 5> basis_ = {};
+  absl::optional<bool> enabled_;
+  absl::optional<mode_t> mode_;
+  absl::optional<fan_t> fan_;
+  absl::optional<uint8_t> temperature_;
+  int attempts_ = 0;
+  uint64_t abandoned_ = 0;
+};
+
+// Bus with main unit and two wired controllers: protocol handler under test
+// and a foreign one. Every cycle main unit polls both of them, order of the
+// slots is configurable. All frames are visible to the handler, as on the
+// real bus.
+class FujiAcBusSim {
+ public:
+  // Cycles within which reverting the other controller's change counts as a
+  // collision.
+  static constexpr uint64_t kCollisionWindow = 4;
+
+  FujiAcBusSim(FujiAcUnitSim *unit, FujiForeignControllerSim *foreign,
+               bool foreign_first = false);
+  void Cycle(FujiAcProtocolHandler *handler);
+
+  uint64_t Cycles() const;
+  // Status writes of the handler and the foreign controller.
+  uint64_t Writes() const;
+  uint64_t ForeignWrites() const;
+  // Writes that reverted a field recently changed on purpose by the other
+  // controller.
+  uint64_t Collisions() const;
+
+ private:
+  static constexpr int kFields = 6;
+  // Controller that made a change.
+  enum class Writer { NONE, HANDLER, FOREIGN };
+  // Most recent change of a field.
+  struct FieldHistory {
+    Writer writer = Writer::NONE;
+    uint64_t cycle = 0;
+    int previous = 0;
+  };
+
+  void HandlerSlot(FujiAcProtocolHandler *handler);
+  void ForeignSlot(FujiAcProtocolHandler *handler);
+  // Tracks changes made by a write. before holds fields prior to it, basis
+  // the status the writer built the frame from.
+  void Record(const FujiControllerFrame &frame, Writer writer,
+              const std::array<int, kFields> &before,
+              const std::array<int, kFields> &basis);
+
+  FujiAcUnitSim *const unit_;
+  FujiForeignControllerSim *const foreign_;
+  const bool foreign_first_;
+  uint64_t cycles_ = 0;
+  uint64_t writes_ = 0;
+  uint64_t foreign_writes_ = 0;
+  uint64_t collisions_ = 0;
+  std::array<FieldHistory, kFields> history_;
+};
+}  // namespace sim
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,100 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sim/fuji_ac_bus_sim.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "protocol/fuji_ac_state.h"
+
+namespace fuji_iot {
+namespace sim {
+
+class FujiAcBusSimTest : public testing::TestWithParam<bool> {
+ protected:
+  void Start(bool yield, bool foreign_first) {
+    state_ = new FujiAcState();
+    handler_.reset(new FujiAcProtocolHandler(
+        std::unique_ptr<FujiAcState>(state_), yield));
+    bus_.reset(new FujiAcBusSim(&unit_, &foreign_, foreign_first));
+    unit_.SetEnabled(true);
+    unit_.SetFan(fan_t::LOW);
+    unit_.SetTemperature(22);
+    // Login and first status.
+    RunCycles(5);
+  }
+
+  void RunCycles(int cycles) {
+    for (int i = 0; i < cycles; ++i) bus_->Cycle(handler_.get());
+  }
+
+  FujiAcUnitSim unit_;
+  FujiForeignControllerSim foreign_;
+  FujiAcState *state_;
+  std::unique_ptr<FujiAcProtocolHandler> handler_;
+  std::unique_ptr<FujiAcBusSim> bus_;
+};
+
+TEST_F(FujiAcBusSimTest, DetectsForeignController) {
+  Start(true, false);
+  EXPECT_TRUE(handler_->ForeignControllerPresent());
+  EXPECT_EQ(0, handler_->ForeignWrites());
+  EXPECT_EQ(22, state_->Temperature());
+}
+
+TEST_P(FujiAcBusSimTest, DifferentFieldsBothApplied) {
+  Start(true, GetParam());
+  state_->SetTemperature(25);
+  foreign_.SetFan(fan_t::HIGH);
+  RunCycles(10);
+  EXPECT_EQ(25, unit_.Temperature());
+  EXPECT_EQ(fan_t::HIGH, unit_.Fan());
+  EXPECT_EQ(25, state_->Temperature());
+  EXPECT_EQ(fan_t::HIGH, state_->Fan());
+  EXPECT_TRUE(state_->Merged());
+  EXPECT_FALSE(foreign_.Pending());
+  // If our slot comes first, remote's write built from the older status
+  // reverts our change once and the handler writes it again.
+  EXPECT_EQ(GetParam() ? 0 : 1, bus_->Collisions());
+  EXPECT_EQ(0, handler_->YieldedChanges());
+}
+
+TEST_P(FujiAcBusSimTest, SameFieldForeignWins) {
+  Start(true, GetParam());
+  state_->SetTemperature(25);
+  foreign_.SetTemperature(19);
+  RunCycles(10);
+  EXPECT_EQ(19, unit_.Temperature());
+  EXPECT_EQ(19, state_->Temperature());
+  EXPECT_TRUE(state_->Merged());
+  EXPECT_FALSE(foreign_.Pending());
+  EXPECT_EQ(1, handler_->YieldedChanges());
+}
+
+TEST_F(FujiAcBusSimTest, WithoutYieldingChangeIsLost) {
+  Start(false, false);
+  state_->SetTemperature(25);
+  foreign_.SetFan(fan_t::HIGH);
+  RunCycles(10);
+  // Foreign write built from an older status reverts ours.
+  EXPECT_EQ(22, unit_.Temperature());
+  EXPECT_EQ(fan_t::HIGH, unit_.Fan());
+  EXPECT_EQ(1, bus_->Collisions());
+}
+
+INSTANTIATE_TEST_SUITE_P(SlotOrder, FujiAcBusSimTest, testing::Bool());
+
+}  // namespace sim
+}  // namespace fuji_iot
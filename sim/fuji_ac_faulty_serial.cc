@@ -0,0 +1,231 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sim/fuji_ac_faulty_serial.h"
+
+#include <algorithm>
+
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "protocol/fuji_register.h"
+#include "protocol/fuji_types.h"
+
+namespace fuji_iot {
+namespace sim {
+namespace {
+
+// Fields of the status the controller replies with agree with the unit.
+bool SameSettings(std::array<uint8_t, 5> unit, std::array<uint8_t, 5> reply) {
+  FujiStatusRegister a(unit.data());
+  FujiStatusRegister b(reply.data());
+  // Temperature is not written back in fan mode.
+  return a.Enabled() == b.Enabled() && a.Mode() == b.Mode() &&
+         a.Fan() == b.Fan() && a.Economy() == b.Economy() &&
+         a.Swing() == b.Swing() &&
+         (a.Mode() == mode_t::FAN || a.Temperature() == b.Temperature());
+}
+
+}  // namespace
+
+const char *FaultClassName(FaultClass fault) {
+  switch (fault) {
+    case FaultClass::BIT_FLIP:
+      return "bit_flip";
+    case FaultClass::TRUNCATED:
+      return "truncated";
+    case FaultClass::DUPLICATED:
+      return "duplicated";
+    case FaultClass::GARBAGE:
+      return "garbage";
+    case FaultClass::SILENCE:
+      return "silence";
+    case FaultClass::MASTER_RESET:
+      return "master_reset";
+  }
+  return "unknown";
+}
+
+FujiAcFaultySerial::FujiAcFaultySerial(FujiAcSimSerial *sim,
+                                       const FaultOptions &options)
+    : sim_(sim), options_(options), random_(options.seed) {}
+
+void FujiAcFaultySerial::WriteControllerFrame(
+    const FujiControllerFrame &frame) {
+  sim_->WriteControllerFrame(frame);
+  last_reply_ = frame;
+  if (open_.has_value() && frame.WriteBit()) {
+    absl::MutexLock l(&mu_);
+    stats_[static_cast<int>(open_->fault)].extra_writes++;
+  }
+}
+
+absl::optional<FujiMasterFrame> FujiAcFaultySerial::ReadMasterFrame() {
+  frames_++;
+  Track();
+  if (queued_.has_value()) {
+    absl::optional<FujiMasterFrame> frame = *queued_;
+    queued_.reset();
+    open_->frame = frames_;
+    open_->start = absl::Now();
+    return frame;
+  }
+  if (silence_left_ > 0) {
+    sim_->ReadMasterFrame();
+    if (--silence_left_ == 0) {
+      open_->frame = frames_;
+      open_->start = absl::Now();
+    }
+    return absl::optional<FujiMasterFrame>();
+  }
+  absl::optional<FaultClass> fault;
+  if (!open_.has_value() && (fault = Draw()).has_value()) {
+    open_ = OpenFault{*fault, frames_, absl::Now()};
+    // Recovery needs a reply given after the fault.
+    last_reply_.reset();
+    absl::MutexLock l(&mu_);
+    stats_[static_cast<int>(*fault)].injected++;
+  }
+  if (fault == FaultClass::MASTER_RESET) {
+    sim_->WithSim([](FujiAcUnitSim *unit) { unit->Restart(); });
+  }
+  absl::optional<FujiMasterFrame> frame = sim_->ReadMasterFrame();
+  if (!fault.has_value() || !frame.has_value()) return frame;
+  return Inject(*fault, *frame);
+}
+
+bool FujiAcFaultySerial::Converged() {
+  if (!last_reply_.has_value() || last_reply_->WriteBit() ||
+      last_reply_->LoginBit() ||
+      last_reply_->QueryRegister() != RegisterType::STATUS) {
+    return false;
+  }
+  bool present = false;
+  std::array<uint8_t, 5> status;
+  sim_->WithSim([&](FujiAcUnitSim *unit) {
+    present = unit->ControllerPresent();
+    status = unit->StatusPayload();
+  });
+  return present && SameSettings(status, last_reply_->Payload());
+}
+
+void FujiAcFaultySerial::Track() {
+  if (queued_.has_value() || silence_left_ > 0) return;
+  bool converged = Converged();
+  if (!open_.has_value()) {
+    quiet_ = converged ? quiet_ + 1 : 0;
+    return;
+  }
+  // Frames after the last one affected by the fault.
+  uint64_t frames = frames_ - open_->frame - 1;
+  if (!converged && frames < static_cast<uint64_t>(options_.max_recovery_frames)) {
+    return;
+  }
+  {
+    absl::MutexLock l(&mu_);
+    FaultClassStats &stats = stats_[static_cast<int>(open_->fault)];
+    if (converged) {
+      stats.recovered++;
+      stats.recovery_frames += frames;
+      stats.recovery_time += absl::Now() - open_->start;
+      stats.max_recovery_frames = std::max(stats.max_recovery_frames, frames);
+    } else {
+      stats.unrecovered++;
+    }
+  }
+  open_.reset();
+  quiet_ = converged ? 1 : 0;
+}
+
+void FujiAcFaultySerial::InjectNext(FaultClass fault) {
+  absl::MutexLock l(&mu_);
+  forced_.push_back(fault);
+}
+
+absl::optional<FaultClass> FujiAcFaultySerial::Draw() {
+  {
+    absl::MutexLock l(&mu_);
+    if (!forced_.empty()) {
+      FaultClass fault = forced_.front();
+      forced_.pop_front();
+      return fault;
+    }
+  }
+  if (quiet_ < options_.quiet_frames) return absl::nullopt;
+  // mt19937 output is the same everywhere, unlike std distributions.
+  double r = random_() / 4294967296.0;
+  for (int i = 0; i < kFaultClasses; ++i) {
+    r -= options_.probability[i];
+    if (r < 0) return static_cast<FaultClass>(i);
+  }
+  return absl::nullopt;
+}
+
+absl::optional<FujiMasterFrame> FujiAcFaultySerial::Inject(
+    FaultClass fault, const FujiMasterFrame &frame) {
+  std::array<uint8_t, 8> data = frame.FullFrame();
+  switch (fault) {
+    case FaultClass::BIT_FLIP: {
+      uint32_t bit = random_() % 64;
+      data[bit / 8] ^= 1 << (bit % 8);
+      return FujiMasterFrame(data);
+    }
+    case FaultClass::TRUNCATED:
+      return absl::optional<FujiMasterFrame>();
+    case FaultClass::DUPLICATED:
+      queued_ = absl::optional<FujiMasterFrame>(frame);
+      return frame;
+    case FaultClass::GARBAGE: {
+      size_t garbage = 1 + random_() % 7;
+      std::copy_backward(data.begin(), data.end() - garbage, data.end());
+      for (size_t i = 0; i < garbage; ++i) data[i] = random_() & 0xff;
+      queued_ = absl::optional<FujiMasterFrame>();
+      return FujiMasterFrame(data);
+    }
+    case FaultClass::SILENCE:
+      silence_left_ = options_.silence_frames - 1;
+      if (silence_left_ == 0) {
+        open_->frame = frames_;
+        open_->start = absl::Now();
+      }
+      return absl::optional<FujiMasterFrame>();
+    case FaultClass::MASTER_RESET:
+      break;
+  }
+  return frame;
+}
+
+FaultClassStats FujiAcFaultySerial::Stats(FaultClass fault) const {
+  absl::MutexLock l(&mu_);
+  return stats_[static_cast<int>(fault)];
+}
+
+std::string FujiAcFaultySerial::Report() const {
+  std::string report = absl::StrFormat(
+      "%-13s %8s %9s %11s %10s %10s %10s %12s\n", "fault", "injected",
+      "recovered", "unrecovered", "avg_frames", "max_frames", "avg_ms", "extra_writes");
+  for (int i = 0; i < kFaultClasses; ++i) {
+    FaultClassStats stats = Stats(static_cast<FaultClass>(i));
+    double n = std::max<uint64_t>(stats.recovered, 1);
+    absl::StrAppendFormat(
+        &report, "%-13s %8d %9d %11d %10.1f %10d %10.1f %12d\n",
+        FaultClassName(static_cast<FaultClass>(i)), stats.injected,
+        stats.recovered, stats.unrecovered, stats.recovery_frames / n, stats.max_recovery_frames,
+        absl::ToDoubleMilliseconds(stats.recovery_time) / n,
+        stats.extra_writes);
+  }
+  return report;
+}
+
+}  // namespace sim
+}  // namespace fuji_iot
@@ -0,0 +1,136 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_FAULTY_SERIAL_H_
+#define FUJI_AC_FAULTY_SERIAL_H_
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "controller/fuji_ac_serial_interface.h"
+#include "protocol/fuji_frame.h"
+#include "sim/fuji_ac_sim_serial.h"
+
+namespace fuji_iot {
+namespace sim {
+enum class FaultClass {
+  // Master frame delivered with one bit flipped, as when a double error
+  // within a byte passes the parity check.
+  BIT_FLIP = 0,
+  // Line goes silent before the master frame is complete.
+  TRUNCATED = 1,
+  // Master frame received twice.
+  DUPLICATED = 2,
+  // Noise before the master frame shifts it, so that garbage and its first
+  // bytes are received as a frame and the rest as an incomplete one.
+  GARBAGE = 3,
+  // Nothing received for FaultOptions::silence_frames master frames.
+  SILENCE = 4,
+  // Main unit power cycles and forgets the controller.
+  MASTER_RESET = 5,
+};
+constexpr int kFaultClasses = 6;
+
+const char *FaultClassName(FaultClass fault);
+
+struct FaultOptions {
+  // Faults are drawn from a generator seeded with this, so that a run can
+  // be repeated.
+  uint32_t seed = 1;
+  // Probability of a fault of given class per master frame, indexed by
+  // FaultClass. Sum must not exceed 1.
+  std::array<double, kFaultClasses> probability = {};
+  int silence_frames = 10;
+  // Faults are only injected after the bus was converged for this many
+  // master frames, so that every recovery is measured on its own.
+  int quiet_frames = 3;
+  // Fault not recovered from within this many master frames is counted as
+  // unrecovered.
+  int max_recovery_frames = 200;
+};
+
+struct FaultClassStats {
+  uint64_t injected = 0;
+  uint64_t recovered = 0;
+  // Not converged within FaultOptions::max_recovery_frames.
+  uint64_t unrecovered = 0;
+  // Sums over recovered faults, from injection until the bus converged.
+  uint64_t recovery_frames = 0;
+  absl::Duration recovery_time;
+  uint64_t max_recovery_frames = 0;
+  // Controller frames with the write bit set while recovering. Without
+  // pending updates a converged bus carries none, so all of them are extra.
+  uint64_t extra_writes = 0;
+};
+
+// Sim transport injecting faults between the simulated unit and the
+// controller. Bus is converged when the main unit lists the controller and
+// the last reply was a plain status reply agreeing with the unit state.
+class FujiAcFaultySerial : public FujiAcSerialInterface {
+ public:
+  FujiAcFaultySerial(FujiAcSimSerial *sim, const FaultOptions &options);
+  void WriteControllerFrame(const FujiControllerFrame &frame) override;
+  absl::optional<FujiMasterFrame> ReadMasterFrame() override;
+
+  // Queues fault for the next master frame once no other fault is being
+  // recovered from, regardless of probabilities. Queued faults are injected
+  // in order. May be called from any thread.
+  void InjectNext(FaultClass fault);
+
+  FaultClassStats Stats(FaultClass fault) const;
+  // Table of the stats of all fault classes.
+  std::string Report() const;
+
+ private:
+  struct OpenFault {
+    FaultClass fault;
+    uint64_t frame;
+    absl::Time start;
+  };
+
+  // Bus converged as of now, called on the bus thread.
+  bool Converged();
+  // Closes open fault if recovered or out of time, else draws a new one.
+  void Track();
+  absl::optional<FaultClass> Draw();
+  // Applies fault to a frame just read from the unit.
+  absl::optional<FujiMasterFrame> Inject(FaultClass fault,
+                                         const FujiMasterFrame &frame);
+
+  FujiAcSimSerial *const sim_;
+  const FaultOptions options_;
+  std::mt19937 random_;
+  absl::optional<FujiControllerFrame> last_reply_;
+  // Frame delivered on the next read instead of reading the unit, the
+  // duplicate or the incomplete rest of a shifted frame.
+  absl::optional<absl::optional<FujiMasterFrame>> queued_;
+  int silence_left_ = 0;
+  int quiet_ = 0;
+  uint64_t frames_ = 0;
+  absl::optional<OpenFault> open_;
+
+  mutable absl::Mutex mu_;
+  std::array<FaultClassStats, kFaultClasses> stats_ ABSL_GUARDED_BY(mu_);
+  std::deque<FaultClass> forced_ ABSL_GUARDED_BY(mu_);
+};
+}  // namespace sim
+}  // namespace fuji_iot
+
+#endif
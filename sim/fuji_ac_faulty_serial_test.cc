@@ -0,0 +1,135 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sim/fuji_ac_faulty_serial.h"
+
+#include <memory>
+
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+#include "protocol/fuji_ac_protocol_handler.h"
+#include "protocol/fuji_ac_state.h"
+#include "sim/fuji_ac_sim_serial.h"
+
+namespace fuji_iot {
+namespace sim {
+namespace {
+
+// Recovery of every class is expected within this many master frames.
+constexpr uint64_t kMaxRecoveryFrames = 6;
+
+class FujiAcFaultySerialTest : public testing::TestWithParam<FaultClass> {
+ protected:
+  FujiAcFaultySerialTest() : sim_(absl::ZeroDuration()) {
+    sim_.WithSim([](FujiAcUnitSim *unit) {
+      unit->SetEnabled(true);
+      unit->SetTemperature(22);
+    });
+  }
+
+  // Runs the handler as the controller's bus loop does.
+  void RunFrames(FujiAcFaultySerial *serial, int frames) {
+    for (int i = 0; i < frames; ++i) {
+      absl::optional<FujiMasterFrame> mf = serial->ReadMasterFrame();
+      if (!mf.has_value()) continue;
+      absl::optional<FujiControllerFrame> cf = handler_.HandleMasterFrame(*mf);
+      if (cf.has_value()) serial->WriteControllerFrame(*cf);
+      handler_.PrepareReplies();
+    }
+  }
+
+  static FaultOptions Only(FaultClass fault, double probability) {
+    FaultOptions options;
+    options.probability[static_cast<int>(fault)] = probability;
+    return options;
+  }
+
+  FujiAcSimSerial sim_;
+  FujiAcProtocolHandler handler_{
+      std::unique_ptr<FujiAcState>(new FujiAcState())};
+};
+
+TEST_P(FujiAcFaultySerialTest, RecoversFromEveryFault) {
+  FujiAcFaultySerial serial(&sim_, Only(GetParam(), 0.2));
+  RunFrames(&serial, 3000);
+  FaultClassStats stats = serial.Stats(GetParam());
+  EXPECT_GT(stats.injected, 50);
+  EXPECT_EQ(0, stats.unrecovered);
+  // The last one may still be in progress.
+  EXPECT_GE(stats.recovered + 1, stats.injected);
+  EXPECT_LE(stats.max_recovery_frames, kMaxRecoveryFrames);
+  sim_.WithSim([](FujiAcUnitSim *unit) {
+    EXPECT_TRUE(unit->Enabled());
+    EXPECT_EQ(22, unit->Temperature());
+  });
+}
+
+TEST_P(FujiAcFaultySerialTest, SameSeedSameRun) {
+  FujiAcFaultySerial serial(&sim_, Only(GetParam(), 0.2));
+  RunFrames(&serial, 500);
+
+  FujiAcSimSerial other_sim(absl::ZeroDuration());
+  other_sim.WithSim([](FujiAcUnitSim *unit) {
+    unit->SetEnabled(true);
+    unit->SetTemperature(22);
+  });
+  FujiAcProtocolHandler other_handler(
+      std::unique_ptr<FujiAcState>(new FujiAcState()));
+  FujiAcFaultySerial other(&other_sim, Only(GetParam(), 0.2));
+  for (int i = 0; i < 500; ++i) {
+    absl::optional<FujiMasterFrame> mf = other.ReadMasterFrame();
+    if (!mf.has_value()) continue;
+    absl::optional<FujiControllerFrame> cf =
+        other_handler.HandleMasterFrame(*mf);
+    if (cf.has_value()) other.WriteControllerFrame(*cf);
+    other_handler.PrepareReplies();
+  }
+  FaultClassStats a = serial.Stats(GetParam());
+  FaultClassStats b = other.Stats(GetParam());
+  EXPECT_EQ(a.injected, b.injected);
+  EXPECT_EQ(a.recovered, b.recovered);
+  EXPECT_EQ(a.recovery_frames, b.recovery_frames);
+  EXPECT_EQ(a.extra_writes, b.extra_writes);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllFaults, FujiAcFaultySerialTest,
+    testing::Values(FaultClass::BIT_FLIP, FaultClass::TRUNCATED,
+                    FaultClass::DUPLICATED, FaultClass::GARBAGE,
+                    FaultClass::SILENCE, FaultClass::MASTER_RESET),
+    [](const testing::TestParamInfo<FaultClass> &info) {
+      return std::string(FaultClassName(info.param));
+    });
+
+TEST_F(FujiAcFaultySerialTest, MasterResetNeedsLogin) {
+  FujiAcFaultySerial serial(&sim_, Only(FaultClass::MASTER_RESET, 1));
+  RunFrames(&serial, 200);
+  FaultClassStats stats = serial.Stats(FaultClass::MASTER_RESET);
+  EXPECT_GT(stats.injected, 10);
+  // Controller is forgotten, so the reply to the first status after the
+  // reset is a login and only the next status confirms the controller.
+  EXPECT_GE(stats.recovery_frames, stats.recovered);
+}
+
+TEST_F(FujiAcFaultySerialTest, NoFaultsWithoutProbability) {
+  FujiAcFaultySerial serial(&sim_, FaultOptions());
+  RunFrames(&serial, 100);
+  for (int i = 0; i < kFaultClasses; ++i) {
+    EXPECT_EQ(0, serial.Stats(static_cast<FaultClass>(i)).injected);
+  }
+}
+
+}  // namespace
+}  // namespace sim
+}  // namespace fuji_iot
@@ -0,0 +1,223 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sim/fuji_ac_room_sim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "absl/time/time.h"
+
+namespace fuji_iot {
+namespace sim {
+namespace {
+
+constexpr absl::Duration kDay = absl::Hours(24);
+// Longest step of the model, longer steps are split.
+constexpr absl::Duration kMaxStep = absl::Minutes(1);
+constexpr uint8_t kMinSetpoint = 16;
+constexpr uint8_t kMaxSetpoint = 30;
+
+// Fraction of full power delivered at given fan speed. On AUTO the unit
+// runs faster the further the room is from setpoint.
+double FanFactor(fan_t fan, double error) {
+  switch (fan) {
+    case fan_t::LOW:
+      return 0.45;
+    case fan_t::MEDIUM:
+      return 0.65;
+    case fan_t::HIGH:
+      return 0.85;
+    case fan_t::MAX:
+      return 1.0;
+    default:
+      return std::min(1.0, 0.45 + 0.25 * std::fabs(error));
+  }
+}
+
+// True if t + k * day falls within (from, from + dt] for some k.
+bool Due(absl::Duration t, absl::Duration from, absl::Duration dt) {
+  absl::Duration since = (t - from) - absl::Trunc(t - from, kDay);
+  if (since <= absl::ZeroDuration()) since += kDay;
+  return since <= dt;
+}
+
+}  // namespace
+
+double OutdoorProfile::At(absl::Duration time_of_day) const {
+  double phase = absl::FDivDuration(time_of_day - warmest, kDay);
+  return mean + amplitude * std::cos(2 * M_PI * phase);
+}
+
+ThermalRoomModel::ThermalRoomModel(const ThermalRoomParams &params)
+    : params_(params), temperature_(params.initial_temperature) {}
+
+double ThermalRoomModel::UnitPower(const FujiAcUnitSim &unit) {
+  int direction = 0;
+  double factor = 1;
+  switch (unit.Mode()) {
+    case mode_t::HEAT:
+      direction = 1;
+      break;
+    case mode_t::COOL:
+      direction = -1;
+      break;
+    case mode_t::DRY:
+      direction = -1;
+      factor = 1.0 / 3;
+      break;
+    case mode_t::AUTO:
+      direction = unit.Temperature() > temperature_ ? 1 : -1;
+      break;
+    default:
+      break;
+  }
+  double error = unit.Temperature() - temperature_;
+  // Positive while the room needs what the unit provides in this mode.
+  double demand = direction * error;
+  if (!unit.Enabled() || direction == 0 ||
+      demand <= (compressor_ ? 0 : params_.hysteresis)) {
+    compressor_ = false;
+    return 0;
+  }
+  compressor_ = true;
+  if (unit.Economy()) factor *= 0.7;
+  return direction * factor * FanFactor(unit.Fan(), error) *
+         params_.unit_power_w;
+}
+
+void ThermalRoomModel::Step(const FujiAcUnitSim &unit,
+                            absl::Duration time_of_day, absl::Duration dt) {
+  double loss = params_.loss_w_per_k *
+                (params_.outdoor.At(time_of_day) - temperature_);
+  double joules = (loss + UnitPower(unit)) * absl::ToDoubleSeconds(dt);
+  temperature_ += joules / (params_.capacity_kj_per_k * 1000);
+}
+
+double ThermalRoomModel::RoomTemperature() const { return temperature_; }
+
+bool ThermalRoomModel::CompressorRunning() const { return compressor_; }
+
+Occupant::Occupant(OccupantParams params) : params_(std::move(params)) {}
+
+int Occupant::Act(FujiAcUnitSim *unit, absl::Duration time_of_day,
+                  absl::Duration dt, double room_temperature) {
+  return ApplySchedule(unit, time_of_day, dt) +
+         AdjustSetpoint(unit, time_of_day, dt, room_temperature);
+}
+
+int Occupant::ApplySchedule(FujiAcUnitSim *unit, absl::Duration time_of_day,
+                            absl::Duration dt) {
+  int changes = 0;
+  for (const ScheduleEntry &entry : params_.schedule) {
+    if (!Due(entry.time_of_day, time_of_day, dt)) continue;
+    if (entry.enabled.has_value()) unit->SetEnabled(*entry.enabled);
+    if (entry.mode.has_value()) unit->SetMode(*entry.mode);
+    if (entry.temperature.has_value()) unit->SetTemperature(*entry.temperature);
+    if (entry.fan.has_value()) unit->SetFan(*entry.fan);
+    discomfort_ = absl::ZeroDuration();
+    changes++;
+  }
+  return changes;
+}
+
+int Occupant::AdjustSetpoint(FujiAcUnitSim *unit, absl::Duration time_of_day,
+                             absl::Duration dt, double room_temperature) {
+  bool home = time_of_day >= params_.home_from && time_of_day < params_.home_to;
+  double off = params_.comfort.has_value() ? room_temperature - *params_.comfort
+                                           : 0;
+  if (!home || !unit->Enabled() || unit->Mode() == mode_t::FAN ||
+      std::fabs(off) <= params_.tolerance) {
+    discomfort_ = absl::ZeroDuration();
+    return 0;
+  }
+  discomfort_ += dt;
+  if (discomfort_ < params_.patience) return 0;
+  discomfort_ = absl::ZeroDuration();
+  int setpoint = unit->Temperature() + (off < 0 ? 1 : -1);
+  if (setpoint < kMinSetpoint || setpoint > kMaxSetpoint) return 0;
+  unit->SetTemperature(setpoint);
+  return 1;
+}
+
+FujiAcRoomSim::FujiAcRoomSim(std::unique_ptr<RoomModel> model,
+                             absl::Duration start_time_of_day)
+    : model_(std::move(model)), start_(start_time_of_day) {}
+
+void FujiAcRoomSim::AddOccupant(Occupant occupant) {
+  occupants_.push_back(std::move(occupant));
+}
+
+void FujiAcRoomSim::Step(FujiAcUnitSim *unit, absl::Duration dt) {
+  while (dt > absl::ZeroDuration()) {
+    absl::Duration step = std::min(dt, kMaxStep);
+    absl::Duration time_of_day = TimeOfDay();
+    model_->Step(*unit, time_of_day, step);
+    if (model_->CompressorRunning()) compressor_time_ += step;
+    for (Occupant &occupant : occupants_) {
+      remote_changes_ +=
+          occupant.Act(unit, time_of_day, step, model_->RoomTemperature());
+    }
+    elapsed_ += step;
+    dt -= step;
+  }
+}
+
+absl::Duration FujiAcRoomSim::Elapsed() const { return elapsed_; }
+
+absl::Duration FujiAcRoomSim::TimeOfDay() const {
+  absl::Duration t = start_ + elapsed_;
+  return t - absl::Trunc(t, kDay);
+}
+
+double FujiAcRoomSim::RoomTemperature() const {
+  return model_->RoomTemperature();
+}
+
+uint64_t FujiAcRoomSim::RemoteChanges() const { return remote_changes_; }
+
+double FujiAcRoomSim::DutyCycle() const {
+  if (elapsed_ == absl::ZeroDuration()) return 0;
+  return absl::FDivDuration(compressor_time_, elapsed_);
+}
+
+std::unique_ptr<FujiAcRoomSim> MakeWorkdayRoomSim(
+    const ThermalRoomParams &params) {
+  std::unique_ptr<FujiAcRoomSim> room(new FujiAcRoomSim(
+      std::unique_ptr<RoomModel>(new ThermalRoomModel(params))));
+  OccupantParams early;
+  early.schedule = {
+      {absl::Hours(6) + absl::Minutes(30), true, mode_t::HEAT, 21, fan_t::AUTO},
+      {absl::Hours(8), false, {}, {}, {}},
+      {absl::Hours(17) + absl::Minutes(30), true, {}, 21, {}},
+      {absl::Hours(22) + absl::Minutes(30), {}, {}, 18, {}},
+  };
+  early.comfort = 21;
+  early.home_from = absl::Hours(17) + absl::Minutes(30);
+  early.home_to = absl::Hours(22) + absl::Minutes(30);
+  room->AddOccupant(Occupant(std::move(early)));
+
+  OccupantParams late;
+  late.comfort = 22.5;
+  late.tolerance = 1;
+  late.patience = absl::Minutes(20);
+  late.home_from = absl::Hours(18);
+  late.home_to = absl::Hours(22);
+  room->AddOccupant(Occupant(std::move(late)));
+  return room;
+}
+
+}  // namespace sim
+}  // namespace fuji_iot
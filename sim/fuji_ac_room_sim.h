@@ -0,0 +1,170 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_ROOM_SIM_H_
+#define FUJI_AC_ROOM_SIM_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "protocol/fuji_types.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace sim {
+// Physical model of the room served by the simulated unit. Advanced in
+// simulated time, reads the unit state but never changes it.
+class RoomModel {
+ public:
+  virtual ~RoomModel() = default;
+  // Advances the model by dt, time_of_day is the simulated wall clock at the
+  // start of the step.
+  virtual void Step(const FujiAcUnitSim &unit, absl::Duration time_of_day,
+                    absl::Duration dt) = 0;
+  // Room temperature in degrees Celsius.
+  virtual double RoomTemperature() const = 0;
+  // True if compressor was running during the last step.
+  virtual bool CompressorRunning() const = 0;
+};
+
+// Outdoor temperature following a daily sine.
+struct OutdoorProfile {
+  double mean = 5;
+  double amplitude = 4;
+  // Time of day of the maximum.
+  absl::Duration warmest = absl::Hours(15);
+
+  double At(absl::Duration time_of_day) const;
+};
+
+struct ThermalRoomParams {
+  double initial_temperature = 18;
+  // Heat capacity of air, walls and furniture, in kJ/K.
+  double capacity_kj_per_k = 3000;
+  // Heat lost to outdoors, in W/K.
+  double loss_w_per_k = 50;
+  // Heating or cooling power of the unit with fan at max, in W.
+  double unit_power_w = 3500;
+  // Compressor starts once room drifts this far from setpoint and stops
+  // when setpoint is reached.
+  double hysteresis = 0.5;
+  OutdoorProfile outdoor;
+};
+
+// Single thermal mass losing heat to outdoors through a fixed resistance.
+// Power of the unit depends on mode and fan; economy limits it to 70%. In
+// FAN mode and when the unit is off no heat is exchanged, DRY cools at a
+// third of the power.
+class ThermalRoomModel : public RoomModel {
+ public:
+  explicit ThermalRoomModel(const ThermalRoomParams &params = {});
+  void Step(const FujiAcUnitSim &unit, absl::Duration time_of_day,
+            absl::Duration dt) override;
+  double RoomTemperature() const override;
+  bool CompressorRunning() const override;
+
+ private:
+  // Heat delivered by the unit in W, positive when heating.
+  double UnitPower(const FujiAcUnitSim &unit);
+
+  const ThermalRoomParams params_;
+  double temperature_;
+  bool compressor_ = false;
+};
+
+// Remote change made by an occupant at a fixed time of day. Unset fields are
+// left as they are.
+struct ScheduleEntry {
+  absl::Duration time_of_day;
+  absl::optional<bool> enabled;
+  absl::optional<mode_t> mode;
+  absl::optional<uint8_t> temperature;
+  absl::optional<fan_t> fan;
+};
+
+struct OccupantParams {
+  std::vector<ScheduleEntry> schedule;
+  // Preferred room temperature, setpoint is never adjusted when unset.
+  absl::optional<double> comfort;
+  double tolerance = 1.5;
+  absl::Duration patience = absl::Minutes(30);
+  // Part of the day the occupant is at home and awake, home_from must be
+  // earlier than home_to.
+  absl::Duration home_from = absl::ZeroDuration();
+  absl::Duration home_to = absl::Hours(24);
+};
+
+// Someone using the IR remote. Follows the schedule and, when at home with
+// the unit on, moves the setpoint by one degree once the room stays further
+// than tolerance from comfort for longer than patience.
+class Occupant {
+ public:
+  explicit Occupant(OccupantParams params);
+  // Uses the remote for everything due within dt after time_of_day. dt must
+  // be shorter than a day. Returns the number of changes made.
+  int Act(FujiAcUnitSim *unit, absl::Duration time_of_day, absl::Duration dt,
+          double room_temperature);
+
+ private:
+  int ApplySchedule(FujiAcUnitSim *unit, absl::Duration time_of_day,
+                    absl::Duration dt);
+  int AdjustSetpoint(FujiAcUnitSim *unit, absl::Duration time_of_day,
+                     absl::Duration dt, double room_temperature);
+
+  const OccupantParams params_;
+  // Time spent uncomfortable since the last adjustment.
+  absl::Duration discomfort_;
+};
+
+// Drives the simulated unit through simulated days: advances the room model
+// and lets occupants use the remote. Not thread safe, callers hold whatever
+// protects the unit.
+class FujiAcRoomSim {
+ public:
+  explicit FujiAcRoomSim(std::unique_ptr<RoomModel> model,
+                         absl::Duration start_time_of_day = absl::ZeroDuration());
+  void AddOccupant(Occupant occupant);
+  // Advances simulated time by dt.
+  void Step(FujiAcUnitSim *unit, absl::Duration dt);
+
+  absl::Duration Elapsed() const;
+  absl::Duration TimeOfDay() const;
+  double RoomTemperature() const;
+  // Number of remote changes made by all occupants.
+  uint64_t RemoteChanges() const;
+  // Fraction of elapsed time the compressor was running.
+  double DutyCycle() const;
+
+ private:
+  std::unique_ptr<RoomModel> model_;
+  std::vector<Occupant> occupants_;
+  const absl::Duration start_;
+  absl::Duration elapsed_;
+  absl::Duration compressor_time_;
+  uint64_t remote_changes_ = 0;
+};
+
+// Household out at work during the day: heating to 21 in the morning, off at
+// 8:00, back on at 17:30 and lowered to 18 for the night, with two
+// occupants adjusting the setpoint when it feels off.
+std::unique_ptr<FujiAcRoomSim> MakeWorkdayRoomSim(
+    const ThermalRoomParams &params = {});
+
+}  // namespace sim
+}  // namespace fuji_iot
+
+#endif
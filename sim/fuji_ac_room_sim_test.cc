@@ -0,0 +1,145 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sim/fuji_ac_room_sim.h"
+
+#include <memory>
+
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace sim {
+namespace {
+
+ThermalRoomParams ConstantOutdoor(double temperature) {
+  ThermalRoomParams params;
+  params.outdoor.mean = temperature;
+  params.outdoor.amplitude = 0;
+  return params;
+}
+
+TEST(OutdoorProfileTest, WarmestAtConfiguredTime) {
+  OutdoorProfile outdoor;
+  EXPECT_DOUBLE_EQ(outdoor.mean + outdoor.amplitude,
+                   outdoor.At(outdoor.warmest));
+  EXPECT_DOUBLE_EQ(outdoor.mean - outdoor.amplitude,
+                   outdoor.At(outdoor.warmest - absl::Hours(12)));
+}
+
+TEST(ThermalRoomModelTest, DriftsToOutdoorWhenOff) {
+  FujiAcUnitSim unit;
+  FujiAcRoomSim room(
+      std::unique_ptr<RoomModel>(new ThermalRoomModel(ConstantOutdoor(0))));
+  room.Step(&unit, absl::Hours(6));
+  double after_6h = room.RoomTemperature();
+  EXPECT_LT(after_6h, 18);
+  EXPECT_GT(after_6h, 0);
+  room.Step(&unit, absl::Hours(24 * 7));
+  EXPECT_NEAR(0, room.RoomTemperature(), 0.1);
+  EXPECT_EQ(0, room.DutyCycle());
+}
+
+TEST(ThermalRoomModelTest, HeatingHoldsSetpoint) {
+  FujiAcUnitSim unit;
+  unit.SetEnabled(true);
+  unit.SetMode(mode_t::HEAT);
+  unit.SetTemperature(22);
+  FujiAcRoomSim room(
+      std::unique_ptr<RoomModel>(new ThermalRoomModel(ConstantOutdoor(0))));
+  room.Step(&unit, absl::Hours(2));
+  EXPECT_NEAR(22, room.RoomTemperature(), 0.6);
+  room.Step(&unit, absl::Hours(10));
+  EXPECT_NEAR(22, room.RoomTemperature(), 0.6);
+  // Compressor cycles, running a good part of the time against the loss.
+  EXPECT_GT(room.DutyCycle(), 0.3);
+  EXPECT_LT(room.DutyCycle(), 1);
+}
+
+TEST(ThermalRoomModelTest, FanModeDoesNotHeat) {
+  FujiAcUnitSim unit;
+  unit.SetEnabled(true);
+  unit.SetMode(mode_t::FAN);
+  FujiAcRoomSim room(
+      std::unique_ptr<RoomModel>(new ThermalRoomModel(ConstantOutdoor(35))));
+  room.Step(&unit, absl::Hours(12));
+  EXPECT_GT(room.RoomTemperature(), 26);
+  EXPECT_EQ(0, room.DutyCycle());
+
+  unit.SetMode(mode_t::COOL);
+  unit.SetTemperature(24);
+  room.Step(&unit, absl::Hours(4));
+  EXPECT_NEAR(24, room.RoomTemperature(), 0.6);
+}
+
+TEST(OccupantTest, ScheduleRunsOncePerDay) {
+  FujiAcUnitSim unit;
+  OccupantParams params;
+  params.schedule = {{absl::Minutes(30), true, mode_t::HEAT, 23, {}}};
+  FujiAcRoomSim room(
+      std::unique_ptr<RoomModel>(new ThermalRoomModel(ConstantOutdoor(0))),
+      absl::Hours(23));
+  room.AddOccupant(Occupant(params));
+  room.Step(&unit, absl::Hours(1));
+  EXPECT_FALSE(unit.Enabled());
+  room.Step(&unit, absl::Hours(1));
+  EXPECT_TRUE(unit.Enabled());
+  EXPECT_EQ(mode_t::HEAT, unit.Mode());
+  EXPECT_EQ(23, unit.Temperature());
+  EXPECT_EQ(1, room.RemoteChanges());
+  room.Step(&unit, absl::Hours(48));
+  EXPECT_EQ(3, room.RemoteChanges());
+}
+
+TEST(OccupantTest, AdjustsSetpointWhenUncomfortable) {
+  FujiAcUnitSim unit;
+  unit.SetEnabled(true);
+  unit.SetMode(mode_t::HEAT);
+  unit.SetTemperature(18);
+  OccupantParams params;
+  params.comfort = 22;
+  params.tolerance = 1;
+  params.patience = absl::Minutes(30);
+  FujiAcRoomSim room(
+      std::unique_ptr<RoomModel>(new ThermalRoomModel(ConstantOutdoor(5))));
+  room.AddOccupant(Occupant(params));
+  room.Step(&unit, absl::Minutes(29));
+  EXPECT_EQ(18, unit.Temperature());
+  room.Step(&unit, absl::Minutes(1));
+  EXPECT_EQ(19, unit.Temperature());
+  room.Step(&unit, absl::Hours(12));
+  EXPECT_GE(unit.Temperature(), 21);
+  EXPECT_NEAR(22, room.RoomTemperature(), 1.6);
+}
+
+TEST(FujiAcRoomSimTest, WorkdayChurn) {
+  FujiAcUnitSim unit;
+  std::unique_ptr<FujiAcRoomSim> room = MakeWorkdayRoomSim();
+  room->Step(&unit, absl::Hours(7));
+  EXPECT_TRUE(unit.Enabled());
+  room->Step(&unit, absl::Hours(2));
+  EXPECT_FALSE(unit.Enabled());
+  room->Step(&unit, absl::Hours(11));
+  EXPECT_TRUE(unit.Enabled());
+  EXPECT_GT(room->RoomTemperature(), 19);
+  room->Step(&unit, absl::Hours(4));
+  EXPECT_EQ(18, unit.Temperature());
+  EXPECT_GE(room->RemoteChanges(), 5);
+  EXPECT_GT(room->DutyCycle(), 0);
+}
+
+}  // namespace
+}  // namespace sim
+}  // namespace fuji_iot
@@ -0,0 +1,547 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sim/fuji_ac_scenario.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "controller/fuji_ac_controller.h"
+#include "protocol/fuji_types.h"
+#include "sim/fuji_ac_sim_serial.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace sim {
+namespace {
+
+absl::Status ParseBool(const std::string &value, bool *out) {
+  if (value != "on" && value != "off") {
+    return absl::InvalidArgumentError(
+        absl::StrCat("expected on or off, got ", value));
+  }
+  *out = value == "on";
+  return absl::OkStatus();
+}
+
+absl::Status ParseSetpoint(const std::string &value, int *out) {
+  if (!absl::SimpleAtoi(value, out) || *out < 16 || *out > 30) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("expected setpoint 16-30, got ", value));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ApplyToUnit(const std::string &field, const std::string &value,
+                         FujiAcUnitSim *unit) {
+  absl::Status status;
+  const std::string upper = absl::AsciiStrToUpper(value);
+  if (field == "power" || field == "economy" || field == "swing") {
+    bool on = false;
+    status = ParseBool(value, &on);
+    if (!status.ok()) return status;
+    if (field == "power") unit->SetEnabled(on);
+    if (field == "economy") unit->SetEconomy(on);
+    if (field == "swing") unit->SetSwing(on);
+    return status;
+  }
+  if (field == "mode") {
+    for (mode_t mode : all_mode_t) {
+      if (mode != mode_t::UNKNOWN && ToString(mode) == upper) {
+        unit->SetMode(mode);
+        return status;
+      }
+    }
+    return absl::InvalidArgumentError(absl::StrCat("unknown mode ", value));
+  }
+  if (field == "fan") {
+    for (fan_t fan : all_fan_t) {
+      if (fan != fan_t::UNKNOWN && ToString(fan) == upper) {
+        unit->SetFan(fan);
+        return status;
+      }
+    }
+    return absl::InvalidArgumentError(absl::StrCat("unknown fan ", value));
+  }
+  if (field == "setpoint") {
+    int setpoint;
+    status = ParseSetpoint(value, &setpoint);
+    if (status.ok()) unit->SetTemperature(setpoint);
+    return status;
+  }
+  return absl::InvalidArgumentError(absl::StrCat("unknown unit field ", field));
+}
+
+// Value of field comparable between two units.
+int UnitValue(const std::string &field, const FujiAcUnitSim &unit) {
+  if (field == "power") return unit.Enabled();
+  if (field == "economy") return unit.Economy();
+  if (field == "swing") return unit.Swing();
+  if (field == "mode") return static_cast<int>(unit.Mode());
+  if (field == "fan") return static_cast<int>(unit.Fan());
+  return unit.Temperature();
+}
+
+absl::Status ApplyToState(const std::string &field, const std::string &value,
+                          proto::ACUnitState *state) {
+  const std::string upper = absl::AsciiStrToUpper(value);
+  if (field == "mode") {
+    proto::Mode mode;
+    if (!proto::Mode_Parse("MODE_" + upper, &mode) ||
+        mode == proto::MODE_UNKNOWN) {
+      return absl::InvalidArgumentError(absl::StrCat("unknown mode ", value));
+    }
+    state->set_mode(mode);
+    return absl::OkStatus();
+  }
+  if (field == "fan") {
+    proto::Fan fan;
+    if (!proto::Fan_Parse("FAN_" + upper, &fan) || fan == proto::FAN_UNKNOWN) {
+      return absl::InvalidArgumentError(absl::StrCat("unknown fan ", value));
+    }
+    state->set_fan(fan);
+    return absl::OkStatus();
+  }
+  if (field == "setpoint") {
+    int setpoint;
+    absl::Status status = ParseSetpoint(value, &setpoint);
+    if (status.ok()) state->set_setpoint_temperature(setpoint);
+    return status;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("unknown status field ", field));
+}
+
+int StateValue(const std::string &field, const proto::ACUnitState &state) {
+  if (field == "mode") return state.mode();
+  if (field == "fan") return state.fan();
+  return state.setpoint_temperature();
+}
+
+// Expands "20..25" and "cool,heat".
+absl::Status ParseValues(const std::string &spec,
+                         std::vector<std::string> *values) {
+  std::vector<std::string> range = absl::StrSplit(spec, "..");
+  if (range.size() == 1) {
+    *values = absl::StrSplit(spec, ',', absl::SkipEmpty());
+    return absl::OkStatus();
+  }
+  int from, to;
+  if (range.size() != 2 || !absl::SimpleAtoi(range[0], &from) ||
+      !absl::SimpleAtoi(range[1], &to) || from > to) {
+    return absl::InvalidArgumentError(absl::StrCat("invalid range ", spec));
+  }
+  for (int i = from; i <= to; ++i) values->push_back(absl::StrCat(i));
+  return absl::OkStatus();
+}
+
+absl::Status ParseDuration(const std::string &text, absl::Duration *out) {
+  if (!absl::ParseDuration(text, out) || *out < absl::ZeroDuration()) {
+    return absl::InvalidArgumentError(absl::StrCat("invalid duration ", text));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ParseFault(const std::string &name, FaultClass *fault) {
+  for (int i = 0; i < kFaultClasses; ++i) {
+    if (name == FaultClassName(static_cast<FaultClass>(i))) {
+      *fault = static_cast<FaultClass>(i);
+      return absl::OkStatus();
+    }
+  }
+  return absl::InvalidArgumentError(absl::StrCat("unknown fault ", name));
+}
+
+absl::Status ValidateValues(const ScenarioCommand &command, bool unit) {
+  for (const std::string &value : command.values) {
+    FujiAcUnitSim scratch_unit;
+    proto::ACUnitState scratch_state;
+    absl::Status status =
+        unit ? ApplyToUnit(command.field, value, &scratch_unit)
+             : ApplyToState(command.field, value, &scratch_state);
+    if (!status.ok()) return status;
+  }
+  if (command.values.empty()) {
+    return absl::InvalidArgumentError("missing value");
+  }
+  return absl::OkStatus();
+}
+
+// Parses "count <k> [every <duration>]" of a clients command.
+absl::Status ParseClientRate(const std::vector<std::string> &tokens,
+                             size_t from, ScenarioCommand *command) {
+  if (tokens.size() < from + 2 || tokens[from] != "count" ||
+      !absl::SimpleAtoi(tokens[from + 1], &command->count) ||
+      command->count <= 0) {
+    return absl::InvalidArgumentError("expected count <calls>");
+  }
+  if (tokens.size() == from + 2) return absl::OkStatus();
+  if (tokens.size() != from + 4 || tokens[from + 2] != "every") {
+    return absl::InvalidArgumentError("expected every <duration>");
+  }
+  return ParseDuration(tokens[from + 3], &command->duration);
+}
+
+absl::Status ParseCommand(const std::vector<std::string> &t,
+                          ScenarioCommand *command) {
+  const std::string &verb = t[0];
+  auto expect_size = [&t](size_t size) {
+    return t.size() == size ? absl::OkStatus()
+                            : absl::InvalidArgumentError(absl::StrCat(
+                                  t[0], " takes ", size - 1, " arguments"));
+  };
+  absl::Status status;
+  if (verb == "remote" || verb == "update") {
+    status = expect_size(3);
+    if (!status.ok()) return status;
+    command->kind =
+        verb == "remote" ? ScenarioCommand::REMOTE : ScenarioCommand::UPDATE;
+    command->field = t[1];
+    command->values = {t[2]};
+    return ValidateValues(*command, verb == "remote");
+  }
+  if (verb == "clients") {
+    command->kind = ScenarioCommand::CLIENTS;
+    if (t.size() < 3 || !absl::SimpleAtoi(t[1], &command->clients) ||
+        command->clients <= 0) {
+      return absl::InvalidArgumentError("expected clients <n> <op>");
+    }
+    command->op = t[2];
+    if (command->op == "get_status") return ParseClientRate(t, 3, command);
+    if (command->op != "update" || t.size() < 5) {
+      return absl::InvalidArgumentError(
+          "expected get_status or update <field> <values>");
+    }
+    command->field = t[3];
+    status = ParseValues(t[4], &command->values);
+    if (status.ok()) status = ValidateValues(*command, false);
+    if (status.ok()) status = ParseClientRate(t, 5, command);
+    return status;
+  }
+  if (verb == "join") {
+    command->kind = ScenarioCommand::JOIN;
+    return expect_size(1);
+  }
+  if (verb == "sleep" || verb == "at") {
+    command->kind =
+        verb == "sleep" ? ScenarioCommand::SLEEP : ScenarioCommand::AT;
+    status = expect_size(2);
+    if (status.ok()) status = ParseDuration(t[1], &command->duration);
+    return status;
+  }
+  if (verb == "fault") {
+    command->kind = ScenarioCommand::FAULT;
+    status = expect_size(2);
+    if (status.ok()) status = ParseFault(t[1], &command->fault);
+    return status;
+  }
+  if (verb == "expect") {
+    if (t.size() != 4 && !(t.size() == 6 && t[4] == "within")) {
+      return absl::InvalidArgumentError(
+          "expected expect unit|status <field> <value> [within <duration>]");
+    }
+    if (t[1] != "unit" && t[1] != "status") {
+      return absl::InvalidArgumentError("expect takes unit or status");
+    }
+    command->kind = t[1] == "unit" ? ScenarioCommand::EXPECT_UNIT
+                                   : ScenarioCommand::EXPECT_STATUS;
+    command->field = t[2];
+    command->values = {t[3]};
+    status = ValidateValues(*command, t[1] == "unit");
+    if (status.ok() && t.size() == 6) {
+      status = ParseDuration(t[5], &command->duration);
+    }
+    return status;
+  }
+  return absl::InvalidArgumentError(absl::StrCat("unknown command ", verb));
+}
+
+absl::Status ParseLine(const std::vector<std::string> &t, int line,
+                       Scenario *scenario) {
+  if (t[0] == "frame_interval" || t[0] == "seed") {
+    if (!scenario->phases.empty()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat(t[0], " must precede the first phase"));
+    }
+    if (t.size() != 2) {
+      return absl::InvalidArgumentError(absl::StrCat(t[0], " takes 1 argument"));
+    }
+    if (t[0] == "seed") {
+      return absl::SimpleAtoi(t[1], &scenario->seed)
+                 ? absl::OkStatus()
+                 : absl::InvalidArgumentError(absl::StrCat("invalid seed ", t[1]));
+    }
+    return ParseDuration(t[1], &scenario->frame_interval);
+  }
+  if (t[0] == "phase") {
+    if (t.size() != 2) return absl::InvalidArgumentError("phase takes a name");
+    scenario->phases.push_back(ScenarioPhase{t[1], {}});
+    return absl::OkStatus();
+  }
+  if (scenario->phases.empty()) {
+    return absl::InvalidArgumentError("command outside of a phase");
+  }
+  ScenarioCommand command;
+  command.line = line;
+  absl::Status status = ParseCommand(t, &command);
+  if (status.ok()) scenario->phases.back().commands.push_back(command);
+  return status;
+}
+
+// Runs a scenario, owning the simulated unit, faulty bus and controller.
+class ScenarioRunner {
+ public:
+  explicit ScenarioRunner(const Scenario &scenario)
+      : scenario_(scenario),
+        sim_(scenario.frame_interval),
+        serial_(&sim_, FaultsOptions(scenario)) {
+    controller_ = FujiAcController::MakeFujiAcController(&serial_);
+    controller_->GetStatus();
+  }
+
+  ~ScenarioRunner() {
+    JoinClients();
+    controller_->Shutdown();
+  }
+
+  ScenarioResult Run() {
+    bool faults = false;
+    for (const ScenarioPhase &phase : scenario_.phases) {
+      absl::Time start = absl::Now();
+      for (const ScenarioCommand &command : phase.commands) {
+        RunCommand(command, start);
+        faults |= command.kind == ScenarioCommand::FAULT;
+      }
+      JoinClients();
+      result_.phases.push_back(PhaseStats(phase.name, absl::Now() - start));
+    }
+    if (faults) result_.faults = serial_.Report();
+    return result_;
+  }
+
+ private:
+  static FaultOptions FaultsOptions(const Scenario &scenario) {
+    FaultOptions options;
+    options.seed = scenario.seed;
+    return options;
+  }
+
+  void RunCommand(const ScenarioCommand &command, absl::Time phase_start) {
+    switch (command.kind) {
+      case ScenarioCommand::REMOTE:
+        sim_.WithSim([&command](FujiAcUnitSim *unit) {
+          ApplyToUnit(command.field, command.values[0], unit).IgnoreError();
+        });
+        break;
+      case ScenarioCommand::UPDATE:
+        CallUpdate(command.field, command.values[0]);
+        break;
+      case ScenarioCommand::CLIENTS:
+        for (int c = 0; c < command.clients; ++c) {
+          clients_.emplace_back([this, &command, c]() { RunClient(command, c); });
+        }
+        break;
+      case ScenarioCommand::JOIN:
+        JoinClients();
+        break;
+      case ScenarioCommand::SLEEP:
+        absl::SleepFor(command.duration);
+        break;
+      case ScenarioCommand::AT:
+        absl::SleepFor(phase_start + command.duration - absl::Now());
+        break;
+      case ScenarioCommand::FAULT:
+        serial_.InjectNext(command.fault);
+        break;
+      case ScenarioCommand::EXPECT_UNIT:
+      case ScenarioCommand::EXPECT_STATUS:
+        Expect(command);
+        break;
+    }
+  }
+
+  void RunClient(const ScenarioCommand &command, int client) {
+    for (int i = 0; i < command.count; ++i) {
+      if (i > 0) absl::SleepFor(command.duration);
+      if (command.op == "get_status") {
+        absl::Time start = absl::Now();
+        controller_->GetSharedStatus();
+        Record("get_status", absl::Now() - start, true);
+      } else {
+        const std::vector<std::string> &values = command.values;
+        CallUpdate(command.field, values[(client + i) % values.size()]);
+      }
+    }
+  }
+
+  void CallUpdate(const std::string &field, const std::string &value) {
+    proto::ACUnitState state;
+    ApplyToState(field, value, &state).IgnoreError();
+    absl::Time start = absl::Now();
+    absl::Status status = controller_->Update(state);
+    Record("update", absl::Now() - start, status.ok());
+  }
+
+  void Expect(const ScenarioCommand &command) {
+    const bool unit = command.kind == ScenarioCommand::EXPECT_UNIT;
+    int expected, actual;
+    if (unit) {
+      FujiAcUnitSim scratch;
+      ApplyToUnit(command.field, command.values[0], &scratch).IgnoreError();
+      expected = UnitValue(command.field, scratch);
+    } else {
+      proto::ACUnitState scratch;
+      ApplyToState(command.field, command.values[0], &scratch).IgnoreError();
+      expected = StateValue(command.field, scratch);
+    }
+    absl::Time deadline = absl::Now() + command.duration;
+    while (true) {
+      if (unit) {
+        sim_.WithSim([&](FujiAcUnitSim *sim) {
+          actual = UnitValue(command.field, *sim);
+        });
+      } else {
+        actual = StateValue(command.field, controller_->GetStatus());
+      }
+      if (actual == expected) return;
+      if (absl::Now() >= deadline) break;
+      absl::SleepFor(scenario_.frame_interval);
+    }
+    result_.failures.push_back(absl::StrFormat(
+        "line %d: expected %s %s %s, got %d", command.line,
+        unit ? "unit" : "status", command.field, command.values[0], actual));
+  }
+
+  void JoinClients() {
+    for (std::thread &client : clients_) client.join();
+    clients_.clear();
+  }
+
+  void Record(const std::string &op, absl::Duration latency, bool ok) {
+    absl::MutexLock l(&mu_);
+    latencies_[op].push_back(latency);
+    if (!ok) errors_[op]++;
+  }
+
+  PhaseResult PhaseStats(const std::string &name, absl::Duration duration) {
+    PhaseResult phase{name, duration, {}};
+    absl::MutexLock l(&mu_);
+    for (auto &op : latencies_) {
+      std::vector<absl::Duration> &samples = op.second;
+      std::sort(samples.begin(), samples.end());
+      OpStats &stats = phase.ops[op.first];
+      stats.count = samples.size();
+      stats.errors = errors_[op.first];
+      stats.p50 = samples[(samples.size() - 1) / 2];
+      stats.p99 = samples[(samples.size() - 1) * 99 / 100];
+      stats.max = samples.back();
+      stats.rate = stats.count / absl::ToDoubleSeconds(duration);
+    }
+    latencies_.clear();
+    errors_.clear();
+    return phase;
+  }
+
+  const Scenario &scenario_;
+  FujiAcSimSerial sim_;
+  FujiAcFaultySerial serial_;
+  std::unique_ptr<FujiAcController> controller_;
+  std::vector<std::thread> clients_;
+  ScenarioResult result_;
+
+  absl::Mutex mu_;
+  std::map<std::string, std::vector<absl::Duration>> latencies_
+      ABSL_GUARDED_BY(mu_);
+  std::map<std::string, uint64_t> errors_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+absl::Status ParseScenario(absl::string_view text, Scenario *scenario) {
+  *scenario = Scenario();
+  int line = 0;
+  for (absl::string_view content : absl::StrSplit(text, '\n')) {
+    line++;
+    content = content.substr(0, content.find('#'));
+    std::vector<std::string> tokens =
+        absl::StrSplit(content, absl::ByAnyChar(" \t\r"), absl::SkipEmpty());
+    if (tokens.empty()) continue;
+    absl::Status status = ParseLine(tokens, line, scenario);
+    if (!status.ok()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("line ", line, ": ", status.message()));
+    }
+  }
+  if (scenario->phases.empty()) {
+    return absl::InvalidArgumentError("scenario has no phases");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LoadScenario(const std::string &path, Scenario *scenario) {
+  std::ifstream file(path);
+  if (!file) return absl::NotFoundError(absl::StrCat("cannot open ", path));
+  std::stringstream text;
+  text << file.rdbuf();
+  absl::Status status = ParseScenario(text.str(), scenario);
+  if (!status.ok()) {
+    return absl::Status(status.code(),
+                        absl::StrCat(path, ": ", status.message()));
+  }
+  return status;
+}
+
+std::string ScenarioResult::Report() const {
+  std::string report =
+      absl::StrFormat("%-12s %-10s %8s %6s %9s %9s %9s %9s\n", "phase", "op",
+                      "calls", "errors", "rate/s", "p50_ms", "p99_ms",
+                      "max_ms");
+  for (const PhaseResult &phase : phases) {
+    if (phase.ops.empty()) {
+      absl::StrAppendFormat(&report, "%-12s -\n", phase.name);
+    }
+    for (const auto &op : phase.ops) {
+      const OpStats &stats = op.second;
+      absl::StrAppendFormat(
+          &report, "%-12s %-10s %8d %6d %9.1f %9.2f %9.2f %9.2f\n", phase.name,
+          op.first, stats.count, stats.errors, stats.rate,
+          absl::ToDoubleMilliseconds(stats.p50),
+          absl::ToDoubleMilliseconds(stats.p99),
+          absl::ToDoubleMilliseconds(stats.max));
+    }
+  }
+  if (!faults.empty()) absl::StrAppend(&report, "\n", faults);
+  for (const std::string &failure : failures) {
+    absl::StrAppend(&report, "FAILED ", failure, "\n");
+  }
+  return report;
+}
+
+ScenarioResult RunScenario(const Scenario &scenario) {
+  ScenarioRunner runner(scenario);
+  return runner.Run();
+}
+
+}  // namespace sim
+}  // namespace fuji_iot
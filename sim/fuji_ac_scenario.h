@@ -0,0 +1,131 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_SCENARIO_H_
+#define FUJI_AC_SCENARIO_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "sim/fuji_ac_faulty_serial.h"
+
+namespace fuji_iot {
+namespace sim {
+// Workload for the daemon running against the simulated unit, written as a
+// text file. One command per line, '#' starts a comment:
+//
+//   frame_interval 5ms        master frame interval, before the first phase
+//   seed 7                    seed of injected faults, before the first phase
+//   phase <name>              starts a phase, phases run one after another
+//   remote <field> <value>    IR remote change on the unit
+//   update <field> <value>    single Update from the runner
+//   clients <n> get_status count <k> [every <duration>]
+//   clients <n> update <field> <values> count <k> [every <duration>]
+//                             n concurrent clients issuing k calls each
+//   join                      waits for all clients started in the phase
+//   sleep <duration>
+//   at <duration>             waits until given time since phase start
+//   fault <class>             injects a fault (see FaultClassName)
+//   expect unit <field> <value> [within <duration>]
+//   expect status <field> <value> [within <duration>]
+//
+// Unit fields are power (on/off), mode, fan, setpoint, economy and swing;
+// status and update fields are mode (including off), fan and setpoint.
+// Client values are a list ("cool,heat") or a range ("20..25"), client c
+// uses value (c + i) % size in its i-th call. Phases end by joining their
+// clients.
+struct ScenarioCommand {
+  enum Kind {
+    REMOTE,
+    UPDATE,
+    CLIENTS,
+    JOIN,
+    SLEEP,
+    AT,
+    FAULT,
+    EXPECT_UNIT,
+    EXPECT_STATUS,
+  };
+  Kind kind;
+  // Line of the scenario file, for reporting.
+  int line = 0;
+  std::string field;
+  std::vector<std::string> values;
+  // Operation of CLIENTS, get_status or update.
+  std::string op;
+  int clients = 0;
+  int count = 0;
+  // Pause between calls of a client, time of SLEEP and AT, and how long an
+  // expectation may take to come true.
+  absl::Duration duration;
+  FaultClass fault = FaultClass::BIT_FLIP;
+};
+
+struct ScenarioPhase {
+  std::string name;
+  std::vector<ScenarioCommand> commands;
+};
+
+struct Scenario {
+  absl::Duration frame_interval = absl::Milliseconds(5);
+  uint32_t seed = 1;
+  std::vector<ScenarioPhase> phases;
+};
+
+// Parses scenario text, errors name the offending line.
+absl::Status ParseScenario(absl::string_view text, Scenario *scenario);
+absl::Status LoadScenario(const std::string &path, Scenario *scenario);
+
+// Latency of one kind of call within a phase.
+struct OpStats {
+  uint64_t count = 0;
+  uint64_t errors = 0;
+  absl::Duration p50;
+  absl::Duration p99;
+  absl::Duration max;
+  // Calls per second of the phase.
+  double rate = 0;
+};
+
+struct PhaseResult {
+  std::string name;
+  absl::Duration duration;
+  // Keyed by get_status and update.
+  std::map<std::string, OpStats> ops;
+};
+
+struct ScenarioResult {
+  std::vector<PhaseResult> phases;
+  // Expectations that did not come true.
+  std::vector<std::string> failures;
+  // Recovery table of injected faults, see FujiAcFaultySerial::Report.
+  std::string faults;
+
+  bool ok() const { return failures.empty(); }
+  // Per phase table of calls, rates and latencies, followed by failures.
+  std::string Report() const;
+};
+
+// Runs scenario against a fresh simulated unit and controller.
+ScenarioResult RunScenario(const Scenario &scenario);
+
+}  // namespace sim
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,52 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sim/fuji_ac_sim_serial.h"
+
+#include <utility>
+
+#include "absl/time/clock.h"
+
+namespace fuji_iot {
+namespace sim {
+
+FujiAcSimSerial::FujiAcSimSerial(absl::Duration frame_interval)
+    : frame_interval_(frame_interval) {}
+
+void FujiAcSimSerial::WriteControllerFrame(const FujiControllerFrame &frame) {
+  absl::MutexLock l(&mu_);
+  sim_.PushControllerFrame(frame);
+}
+
+absl::optional<FujiMasterFrame> FujiAcSimSerial::ReadMasterFrame() {
+  absl::SleepFor(frame_interval_);
+  absl::MutexLock l(&mu_);
+  if (room_ != nullptr) room_->Step(&sim_, room_step_);
+  return sim_.GetNextMasterFrame();
+}
+
+void FujiAcSimSerial::WithSim(absl::FunctionRef<void(FujiAcUnitSim *)> fn) {
+  absl::MutexLock l(&mu_);
+  fn(&sim_);
+}
+
+void FujiAcSimSerial::AttachRoom(std::unique_ptr<FujiAcRoomSim> room,
+                                 absl::Duration room_step) {
+  absl::MutexLock l(&mu_);
+  room_ = std::move(room);
+  room_step_ = room_step;
+}
+
+}  // namespace sim
+}  // namespace fuji_iot
@@ -0,0 +1,54 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_SIM_SERIAL_H_
+#define FUJI_AC_SIM_SERIAL_H_
+
+#include <memory>
+
+#include "absl/functional/function_ref.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "controller/fuji_ac_serial_interface.h"
+#include "sim/fuji_ac_room_sim.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace sim {
+// Serial interface connected directly to a simulated AC unit, delivering one
+// master frame every frame_interval.
+class FujiAcSimSerial : public FujiAcSerialInterface {
+ public:
+  explicit FujiAcSimSerial(absl::Duration frame_interval = absl::Seconds(1));
+  virtual void WriteControllerFrame(const FujiControllerFrame &frame) override;
+  virtual absl::optional<FujiMasterFrame> ReadMasterFrame() override;
+  // Runs fn with exclusive access to the simulated unit.
+  void WithSim(absl::FunctionRef<void(FujiAcUnitSim *)> fn);
+  // Advances room by room_step of simulated time with every master frame,
+  // so that its occupants change the unit state as with the IR remote.
+  void AttachRoom(std::unique_ptr<FujiAcRoomSim> room,
+                  absl::Duration room_step);
+
+ private:
+  const absl::Duration frame_interval_;
+  absl::Mutex mu_;
+  FujiAcUnitSim sim_ ABSL_GUARDED_BY(mu_);
+  std::unique_ptr<FujiAcRoomSim> room_ ABSL_GUARDED_BY(mu_);
+  absl::Duration room_step_ ABSL_GUARDED_BY(mu_);
+};
+}  // namespace sim
+}  // namespace fuji_iot
+
+#endif
@@ -0,0 +1,170 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sim/fuji_ac_tcp_bridge_sim.h"
+
+#include <arpa/inet.h>
+#include <glog/logging.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+
+#include "absl/time/clock.h"
+#include "protocol/fuji_frame.h"
+
+namespace fuji_iot {
+namespace sim {
+namespace {
+
+// How often blocked calls check for shutdown.
+constexpr int kPollIntervalMs = 50;
+
+}  // namespace
+
+FujiAcTcpBridgeSim::FujiAcTcpBridgeSim(int port) {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    PLOG(FATAL) << "Failed to create socket";
+  }
+  int one = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) <
+          0 ||
+      listen(listen_fd_, 1) < 0) {
+    PLOG(FATAL) << "Failed to listen on port " << port;
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len);
+  port_ = ntohs(addr.sin_port);
+  thread_ = std::unique_ptr<std::thread>(
+      new std::thread(&FujiAcTcpBridgeSim::Loop, this));
+}
+
+FujiAcTcpBridgeSim::~FujiAcTcpBridgeSim() {
+  shutdown_ = true;
+  thread_->join();
+  close(listen_fd_);
+}
+
+int FujiAcTcpBridgeSim::Port() const { return port_; }
+
+void FujiAcTcpBridgeSim::WithSim(
+    absl::FunctionRef<void(FujiAcUnitSim *)> fn) {
+  absl::MutexLock l(&mu_);
+  fn(&sim_);
+}
+
+void FujiAcTcpBridgeSim::DropConnection() { drop_ = true; }
+
+void FujiAcTcpBridgeSim::InjectPartialFrame(size_t bytes,
+                                            absl::Duration silence) {
+  absl::MutexLock l(&mu_);
+  partial_bytes_ = bytes;
+  partial_silence_ = silence;
+}
+
+void FujiAcTcpBridgeSim::SetByteDelay(absl::Duration delay) {
+  absl::MutexLock l(&mu_);
+  byte_delay_ = delay;
+}
+
+void FujiAcTcpBridgeSim::SetReplyTimeout(absl::Duration timeout) {
+  absl::MutexLock l(&mu_);
+  reply_timeout_ = timeout;
+}
+
+void FujiAcTcpBridgeSim::Loop() {
+  while (!shutdown_) {
+    pollfd pfd = {listen_fd_, POLLIN, 0};
+    if (poll(&pfd, 1, kPollIntervalMs) <= 0) continue;
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      PLOG(ERROR) << "Failed to accept connection";
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    drop_ = false;
+    while (!shutdown_ && !drop_ && Cycle(fd)) {
+    }
+    close(fd);
+  }
+}
+
+bool FujiAcTcpBridgeSim::Cycle(int fd) {
+  std::array<uint8_t, 8> data;
+  size_t partial_bytes;
+  absl::Duration partial_silence, byte_delay, reply_timeout;
+  {
+    absl::MutexLock l(&mu_);
+    data = sim_.GetNextMasterFrame().FullFrame();
+    partial_bytes = partial_bytes_;
+    partial_silence = partial_silence_;
+    byte_delay = byte_delay_;
+    reply_timeout = reply_timeout_;
+    partial_bytes_ = 0;
+  }
+  for (int i = 0; i < 8; i++) {
+    data[i] ^= 0xFF;
+  }
+  if (partial_bytes > 0) {
+    if (send(fd, data.data(), partial_bytes, MSG_NOSIGNAL) < 0) return false;
+    absl::SleepFor(partial_silence);
+  }
+  if (byte_delay == absl::ZeroDuration()) {
+    if (send(fd, data.data(), data.size(), MSG_NOSIGNAL) < 0) return false;
+  } else {
+    for (size_t i = 0; i < data.size(); i++) {
+      if (send(fd, data.data() + i, 1, MSG_NOSIGNAL) < 0) return false;
+      absl::SleepFor(byte_delay);
+    }
+  }
+
+  std::array<uint8_t, 8> reply;
+  size_t received = 0;
+  absl::Time deadline = absl::Now() + reply_timeout;
+  while (received < reply.size()) {
+    absl::Duration left = deadline - absl::Now();
+    if (left <= absl::ZeroDuration()) break;
+    pollfd pfd = {fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, absl::ToInt64Milliseconds(left) + 1);
+    if (ready <= 0) continue;
+    ssize_t n = recv(fd, reply.data() + received, reply.size() - received, 0);
+    if (n <= 0) return false;
+    received += n;
+  }
+  if (received == reply.size()) {
+    for (int i = 0; i < 8; i++) {
+      reply[i] ^= 0xFF;
+    }
+    absl::MutexLock l(&mu_);
+    sim_.PushControllerFrame(FujiControllerFrame(reply));
+  } else if (received > 0) {
+    LOG(WARNING) << "Dropping incomplete reply: " << received;
+  }
+  return true;
+}
+
+}  // namespace sim
+}  // namespace fuji_iot
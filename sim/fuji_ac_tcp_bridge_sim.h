@@ -0,0 +1,72 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FUJI_AC_TCP_BRIDGE_SIM_H_
+#define FUJI_AC_TCP_BRIDGE_SIM_H_
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "absl/functional/function_ref.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace sim {
+// Stand-in for a raw TCP serial bridge (ser2net style) with simulated AC unit
+// on the other end of the wire. Accepts one client at a time on loopback and
+// plays the master role: sends master frame, waits for the reply and passes
+// it to the simulated unit.
+class FujiAcTcpBridgeSim {
+ public:
+  // Port 0 picks any free port, see Port().
+  explicit FujiAcTcpBridgeSim(int port = 0);
+  ~FujiAcTcpBridgeSim();
+  int Port() const;
+
+  // Runs fn with exclusive access to the simulated unit.
+  void WithSim(absl::FunctionRef<void(FujiAcUnitSim *)> fn);
+  // Closes the current client connection, next client is accepted afterwards.
+  void DropConnection();
+  // Precedes the next master frame with first bytes of a frame followed by
+  // silence, as if the line glitched.
+  void InjectPartialFrame(size_t bytes, absl::Duration silence);
+  // Delay between bytes of master frame, zero sends the frame in one write.
+  void SetByteDelay(absl::Duration delay);
+  // How long the bridge waits for a reply after every master frame.
+  void SetReplyTimeout(absl::Duration timeout);
+
+ private:
+  void Loop();
+  // Runs one master frame / reply cycle, returns false if client went away.
+  bool Cycle(int fd);
+
+  int listen_fd_;
+  int port_;
+  std::atomic<bool> shutdown_{false};
+  std::atomic<bool> drop_{false};
+  absl::Mutex mu_;
+  FujiAcUnitSim sim_ ABSL_GUARDED_BY(mu_);
+  size_t partial_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+  absl::Duration partial_silence_ ABSL_GUARDED_BY(mu_);
+  absl::Duration byte_delay_ ABSL_GUARDED_BY(mu_);
+  absl::Duration reply_timeout_ ABSL_GUARDED_BY(mu_) = absl::Milliseconds(100);
+  std::unique_ptr<std::thread> thread_;
+};
+}  // namespace sim
+}  // namespace fuji_iot
+
+#endif
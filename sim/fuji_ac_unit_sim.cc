@@ -70,6 +70,10 @@ void FujiAcUnitSim::PushControllerFrame(const FujiControllerFrame &frame) {
   if (frame.LoginBit()) {
     status_->SetControllerPresent(true);
   }
+  ApplyControllerWrite(frame);
+}
+
+void FujiAcUnitSim::ApplyControllerWrite(const FujiControllerFrame &frame) {
   if (frame.QueryRegister() == RegisterType::STATUS && frame.WriteBit()) {
     std::array<uint8_t, 5> payload = frame.Payload();
     FujiStatusRegister status(payload.data());
@@ -90,6 +94,10 @@ void FujiAcUnitSim::PushControllerFrame(const FujiControllerFrame &frame) {
   }
 }
 
+std::array<uint8_t, 5> FujiAcUnitSim::StatusPayload() const {
+  return FujiMasterFrame(status_register_).Payload();
+}
+
 void FujiAcUnitSim::Update() { status_->SetUpdateMagic(4); }
 
 bool FujiAcUnitSim::Enabled() const { return status_->Enabled(); }
@@ -145,6 +153,11 @@ bool FujiAcUnitSim::ControllerPresent() const {
   return status_->ControllerPresent();
 }
 
+void FujiAcUnitSim::Restart() {
+  status_->SetControllerPresent(false);
+  next_query_register_ = RegisterType::STATUS;
+}
+
 }  // namespace sim
 
 }  // namespace fuji_iot
\ No newline at end of file
@@ -33,6 +33,11 @@ class FujiAcUnitSim {
   FujiAcUnitSim();
   const FujiMasterFrame GetNextMasterFrame();
   void PushControllerFrame(const FujiControllerFrame &frame);
+  // Applies status written by a controller frame without touching the query
+  // sequence, so that frames of several controllers can be applied.
+  void ApplyControllerWrite(const FujiControllerFrame &frame);
+  // Payload of the status register as sent to any controller.
+  std::array<uint8_t, 5> StatusPayload() const;
 
   // Methods below are intended to real AC unit side state of the universe.
   // Changing values is simulated as if IR controller was used.
@@ -51,6 +56,9 @@ class FujiAcUnitSim {
   bool SwingStep() const;
   void SetSwingStep(bool swing);
   bool ControllerPresent() const;
+  // Simulates power cycle of the main unit: logged in controllers are
+  // forgotten, settings are kept.
+  void Restart();
 
  protected:
   FRIEND_TEST(FujiAcUnitSimTest, TestReconnect);
@@ -0,0 +1,195 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Verifies that the bus thread does not touch the heap in steady state: every
+// master frame -> reply cycle through serial interface, protocol handler,
+// state and controller bookkeeping. Allocations are counted on the bus thread
+// by the shared allocator hooks, which see malloc, the aligned allocators and
+// so every form of operator new. Heap churn over months of uptime fragments
+// memory of a small board and adds latency to replies.
+
+#include <poll.h>
+#include <pty.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "controller/fuji_ac_controller.h"
+#include "controller/fuji_ac_malloc_hooks.h"
+#include "controller/fuji_ac_serial_interface.h"
+#include "controller/fuji_ac_serial_reader.h"
+#include "gtest/gtest.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace tests {
+namespace {
+
+// Cycles run before counting starts: login, first status and anything that
+// is set up once.
+constexpr int kWarmupCycles = 20;
+
+// Serial interface backed directly by a simulated unit.
+class SimSerial : public FujiAcSerialInterface {
+ public:
+  void WriteControllerFrame(const FujiControllerFrame &frame) override {
+    sim_.PushControllerFrame(frame);
+  }
+  absl::optional<FujiMasterFrame> ReadMasterFrame() override {
+    return sim_.GetNextMasterFrame();
+  }
+
+ private:
+  sim::FujiAcUnitSim sim_;
+};
+
+// Counts allocations of the thread using it for the given number of cycles
+// after warm-up. A cycle spans from one read to the next, so it covers the
+// reply and all bookkeeping of the controller.
+class CountingSerial : public FujiAcSerialInterface {
+ public:
+  CountingSerial(FujiAcSerialInterface *serial, int cycles)
+      : serial_(serial), cycles_(cycles) {}
+
+  void WriteControllerFrame(const FujiControllerFrame &frame) override {
+    serial_->WriteControllerFrame(frame);
+  }
+
+  absl::optional<FujiMasterFrame> ReadMasterFrame() override {
+    if (frames_ == kWarmupCycles) start_ = ThreadAllocations();
+    if (frames_ == kWarmupCycles + cycles_ && !done_.HasBeenNotified()) {
+      allocations_ = ThreadAllocations() - start_;
+      done_.Notify();
+    }
+    absl::optional<FujiMasterFrame> frame = serial_->ReadMasterFrame();
+    if (frame.has_value()) frames_++;
+    return frame;
+  }
+
+  // Returns allocations made during the counted cycles.
+  uint64_t WaitForCycles() {
+    done_.WaitForNotification();
+    return allocations_;
+  }
+
+ private:
+  FujiAcSerialInterface *const serial_;
+  const int cycles_;
+  int frames_ = 0;
+  uint64_t start_ = 0;
+  uint64_t allocations_ = 0;
+  absl::Notification done_;
+};
+
+// Plays a simulated main unit on the far end of a pseudo terminal.
+class PtyMainUnit {
+ public:
+  PtyMainUnit() {
+    if (openpty(&master_, &slave_, name_, nullptr, nullptr) < 0) {
+      master_ = -1;
+      return;
+    }
+    thread_ = std::thread([this]() { Run(); });
+  }
+
+  ~PtyMainUnit() {
+    stop_ = true;
+    if (thread_.joinable()) thread_.join();
+    if (master_ >= 0) {
+      close(slave_);
+      close(master_);
+    }
+  }
+
+  bool ok() const { return master_ >= 0; }
+  const char *name() const { return name_; }
+
+ private:
+  void Run() {
+    while (!stop_) {
+      std::array<uint8_t, 8> data = sim_.GetNextMasterFrame().FullFrame();
+      for (uint8_t &b : data) b ^= 0xFF;
+      if (write(master_, data.data(), data.size()) != 8) return;
+      if (ReadReply(&data)) {
+        for (uint8_t &b : data) b ^= 0xFF;
+        sim_.PushControllerFrame(FujiControllerFrame(data));
+      }
+    }
+  }
+
+  bool ReadReply(std::array<uint8_t, 8> *data) {
+    size_t received = 0;
+    while (received < data->size()) {
+      pollfd pfd = {master_, POLLIN, 0};
+      if (poll(&pfd, 1, 1000) <= 0) return false;
+      ssize_t n = read(master_, data->data() + received,
+                       data->size() - received);
+      if (n <= 0) return false;
+      received += n;
+    }
+    return true;
+  }
+
+  int master_;
+  int slave_;
+  char name_[64];
+  std::atomic<bool> stop_{false};
+  sim::FujiAcUnitSim sim_;
+  std::thread thread_;
+};
+
+class AllocationTest : public testing::Test {
+ protected:
+  void SetUp() override {
+#ifndef __GLIBC__
+    GTEST_SKIP() << "Allocation counting needs glibc";
+#endif
+  }
+
+  // Runs controller over serial until the counted cycles are done, returns
+  // allocations of the bus thread during them.
+  uint64_t RunCycles(FujiAcSerialInterface *serial, int cycles) {
+    CountingSerial counting_serial(serial, cycles);
+    auto controller = FujiAcController::MakeFujiAcController(&counting_serial);
+    uint64_t allocations = counting_serial.WaitForCycles();
+    controller->Shutdown();
+    return allocations;
+  }
+};
+
+TEST_F(AllocationTest, SteadyStateCycleDoesNotAllocate) {
+  SimSerial serial;
+  EXPECT_EQ(0, RunCycles(&serial, 10000));
+}
+
+// Same through the tty reader and writer. The reader paces itself with a
+// 30ms pause after every frame, so fewer cycles are run.
+TEST_F(AllocationTest, TtyCycleDoesNotAllocate) {
+  PtyMainUnit main_unit;
+  ASSERT_TRUE(main_unit.ok());
+  auto reader = FujiAcSerialReader::Build(main_unit.name(),
+                                          FujiEchoSuppressor::Mode::OFF);
+  EXPECT_EQ(0, RunCycles(reader.get(), 100));
+}
+
+}  // namespace
+}  // namespace tests
+}  // namespace fuji_iot
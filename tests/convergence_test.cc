@@ -0,0 +1,298 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Bus cycles the daemon needs to apply an update, for every transition of
+// mode, power, fan and setpoint. The bus is stepped one master frame at a
+// time, so counts are exact and do not depend on the host. Budgets below are
+// the current counts: a change making updates slower fails here, raise a
+// budget only knowingly.
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "controller/fuji_ac_bus_budget.h"
+#include "controller/fuji_ac_controller.h"
+#include "controller/fuji_ac_serial_interface.h"
+#include "gtest/gtest.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace tests {
+
+// Cycles after which an update counts as never converging.
+constexpr int kMaxCycles = 50;
+
+// Serial interface handing master frames of the simulated unit to the
+// controller one at a time, as the test steps the bus. Also serves as the
+// virtual clock: every frame on the bus takes kFrameAirtime.
+class SteppedBus : public FujiAcSerialInterface {
+ public:
+  void WriteControllerFrame(const FujiControllerFrame &frame) override {
+    absl::MutexLock l(&mu_);
+    writes_++;
+    sim_.PushControllerFrame(frame);
+  }
+
+  absl::optional<FujiMasterFrame> ReadMasterFrame() override {
+    absl::MutexLock l(&mu_);
+    waiting_ = true;
+    auto granted = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return running_ || granted_ > reads_;
+    };
+    mu_.Await(absl::Condition(&granted));
+    waiting_ = false;
+    reads_++;
+    return sim_.GetNextMasterFrame();
+  }
+
+  // Lets frames through freely.
+  void Run() {
+    absl::MutexLock l(&mu_);
+    running_ = true;
+  }
+
+  // Holds the bus before the next master frame.
+  void Stop() {
+    absl::MutexLock l(&mu_);
+    running_ = false;
+    granted_ = reads_;
+    mu_.Await(absl::Condition(&waiting_));
+  }
+
+  // Delivers one master frame and waits until the controller handled it and
+  // asks for the next one.
+  void Step() {
+    absl::MutexLock l(&mu_);
+    granted_++;
+    auto handled = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return waiting_ && reads_ == granted_;
+    };
+    mu_.Await(absl::Condition(&handled));
+  }
+
+  // Time the bus was busy transmitting so far.
+  absl::Duration Airtime() {
+    absl::MutexLock l(&mu_);
+    return (reads_ + writes_) * kFrameAirtime;
+  }
+
+  bool Matches(const proto::ACUnitState &state) {
+    absl::MutexLock l(&mu_);
+    if (state.mode() == proto::MODE_OFF) return !sim_.Enabled();
+    if (state.mode() != proto::MODE_UNKNOWN &&
+        (!sim_.Enabled() || ModeName(sim_.Mode()) !=
+                                proto::Mode_Name(state.mode()))) {
+      return false;
+    }
+    if (state.fan() != proto::FAN_UNKNOWN &&
+        FanName(sim_.Fan()) != proto::Fan_Name(state.fan())) {
+      return false;
+    }
+    // Unit ignores setpoint in fan mode.
+    return state.setpoint_temperature() == 0 ||
+           state.mode() == proto::MODE_FAN ||
+           sim_.Temperature() == state.setpoint_temperature();
+  }
+
+ private:
+  static std::string ModeName(mode_t mode) {
+    return absl::StrCat("MODE_", ToString(mode));
+  }
+  static std::string FanName(fan_t fan) {
+    return absl::StrCat("FAN_", ToString(fan));
+  }
+
+  absl::Mutex mu_;
+  sim::FujiAcUnitSim sim_ ABSL_GUARDED_BY(mu_);
+  bool running_ ABSL_GUARDED_BY(mu_) = true;
+  bool waiting_ ABSL_GUARDED_BY(mu_) = false;
+  uint64_t granted_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t reads_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t writes_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+// Convergence of a single update.
+struct Convergence {
+  std::string transition;
+  // Master frames until the unit applied the update.
+  int unit_cycles = 0;
+  // Master frames until Update() returned.
+  int return_cycles = 0;
+  // Bus time until Update() returned.
+  absl::Duration airtime;
+};
+
+// Maximal cycles per transition.
+struct CycleBudget {
+  int unit_cycles;
+  int return_cycles;
+};
+
+// The unit applies our reply right away, Update() returns once the reply
+// repeated unchanged.
+constexpr CycleBudget kUpdateBudget = {1, 3};
+
+class ConvergenceTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    controller_ = FujiAcController::MakeFujiAcController(&bus_);
+    // Login is not measured here.
+    controller_->GetStatus();
+    bus_.Stop();
+  }
+
+  void TearDown() override {
+    bus_.Run();
+    controller_->Shutdown();
+  }
+
+  // Applies update while stepping the bus.
+  Convergence Measure(const proto::ACUnitState &update) {
+    Convergence result;
+    result.transition =
+        absl::StrCat(Describe(current_), " -> ", Describe(update));
+    uint64_t version;
+    controller_->GetStatus(&version);
+    std::vector<proto::StateEvent> events;
+    controller_->AwaitEvents(0, 0, absl::ZeroDuration(), &events);
+    const uint64_t run_id = events.empty() ? 0 : events.back().run_id();
+    const uint64_t seq = events.empty() ? 0 : events.back().seq();
+    const absl::Duration start = bus_.Airtime();
+
+    std::atomic<bool> returned{false};
+    std::thread client([&]() {
+      EXPECT_TRUE(controller_->Update(update).ok());
+      returned = true;
+    });
+    // Update recorded the new state, the bus may move.
+    events.clear();
+    controller_->AwaitEvents(run_id, seq, absl::Seconds(10), &events);
+
+    for (int cycle = 1; cycle <= kMaxCycles; ++cycle) {
+      bus_.Step();
+      if (result.unit_cycles == 0 && bus_.Matches(update)) {
+        result.unit_cycles = cycle;
+      }
+      // Update() returns once the state is stable, the bus is held so it
+      // can't change in the meantime.
+      if (result.return_cycles == 0 &&
+          controller_->AwaitStatusChange(version, absl::ZeroDuration())) {
+        result.return_cycles = cycle;
+        result.airtime = bus_.Airtime() - start;
+      }
+      if (result.unit_cycles > 0 && result.return_cycles > 0) break;
+    }
+    if (result.unit_cycles == 0) result.unit_cycles = kMaxCycles + 1;
+    if (result.return_cycles == 0) result.return_cycles = kMaxCycles + 1;
+    bus_.Run();
+    client.join();
+    bus_.Stop();
+    current_ = update;
+    return result;
+  }
+
+  // Measures every transition between pairs of states and checks it
+  // against the budget.
+  void CheckTransitions(const std::vector<proto::ACUnitState> &states,
+                        const CycleBudget &budget) {
+    for (const proto::ACUnitState &from : states) {
+      for (const proto::ACUnitState &to : states) {
+        if (&from == &to) continue;
+        if (Describe(current_) != Describe(from)) Measure(from);
+        Convergence result = Measure(to);
+        EXPECT_LE(result.unit_cycles, budget.unit_cycles) << result.transition;
+        EXPECT_LE(result.return_cycles, budget.return_cycles)
+            << result.transition;
+        // A master frame and our reply per cycle.
+        EXPECT_LE(result.airtime, 2 * budget.return_cycles * kFrameAirtime)
+            << result.transition;
+      }
+    }
+  }
+
+  static std::string Describe(const proto::ACUnitState &state) {
+    std::string ret = proto::Mode_Name(state.mode());
+    if (state.fan() != proto::FAN_UNKNOWN) {
+      absl::StrAppend(&ret, " ", proto::Fan_Name(state.fan()));
+    }
+    if (state.setpoint_temperature() != 0) {
+      absl::StrAppend(&ret, " ", state.setpoint_temperature());
+    }
+    return ret;
+  }
+
+  static proto::ACUnitState State(proto::Mode mode, proto::Fan fan,
+                                  int setpoint) {
+    proto::ACUnitState state;
+    state.set_mode(mode);
+    state.set_fan(fan);
+    state.set_setpoint_temperature(setpoint);
+    return state;
+  }
+
+  SteppedBus bus_;
+  std::unique_ptr<FujiAcController> controller_;
+  // Last update applied.
+  proto::ACUnitState current_;
+};
+
+TEST_F(ConvergenceTest, Mode) {
+  std::vector<proto::ACUnitState> states;
+  for (proto::Mode mode : {proto::MODE_FAN, proto::MODE_DRY, proto::MODE_COOL,
+                           proto::MODE_HEAT, proto::MODE_AUTO}) {
+    states.push_back(State(mode, proto::FAN_AUTO, 22));
+  }
+  CheckTransitions(states, kUpdateBudget);
+}
+
+TEST_F(ConvergenceTest, Power) {
+  CheckTransitions({State(proto::MODE_OFF, proto::FAN_AUTO, 22),
+                    State(proto::MODE_COOL, proto::FAN_AUTO, 22),
+                    State(proto::MODE_HEAT, proto::FAN_AUTO, 22)},
+                   kUpdateBudget);
+}
+
+TEST_F(ConvergenceTest, Fan) {
+  std::vector<proto::ACUnitState> states;
+  for (proto::Fan fan : {proto::FAN_AUTO, proto::FAN_LOW, proto::FAN_MEDIUM,
+                         proto::FAN_HIGH, proto::FAN_MAX}) {
+    states.push_back(State(proto::MODE_COOL, fan, 22));
+  }
+  CheckTransitions(states, kUpdateBudget);
+}
+
+TEST_F(ConvergenceTest, Setpoint) {
+  std::vector<proto::ACUnitState> states;
+  for (int setpoint : {16, 18, 22, 26, 30}) {
+    states.push_back(State(proto::MODE_COOL, proto::FAN_AUTO, setpoint));
+  }
+  CheckTransitions(states, kUpdateBudget);
+}
+
+TEST_F(ConvergenceTest, AllFields) {
+  CheckTransitions({State(proto::MODE_COOL, proto::FAN_LOW, 18),
+                    State(proto::MODE_HEAT, proto::FAN_MAX, 26),
+                    State(proto::MODE_OFF, proto::FAN_AUTO, 22)},
+                   kUpdateBudget);
+}
+
+}  // namespace tests
+}  // namespace fuji_iot
@@ -0,0 +1,447 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "controller/fuji_ac_client_id.h"
+#include "controller/fuji_ac_controller.grpc.pb.h"
+#include "controller/fuji_ac_service.h"
+#include "gateway/fuji_ac_gateway.h"
+#include "grpcpp/grpcpp.h"
+#include "gtest/gtest.h"
+#include "sim/fuji_ac_sim_serial.h"
+
+namespace fuji_iot {
+namespace tests {
+
+const std::vector<std::string> kUnits = {"bedroom", "kitchen", "living"};
+
+// Daemon serving simulated unit, reachable through in-process channel.
+struct Daemon {
+  sim::FujiAcSimSerial *serial;
+  std::unique_ptr<FujiACControllerServiceImpl> service;
+  std::unique_ptr<grpc::Server> server;
+};
+
+// Runs gateway in front of several in-process daemons.
+class FujiAcGatewayTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::map<std::string, std::shared_ptr<grpc::ChannelInterface>> channels;
+    for (const std::string &unit : kUnits) {
+      Daemon &daemon = daemons_[unit];
+      daemon.serial = new sim::FujiAcSimSerial(absl::Milliseconds(5));
+      daemon.service.reset(new FujiACControllerServiceImpl(
+          std::unique_ptr<FujiAcSerialInterface>(daemon.serial),
+          DaemonOptions()));
+      grpc::ServerBuilder builder;
+      builder.RegisterService(daemon.service.get());
+      daemon.server = builder.BuildAndStart();
+      channels[unit] = daemon.server->InProcessChannel(grpc::ChannelArguments());
+    }
+    gateway_.reset(new gateway::FujiAcGateway(channels));
+    grpc::ServerBuilder builder;
+    builder.RegisterService(gateway_.get());
+    server_ = builder.BuildAndStart();
+    stub_ = proto::FujiACControllerService::NewStub(
+        server_->InProcessChannel(grpc::ChannelArguments()));
+    for (const std::string &unit : kUnits) {
+      AwaitMode(unit, proto::MODE_OFF);
+    }
+  }
+
+  virtual FujiAcControllerOptions DaemonOptions() {
+    return FujiAcControllerOptions();
+  }
+
+  void TearDown() override {
+    server_->Shutdown();
+    gateway_.reset();
+    for (auto &it : daemons_) {
+      it.second.server->Shutdown();
+    }
+  }
+
+  grpc::Status GetStatus(const std::string &unit,
+                         proto::StatusResponse *response) {
+    grpc::ClientContext context;
+    proto::StatusRequest request;
+    request.set_unit(unit);
+    return stub_->GetStatus(&context, request, response);
+  }
+
+  grpc::Status Update(const std::string &unit, proto::Mode mode,
+                      proto::StatusResponse *response) {
+    grpc::ClientContext context;
+    proto::UpdateRequest request;
+    request.set_unit(unit);
+    request.mutable_new_state()->set_mode(mode);
+    return stub_->Update(&context, request, response);
+  }
+
+  // Waits until gateway serves the given mode from its cache.
+  void AwaitMode(const std::string &unit, proto::Mode mode) {
+    absl::Time deadline = absl::Now() + absl::Seconds(10);
+    while (true) {
+      proto::StatusResponse response;
+      if (gateway_->Stats().watch_updates > 0 &&
+          GetStatus(unit, &response).ok() && response.state().mode() == mode) {
+        return;
+      }
+      ASSERT_LT(absl::Now(), deadline)
+          << "Timed out waiting for " << unit << " to reach " << mode;
+      absl::SleepFor(absl::Milliseconds(10));
+    }
+  }
+
+  bool Enabled(const std::string &unit) {
+    bool enabled;
+    daemons_[unit].serial->WithSim(
+        [&](sim::FujiAcUnitSim *sim) { enabled = sim->Enabled(); });
+    return enabled;
+  }
+
+  std::map<std::string, Daemon> daemons_;
+  std::unique_ptr<gateway::FujiAcGateway> gateway_;
+  std::unique_ptr<grpc::Server> server_;
+  std::unique_ptr<proto::FujiACControllerService::Stub> stub_;
+};
+
+TEST_F(FujiAcGatewayTest, GetStatusServedFromCache) {
+  uint64_t backend_calls = gateway_->Stats().backend_calls;
+  for (int i = 0; i < 100; i++) {
+    for (const std::string &unit : kUnits) {
+      proto::StatusResponse response;
+      ASSERT_TRUE(GetStatus(unit, &response).ok());
+      EXPECT_EQ(unit, response.unit());
+      EXPECT_EQ(proto::MODE_OFF, response.state().mode());
+    }
+  }
+  EXPECT_EQ(backend_calls, gateway_->Stats().backend_calls);
+  EXPECT_LE(300, gateway_->Stats().cache_hits);
+}
+
+TEST_F(FujiAcGatewayTest, RemoteChangeReachesCache) {
+  daemons_["kitchen"].serial->WithSim(
+      [](sim::FujiAcUnitSim *sim) { sim->SetEnabled(true); });
+  AwaitMode("kitchen", proto::MODE_COOL);
+  proto::StatusResponse response;
+  ASSERT_TRUE(GetStatus("bedroom", &response).ok());
+  EXPECT_EQ(proto::MODE_OFF, response.state().mode());
+}
+
+TEST_F(FujiAcGatewayTest, UpdateRoutedToUnit) {
+  proto::StatusResponse response;
+  ASSERT_TRUE(Update("living", proto::MODE_HEAT, &response).ok());
+  EXPECT_EQ("living", response.unit());
+  EXPECT_EQ(proto::MODE_HEAT, response.state().mode());
+  EXPECT_TRUE(Enabled("living"));
+  EXPECT_FALSE(Enabled("bedroom"));
+  EXPECT_FALSE(Enabled("kitchen"));
+  // Cache already reflects the update.
+  ASSERT_TRUE(GetStatus("living", &response).ok());
+  EXPECT_EQ(proto::MODE_HEAT, response.state().mode());
+}
+
+TEST_F(FujiAcGatewayTest, ConcurrentUpdates) {
+  std::vector<std::thread> threads;
+  std::map<std::string, grpc::Status> results;
+  for (const std::string &unit : kUnits) {
+    results[unit] = grpc::Status();
+  }
+  for (const std::string &unit : kUnits) {
+    grpc::Status *result = &results[unit];
+    threads.emplace_back([this, unit, result]() {
+      proto::StatusResponse response;
+      *result = Update(unit, proto::MODE_DRY, &response);
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (const std::string &unit : kUnits) {
+    EXPECT_TRUE(results[unit].ok()) << unit;
+    EXPECT_TRUE(Enabled(unit)) << unit;
+  }
+}
+
+TEST_F(FujiAcGatewayTest, UnitSelection) {
+  proto::StatusResponse response;
+  EXPECT_EQ(grpc::StatusCode::NOT_FOUND,
+            GetStatus("garage", &response).error_code());
+  EXPECT_EQ(grpc::StatusCode::INVALID_ARGUMENT,
+            GetStatus("", &response).error_code());
+}
+
+TEST_F(FujiAcGatewayTest, WatchStatus) {
+  grpc::ClientContext context;
+  proto::WatchStatusRequest request;
+  request.set_unit("bedroom");
+  auto reader = stub_->WatchStatus(&context, request);
+  proto::StatusResponse response;
+  ASSERT_TRUE(reader->Read(&response));
+  EXPECT_EQ(proto::MODE_OFF, response.state().mode());
+  daemons_["bedroom"].serial->WithSim(
+      [](sim::FujiAcUnitSim *sim) { sim->SetEnabled(true); });
+  do {
+    ASSERT_TRUE(reader->Read(&response));
+  } while (response.state().mode() == proto::MODE_OFF);
+  EXPECT_EQ(proto::MODE_COOL, response.state().mode());
+  context.TryCancel();
+  reader->Finish();
+}
+
+TEST_F(FujiAcGatewayTest, SubscribeResumesFromCursor) {
+  proto::SubscribeRequest request;
+  request.set_unit("living");
+  proto::StateEvent event;
+  {
+    grpc::ClientContext context;
+    auto reader = stub_->Subscribe(&context, request);
+    ASSERT_TRUE(reader->Read(&event));
+    context.TryCancel();
+    reader->Finish();
+  }
+
+  // Changes made while disconnected are replayed as deltas.
+  proto::UpdateRequest update;
+  update.set_unit("living");
+  update.mutable_new_state()->set_fan(proto::FAN_LOW);
+  update.mutable_new_state()->set_setpoint_temperature(25);
+  for (const char *path : {"fan", "setpoint_temperature"}) {
+    grpc::ClientContext context;
+    update.mutable_update_mask()->clear_paths();
+    update.mutable_update_mask()->add_paths(path);
+    proto::StatusResponse response;
+    ASSERT_TRUE(stub_->Update(&context, update, &response).ok());
+  }
+
+  grpc::ClientContext context;
+  request.set_run_id(event.run_id());
+  request.set_from_seq(event.seq());
+  auto reader = stub_->Subscribe(&context, request);
+  std::vector<std::string> changed;
+  uint64_t seq = event.seq();
+  do {
+    ASSERT_TRUE(reader->Read(&event));
+    EXPECT_FALSE(event.snapshot());
+    EXPECT_EQ(++seq, event.seq());
+    EXPECT_EQ(request.run_id(), event.run_id());
+    changed.insert(changed.end(), event.changed().paths().begin(),
+                   event.changed().paths().end());
+  } while (event.state().setpoint_temperature() != 25);
+  ASSERT_LE(2, changed.size());
+  EXPECT_EQ("fan", changed[changed.size() - 2]);
+  EXPECT_EQ("setpoint_temperature", changed.back());
+  context.TryCancel();
+  reader->Finish();
+
+  // Cursor from before the daemon started falls back to a snapshot, even
+  // when its number is below the last one of this run.
+  grpc::ClientContext stale_context;
+  request.set_run_id(request.run_id() + 1);
+  request.set_from_seq(seq - 1);
+  reader = stub_->Subscribe(&stale_context, request);
+  ASSERT_TRUE(reader->Read(&event));
+  EXPECT_TRUE(event.snapshot());
+  EXPECT_EQ(seq, event.seq());
+  EXPECT_NE(request.run_id(), event.run_id());
+  EXPECT_EQ(proto::FAN_LOW, event.state().fan());
+  EXPECT_EQ(25, event.state().setpoint_temperature());
+  stale_context.TryCancel();
+  reader->Finish();
+}
+
+TEST_F(FujiAcGatewayTest, CompareAndSet) {
+  proto::StatusResponse status;
+  ASSERT_TRUE(GetStatus("kitchen", &status).ok());
+  proto::UpdateRequest request;
+  request.set_unit("kitchen");
+  request.mutable_new_state()->set_fan(proto::FAN_LOW);
+  request.mutable_update_mask()->add_paths("fan");
+  request.set_expected_version(status.version());
+  proto::StatusResponse response;
+  {
+    grpc::ClientContext context;
+    ASSERT_TRUE(stub_->Update(&context, request, &response).ok());
+  }
+  EXPECT_EQ(proto::FAN_LOW, response.state().fan());
+  EXPECT_EQ(proto::MODE_OFF, response.state().mode());
+  EXPECT_NE(status.version(), response.version());
+
+  grpc::ClientContext context;
+  request.mutable_new_state()->set_fan(proto::FAN_HIGH);
+  EXPECT_EQ(grpc::StatusCode::ABORTED,
+            stub_->Update(&context, request, &response).error_code());
+}
+
+TEST_F(FujiAcGatewayTest, GetStatusManyAllUnits) {
+  grpc::ClientContext context;
+  proto::GetStatusManyRequest request;
+  proto::GetStatusManyResponse response;
+  ASSERT_TRUE(stub_->GetStatusMany(&context, request, &response).ok());
+  ASSERT_EQ(kUnits.size(), response.results_size());
+  for (int i = 0; i < response.results_size(); i++) {
+    const proto::UnitResult &result = response.results(i);
+    EXPECT_EQ(kUnits[i], result.unit());
+    EXPECT_EQ(grpc::StatusCode::OK, result.code());
+    EXPECT_EQ(kUnits[i], result.status().unit());
+    EXPECT_EQ(proto::MODE_OFF, result.status().state().mode());
+  }
+}
+
+TEST_F(FujiAcGatewayTest, GetStatusManyUnknownUnit) {
+  grpc::ClientContext context;
+  proto::GetStatusManyRequest request;
+  request.add_units("garage");
+  request.add_units("kitchen");
+  proto::GetStatusManyResponse response;
+  ASSERT_TRUE(stub_->GetStatusMany(&context, request, &response).ok());
+  ASSERT_EQ(2, response.results_size());
+  EXPECT_EQ(grpc::StatusCode::NOT_FOUND, response.results(0).code());
+  EXPECT_FALSE(response.results(0).has_status());
+  EXPECT_EQ(grpc::StatusCode::OK, response.results(1).code());
+}
+
+TEST_F(FujiAcGatewayTest, GetStatusManyRepeatedUnit) {
+  grpc::ClientContext context;
+  proto::GetStatusManyRequest request;
+  for (int i = 0; i < 1000; i++) {
+    request.add_units("kitchen");
+  }
+  const uint64_t backend_calls = gateway_->Stats().backend_calls;
+  proto::GetStatusManyResponse response;
+  ASSERT_TRUE(stub_->GetStatusMany(&context, request, &response).ok());
+  ASSERT_EQ(1000, response.results_size());
+  for (const proto::UnitResult &result : response.results()) {
+    EXPECT_EQ("kitchen", result.unit());
+    EXPECT_EQ(grpc::StatusCode::OK, result.code());
+  }
+  // Daemon is asked once at most, whether cache is fresh or not.
+  EXPECT_GE(backend_calls + 1, gateway_->Stats().backend_calls);
+}
+
+TEST_F(FujiAcGatewayTest, UpdateMany) {
+  grpc::ClientContext context;
+  proto::UpdateManyRequest request;
+  for (const char *unit : {"living", "garage", "bedroom"}) {
+    proto::UpdateRequest *update = request.add_updates();
+    update->set_unit(unit);
+    update->mutable_new_state()->set_mode(proto::MODE_HEAT);
+    update->mutable_new_state()->set_fan(proto::FAN_LOW);
+  }
+  proto::UpdateManyResponse response;
+  ASSERT_TRUE(stub_->UpdateMany(&context, request, &response).ok());
+  ASSERT_EQ(3, response.results_size());
+  EXPECT_EQ("living", response.results(0).unit());
+  EXPECT_EQ(grpc::StatusCode::OK, response.results(0).code());
+  EXPECT_EQ(proto::MODE_HEAT, response.results(0).status().state().mode());
+  EXPECT_EQ(proto::FAN_LOW, response.results(0).status().state().fan());
+  EXPECT_EQ(grpc::StatusCode::NOT_FOUND, response.results(1).code());
+  EXPECT_EQ(grpc::StatusCode::OK, response.results(2).code());
+  EXPECT_TRUE(Enabled("living"));
+  EXPECT_TRUE(Enabled("bedroom"));
+  EXPECT_FALSE(Enabled("kitchen"));
+}
+
+TEST_F(FujiAcGatewayTest, UpdateManyRejectsDuplicates) {
+  grpc::ClientContext context;
+  proto::UpdateManyRequest request;
+  request.add_updates()->set_unit("living");
+  request.add_updates()->set_unit("living");
+  proto::UpdateManyResponse response;
+  EXPECT_EQ(grpc::StatusCode::INVALID_ARGUMENT,
+            stub_->UpdateMany(&context, request, &response).error_code());
+  EXPECT_FALSE(Enabled("living"));
+}
+
+// Peer addresses gRPC reports for callers on in-process channels, which
+// differ between its versions.
+const std::vector<std::string> kInProcessPeers = {"inproc", "unknown"};
+
+class FujiAcGatewayRateLimitTest : public FujiAcGatewayTest {
+ protected:
+  FujiAcControllerOptions DaemonOptions() override {
+    FujiAcControllerOptions options;
+    options.update_rate_limit = 0.01;
+    options.update_burst = 2;
+    options.trusted_gateway_peers = TrustedPeers();
+    return options;
+  }
+
+  virtual std::vector<std::string> TrustedPeers() { return kInProcessPeers; }
+
+  // Updates kitchen through the gateway, or straight at its daemon if
+  // direct is set.
+  grpc::Status UpdateAs(const std::string &client, int temperature,
+                        bool direct = false) {
+    grpc::ClientContext context;
+    context.AddMetadata(kClientMetadataKey, client);
+    proto::UpdateRequest request;
+    request.set_unit("kitchen");
+    if (temperature != 0) {
+      request.mutable_new_state()->set_setpoint_temperature(temperature);
+    }
+    proto::StatusResponse response;
+    if (!direct) return stub_->Update(&context, request, &response);
+    auto daemon = proto::FujiACControllerService::NewStub(
+        daemons_["kitchen"].server->InProcessChannel(
+            grpc::ChannelArguments()));
+    return daemon->Update(&context, request, &response);
+  }
+};
+
+TEST_F(FujiAcGatewayRateLimitTest, LimitsEachClient) {
+  // Gateway names its callers by address, whatever id they claim.
+  EXPECT_TRUE(UpdateAs("automation", 20).ok());
+  EXPECT_TRUE(UpdateAs("automation-1", 21).ok());
+  EXPECT_EQ(grpc::StatusCode::RESOURCE_EXHAUSTED,
+            UpdateAs("automation-2", 22).error_code());
+  // Status queries are not charged.
+  EXPECT_TRUE(UpdateAs("automation", 0).ok());
+  // Daemon takes the id a trusted gateway forwards, so limit of one client
+  // does not affect others.
+  EXPECT_TRUE(UpdateAs("phone", 23, /*direct=*/true).ok());
+
+  grpc::ClientContext context;
+  proto::MetricsRequest request;
+  request.set_unit("kitchen");
+  proto::MetricsResponse metrics;
+  ASSERT_TRUE(stub_->GetMetrics(&context, request, &metrics).ok());
+  EXPECT_EQ(1, metrics.bus().updates_rejected());
+  EXPECT_LT(0, metrics.bus().frames_per_second());
+  EXPECT_LT(0, metrics.bus().writes_per_second());
+  EXPECT_LT(0, metrics.bus().utilisation());
+}
+
+class FujiAcUntrustedPeerTest : public FujiAcGatewayRateLimitTest {
+ protected:
+  std::vector<std::string> TrustedPeers() override { return {}; }
+};
+
+TEST_F(FujiAcUntrustedPeerTest, IgnoresClaimedClient) {
+  EXPECT_TRUE(UpdateAs("a", 20, /*direct=*/true).ok());
+  EXPECT_TRUE(UpdateAs("b", 21, /*direct=*/true).ok());
+  EXPECT_EQ(grpc::StatusCode::RESOURCE_EXHAUSTED,
+            UpdateAs("c", 22, /*direct=*/true).error_code());
+}
+
+}  // namespace tests
+}  // namespace fuji_iot
@@ -12,7 +12,18 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "controller/fuji_ac_controller.h"
 #include "controller/fuji_ac_serial_interface.h"
@@ -66,6 +77,8 @@ proto::Fan FanToProtoFan(const fan_t fan) {
 class FujiAcServerTest : public testing::Test, FujiAcSerialInterface {
  public:
   virtual void WriteControllerFrame(const FujiControllerFrame &frame) {
+    writes_++;
+    absl::SleepFor(write_delay_);
     sim_->PushControllerFrame(frame);
     same_ = (last_frame_ == frame);
     last_frame_ = frame;
@@ -84,12 +97,19 @@ class FujiAcServerTest : public testing::Test, FujiAcSerialInterface {
   }
 
   void SetUp() override {
-    controller_ = std::move(FujiAcController::MakeFujiAcController(this));
+    controller_ =
+        std::move(FujiAcController::MakeFujiAcController(this, options_));
     controller_->GetStatus();
   }
 
   void TearDown() override { controller_->Shutdown(); }
 
+  // Replaces the controller, as if the daemon was restarted.
+  void RestartController() {
+    controller_->Shutdown();
+    SetUp();
+  }
+
   bool Enabled() {
     absl::MutexLock l(&mu_);
     return sim_->Enabled();
@@ -138,6 +158,10 @@ class FujiAcServerTest : public testing::Test, FujiAcSerialInterface {
   }
 
   std::unique_ptr<FujiAcController> controller_;
+  FujiAcControllerOptions options_;
+  // Simulates time needed to transmit controller frame.
+  absl::Duration write_delay_;
+  std::atomic<int> writes_{0};
 
  private:
   absl::Mutex mu_;
@@ -263,5 +287,190 @@ TEST_F(FujiAcServerTest, RaceTempChange) {
   EXPECT_EQ(proto::FAN_MEDIUM, controller_->GetStatus().fan());
 }
 
+TEST_F(FujiAcServerTest, MaskedUpdate) {
+  SetEnabled(true);
+  SetFan(fan_t::LOW);
+  AwaitRead();
+  proto::ACUnitState state;
+  state.set_mode(proto::MODE_HEAT);
+  state.set_fan(proto::FAN_HIGH);
+  google::protobuf::FieldMask mask;
+  mask.add_paths("fan");
+  EXPECT_TRUE(controller_->Update(state, mask, absl::nullopt).ok());
+  EXPECT_EQ(fan_t::HIGH, Fan());
+  EXPECT_EQ(mode_t::COOL, Mode());
+}
+
+TEST_F(FujiAcServerTest, MaskedUpdateValidation) {
+  proto::ACUnitState state;
+  google::protobuf::FieldMask mask;
+  mask.add_paths("mode");
+  EXPECT_TRUE(absl::IsInvalidArgument(
+      controller_->Update(state, mask, absl::nullopt)));
+  mask.set_paths(0, "swing");
+  state.set_mode(proto::MODE_COOL);
+  EXPECT_TRUE(absl::IsInvalidArgument(
+      controller_->Update(state, mask, absl::nullopt)));
+  EXPECT_FALSE(Enabled());
+}
+
+TEST_F(FujiAcServerTest, CompareAndSet) {
+  uint64_t version;
+  controller_->GetStatus(&version);
+  proto::ACUnitState state;
+  state.set_mode(proto::MODE_COOL);
+  google::protobuf::FieldMask mask;
+  mask.add_paths("mode");
+  EXPECT_TRUE(controller_->Update(state, mask, version).ok());
+  EXPECT_TRUE(Enabled());
+
+  // Another client still holds the old version.
+  state.set_mode(proto::MODE_OFF);
+  absl::Status status = controller_->Update(state, mask, version);
+  EXPECT_TRUE(absl::IsAborted(status)) << status;
+  EXPECT_TRUE(Enabled());
+
+  uint64_t current;
+  EXPECT_EQ(proto::MODE_COOL, controller_->GetStatus(&current).mode());
+  EXPECT_NE(version, current);
+  EXPECT_TRUE(controller_->Update(state, mask, current).ok());
+  EXPECT_FALSE(Enabled());
+}
+
+TEST_F(FujiAcServerTest, RemoteChangeBumpsVersion) {
+  uint64_t version;
+  controller_->GetStatus(&version);
+  SetEnabled(true);
+  EXPECT_TRUE(controller_->AwaitStatusChange(version, absl::Seconds(10)));
+  proto::ACUnitState state;
+  state.set_fan(proto::FAN_LOW);
+  google::protobuf::FieldMask mask;
+  mask.add_paths("fan");
+  EXPECT_TRUE(absl::IsAborted(controller_->Update(state, mask, version)));
+}
+
+TEST_F(FujiAcServerTest, SharedStatusReused) {
+  auto status = controller_->GetSharedStatus();
+  EXPECT_EQ(status, controller_->GetSharedStatus());
+  SetEnabled(true);
+  EXPECT_TRUE(controller_->AwaitStatusChange(status->version(),
+                                             absl::Seconds(10)));
+  auto changed = controller_->GetSharedStatus();
+  EXPECT_NE(status, changed);
+  EXPECT_EQ(proto::MODE_COOL, changed->state().mode());
+  EXPECT_EQ(proto::MODE_OFF, status->state().mode());
+}
+
+TEST_F(FujiAcServerTest, ConcurrentGetStatusDuringUpdate) {
+  proto::ACUnitState state;
+  state.set_mode(proto::MODE_HEAT);
+  std::thread update([&]() { EXPECT_TRUE(controller_->Update(state).ok()); });
+  std::vector<std::thread> readers;
+  std::vector<std::shared_ptr<const proto::StatusResponse>> seen(20);
+  for (auto &status : seen) {
+    readers.emplace_back([&]() { status = controller_->GetSharedStatus(); });
+  }
+  update.join();
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  auto final_status = controller_->GetSharedStatus();
+  EXPECT_EQ(proto::MODE_HEAT, final_status->state().mode());
+  for (const auto &status : seen) {
+    ASSERT_NE(nullptr, status);
+    EXPECT_LE(status->version(), final_status->version());
+  }
+}
+
+TEST_F(FujiAcServerTest, RepliesOnTime) {
+  AwaitRead();
+  auto metrics = controller_->GetReplyTimingMetrics();
+  EXPECT_GT(metrics.replies_on_time(), 0);
+  EXPECT_EQ(0, metrics.replies_late());
+  EXPECT_FALSE(metrics.late_mode());
+}
+
+// Replies that take longer than response window are counted as late, but
+// controller keeps working.
+class FujiAcServerLateReplyTest : public FujiAcServerTest {
+ protected:
+  FujiAcServerLateReplyTest() {
+    options_.reply_window = absl::Milliseconds(1);
+    write_delay_ = absl::Milliseconds(2);
+  }
+};
+
+TEST_F(FujiAcServerLateReplyTest, CountsLateReplies) {
+  proto::ACUnitState state;
+  state.set_mode(proto::MODE_HEAT);
+  EXPECT_TRUE(controller_->Update(state).ok());
+  EXPECT_EQ(mode_t::HEAT, Mode());
+  auto metrics = controller_->GetReplyTimingMetrics();
+  EXPECT_EQ(0, metrics.replies_on_time());
+  EXPECT_GT(metrics.replies_late(), 0);
+  EXPECT_GE(metrics.max_turnaround_us(), 2000);
+  EXPECT_TRUE(metrics.late_mode());
+}
+
+// Main unit keeps sending status to the wired controller address even though
+// nobody answers, as it would to an original remote.
+class FujiAcServerListenOnlyTest : public FujiAcServerTest {
+ protected:
+  FujiAcServerListenOnlyTest() { options_.listen_only = true; }
+};
+
+TEST_F(FujiAcServerListenOnlyTest, FollowsRemoteWithoutWriting) {
+  EXPECT_EQ(proto::MODE_OFF, controller_->GetStatus().mode());
+  SetEnabled(true);
+  SetTemperature(24);
+  AwaitRead();
+  auto state = controller_->GetStatus();
+  EXPECT_EQ(proto::MODE_COOL, state.mode());
+  EXPECT_EQ(24, state.setpoint_temperature());
+
+  auto devices = controller_->GetBusDevices();
+  ASSERT_EQ(1, devices.devices_size());
+  EXPECT_EQ(32, devices.devices(0).address());
+  EXPECT_EQ(proto::MODE_COOL, devices.devices(0).state().mode());
+  EXPECT_LT(0, devices.devices(0).frames());
+  EXPECT_EQ(0, writes_);
+}
+
+TEST_F(FujiAcServerListenOnlyTest, RejectsUpdates) {
+  proto::ACUnitState state;
+  EXPECT_TRUE(controller_->Update(state).ok());
+  state.set_mode(proto::MODE_HEAT);
+  EXPECT_TRUE(absl::IsFailedPrecondition(controller_->Update(state)));
+  AwaitRead();
+  EXPECT_FALSE(Enabled());
+  EXPECT_EQ(0, writes_);
+}
+
+// Login session is kept in a file, restarted controller skips the login
+// exchange with a main unit that still lists it.
+class FujiAcServerSessionTest : public FujiAcServerTest {
+ protected:
+  FujiAcServerSessionTest() {
+    const char *dir = getenv("TEST_TMPDIR");
+    options_.session_file =
+        std::string(dir != nullptr ? dir : "/tmp") + "/fuji_session";
+    unlink(options_.session_file.c_str());
+  }
+};
+
+TEST_F(FujiAcServerSessionTest, RestartResumesSession) {
+  auto metrics = controller_->GetSessionMetrics();
+  EXPECT_FALSE(metrics.resumed());
+  EXPECT_EQ(1, metrics.full_logins());
+  EXPECT_EQ(3, metrics.frames_to_first_status());
+
+  RestartController();
+  metrics = controller_->GetSessionMetrics();
+  EXPECT_TRUE(metrics.resumed());
+  EXPECT_EQ(0, metrics.full_logins());
+  EXPECT_EQ(0, metrics.fast_logins());
+  EXPECT_EQ(1, metrics.frames_to_first_status());
+}
+
 }  // namespace tests
 }  // namespace fuji_iot
@@ -0,0 +1,92 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+#include "sim/fuji_ac_scenario.h"
+
+namespace fuji_iot {
+namespace tests {
+
+// Scenario files are data dependencies, relative to the runfiles root.
+constexpr char kScenarioDir[] = "tests/scenarios/";
+
+class ScenarioTest : public ::testing::TestWithParam<std::string> {};
+
+TEST_P(ScenarioTest, Passes) {
+  sim::Scenario scenario;
+  absl::Status status =
+      sim::LoadScenario(kScenarioDir + GetParam() + ".scenario", &scenario);
+  ASSERT_TRUE(status.ok()) << status;
+  sim::ScenarioResult result = sim::RunScenario(scenario);
+  EXPECT_TRUE(result.ok()) << result.Report();
+  ASSERT_EQ(result.phases.size(), scenario.phases.size());
+  for (const sim::PhaseResult &phase : result.phases) {
+    for (const auto &op : phase.ops) {
+      if (op.first == "get_status") {
+        EXPECT_EQ(op.second.errors, 0u);
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Scenarios, ScenarioTest,
+                         ::testing::Values("remote_and_clients",
+                                           "update_burst", "faults"));
+
+TEST(ScenarioParserTest, Parses) {
+  sim::Scenario scenario;
+  ASSERT_TRUE(sim::ParseScenario(R"(
+      frame_interval 2ms  # fast
+      seed 3
+      phase one
+      clients 3 update setpoint 20..22 count 5 every 1ms
+      expect status fan auto within 1s
+      phase two
+      fault silence
+  )",
+                                 &scenario)
+                  .ok());
+  EXPECT_EQ(scenario.frame_interval, absl::Milliseconds(2));
+  EXPECT_EQ(scenario.seed, 3);
+  ASSERT_EQ(scenario.phases.size(), 2);
+  const sim::ScenarioCommand &clients = scenario.phases[0].commands[0];
+  EXPECT_EQ(clients.kind, sim::ScenarioCommand::CLIENTS);
+  EXPECT_EQ(clients.clients, 3);
+  EXPECT_EQ(clients.count, 5);
+  EXPECT_EQ(clients.values.size(), 3);
+  EXPECT_EQ(clients.duration, absl::Milliseconds(1));
+  EXPECT_EQ(scenario.phases[0].commands[1].duration, absl::Seconds(1));
+  EXPECT_EQ(scenario.phases[1].commands[0].fault, sim::FaultClass::SILENCE);
+}
+
+TEST(ScenarioParserTest, ReportsLine) {
+  sim::Scenario scenario;
+  for (const char *text : {"remote power on", "phase a\nremote power maybe",
+                           "phase a\nupdate swing on", "phase a\nfault fire",
+                           "phase a\nseed 1", "phase a\nsleep soon",
+                           "phase a\nclients 2 get_status"}) {
+    absl::Status status = sim::ParseScenario(text, &scenario);
+    EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument) << text;
+  }
+  absl::Status status =
+      sim::ParseScenario("phase a\n\nexpect unit mode warm", &scenario);
+  EXPECT_EQ(status.message(), "line 3: unknown mode warm");
+}
+
+}  // namespace tests
+}  // namespace fuji_iot
@@ -0,0 +1,244 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hundreds of clients calling the controller concurrently, while the IR
+// remote changes the unit and the daemon restarts, some of them right
+// through the shutdown. Meant to be run with --config=tsan as well. Reports
+// throughput and latency of every call.
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "controller/fuji_ac_controller.h"
+#include "gtest/gtest.h"
+#include "sim/fuji_ac_sim_serial.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace tests {
+
+constexpr int kClients = 200;
+constexpr absl::Duration kDuration = absl::Seconds(3);
+constexpr absl::Duration kFrameInterval = absl::Milliseconds(1);
+constexpr absl::Duration kRemoteInterval = absl::Milliseconds(20);
+constexpr absl::Duration kRestartInterval = absl::Milliseconds(500);
+// Fraction of calls that are updates, the rest reads the status.
+constexpr double kUpdateFraction = 0.2;
+// Every this many clients one keeps calling while the controller shuts down,
+// like RPCs in flight when the daemon stops. Others hold restarts off.
+constexpr int kRacingClientEvery = 4;
+
+enum Op { GET_STATUS, GET_SHARED_STATUS, UPDATE, kOps };
+constexpr const char *kOpNames[kOps] = {"GetStatus", "GetSharedStatus",
+                                        "Update"};
+
+// Latencies recorded by one client.
+struct ClientLatencies {
+  std::vector<absl::Duration> op[kOps];
+  int failed_updates = 0;
+  // Updates cut short by a shutdown.
+  int interrupted_updates = 0;
+};
+
+proto::ACUnitState RandomUpdate(std::mt19937 *random) {
+  static constexpr proto::Mode kModes[] = {
+      proto::MODE_FAN, proto::MODE_DRY, proto::MODE_COOL, proto::MODE_HEAT,
+      proto::MODE_AUTO, proto::MODE_OFF};
+  static constexpr proto::Fan kFans[] = {proto::FAN_AUTO, proto::FAN_LOW,
+                                         proto::FAN_MEDIUM, proto::FAN_HIGH,
+                                         proto::FAN_MAX};
+  proto::ACUnitState state;
+  switch ((*random)() % 3) {
+    case 0:
+      state.set_mode(kModes[(*random)() % 6]);
+      break;
+    case 1:
+      state.set_fan(kFans[(*random)() % 5]);
+      break;
+    default:
+      state.set_setpoint_temperature(16 + (*random)() % 15);
+      break;
+  }
+  return state;
+}
+
+class StressTest : public testing::Test {
+ protected:
+  StressTest() : bus_(kFrameInterval) {}
+
+  void StartController() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    controller_ = FujiAcController::MakeFujiAcController(&bus_);
+  }
+
+  void RunClient(int id, ClientLatencies *latencies) {
+    std::mt19937 random(id);
+    const bool racing = id % kRacingClientEvery == 0;
+    // Racing clients keep their controller alive, and keep calling it while
+    // it shuts down until a new one is started.
+    std::shared_ptr<FujiAcController> controller;
+    auto has_controller = [this]() ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+      return controller_ != nullptr;
+    };
+    while (!done_) {
+      if (racing) {
+        {
+          absl::ReaderMutexLock l(&mu_);
+          if (controller_ != nullptr) controller = controller_;
+        }
+        Call(controller.get(), /*racing=*/true, &random, latencies);
+      } else {
+        // Holds the controller shared for the call, restarts wait for it to
+        // take it away.
+        absl::ReaderMutexLock l(&mu_, absl::Condition(&has_controller));
+        Call(controller_.get(), /*racing=*/false, &random, latencies);
+      }
+    }
+  }
+
+  void Call(FujiAcController *controller, bool racing, std::mt19937 *random,
+            ClientLatencies *latencies) {
+    std::uniform_real_distribution<double> dist;
+    absl::Time start = absl::Now();
+    Op op;
+    if (dist(*random) < kUpdateFraction) {
+      op = UPDATE;
+      absl::Status status = controller->Update(RandomUpdate(random));
+      if (racing && absl::IsUnavailable(status)) {
+        latencies->interrupted_updates++;
+      } else if (!status.ok()) {
+        latencies->failed_updates++;
+      }
+    } else if ((*random)() % 2 == 0) {
+      op = GET_STATUS;
+      controller->GetStatus();
+    } else {
+      op = GET_SHARED_STATUS;
+      controller->GetSharedStatus();
+    }
+    latencies->op[op].push_back(absl::Now() - start);
+  }
+
+  void RunRemote() {
+    std::mt19937 random(kClients);
+    while (!done_) {
+      absl::SleepFor(kRemoteInterval);
+      bus_.WithSim([&random](sim::FujiAcUnitSim *unit) {
+        unit->SetFan(static_cast<fan_t>(random() % 5));
+        unit->SetTemperature(16 + random() % 15);
+      });
+    }
+  }
+
+  void RunRestarts() {
+    while (!done_) {
+      absl::SleepFor(kRestartInterval);
+      // Only the swap is serialised with clients, racing ones may be calling
+      // the old controller during Shutdown(). Whoever is last destroys it.
+      std::shared_ptr<FujiAcController> old;
+      {
+        absl::MutexLock l(&mu_);
+        old = std::move(controller_);
+      }
+      old->Shutdown();
+      old.reset();
+      absl::MutexLock l(&mu_);
+      StartController();
+      restarts_++;
+    }
+  }
+
+  sim::FujiAcSimSerial bus_;
+  std::atomic<bool> done_{false};
+  int restarts_ = 0;
+  absl::Mutex mu_;
+  std::shared_ptr<FujiAcController> controller_ ABSL_GUARDED_BY(mu_);
+};
+
+TEST_F(StressTest, MixedCallsRemoteAndRestarts) {
+  {
+    absl::MutexLock l(&mu_);
+    StartController();
+  }
+  std::vector<ClientLatencies> latencies(kClients);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kClients; ++i) {
+    threads.emplace_back([this, i, &latencies]() {
+      RunClient(i, &latencies[i]);
+    });
+  }
+  threads.emplace_back([this]() { RunRemote(); });
+  threads.emplace_back([this]() { RunRestarts(); });
+  absl::Time start = absl::Now();
+  absl::SleepFor(kDuration);
+  done_ = true;
+  for (std::thread &thread : threads) thread.join();
+  absl::Duration elapsed = absl::Now() - start;
+
+  std::cout << absl::StrFormat("%d clients, %d restarts in %s\n", kClients,
+                               restarts_, absl::FormatDuration(elapsed));
+  std::cout << absl::StrFormat("%-16s %8s %9s %9s %9s %9s\n", "call", "calls",
+                               "calls/s", "p50_ms", "p99_ms", "max_ms");
+  int failed_updates = 0, interrupted_updates = 0;
+  for (int op = 0; op < kOps; ++op) {
+    std::vector<absl::Duration> all;
+    for (const ClientLatencies &client : latencies) {
+      all.insert(all.end(), client.op[op].begin(), client.op[op].end());
+    }
+    ASSERT_FALSE(all.empty()) << kOpNames[op];
+    std::sort(all.begin(), all.end());
+    std::cout << absl::StrFormat(
+        "%-16s %8d %9.1f %9.2f %9.2f %9.2f\n", kOpNames[op], all.size(),
+        all.size() / absl::ToDoubleSeconds(elapsed),
+        absl::ToDoubleMilliseconds(all[(all.size() - 1) / 2]),
+        absl::ToDoubleMilliseconds(all[(all.size() - 1) * 99 / 100]),
+        absl::ToDoubleMilliseconds(all.back()));
+  }
+  for (const ClientLatencies &client : latencies) {
+    failed_updates += client.failed_updates;
+    interrupted_updates += client.interrupted_updates;
+  }
+  std::cout << absl::StrFormat("%d updates interrupted by shutdown\n",
+                               interrupted_updates);
+  EXPECT_EQ(failed_updates, 0);
+  EXPECT_GT(restarts_, 0);
+
+  // Once everybody is gone, the daemon agrees with the unit. Mode is set too,
+  // since the setpoint is fixed in FAN mode, which clients may have left.
+  absl::MutexLock l(&mu_);
+  proto::ACUnitState update;
+  update.set_mode(proto::MODE_COOL);
+  update.set_setpoint_temperature(21);
+  ASSERT_TRUE(controller_->Update(update).ok());
+  EXPECT_EQ(controller_->GetStatus().setpoint_temperature(), 21);
+  uint8_t temperature = 0;
+  bus_.WithSim([&temperature](sim::FujiAcUnitSim *unit) {
+    temperature = unit->Temperature();
+  });
+  EXPECT_EQ(temperature, 21);
+  controller_->Shutdown();
+}
+
+}  // namespace tests
+}  // namespace fuji_iot
@@ -0,0 +1,116 @@
+// Copyright 2020 Fuji-Iot authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <functional>
+#include <memory>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "controller/fuji_ac_controller.h"
+#include "controller/fuji_ac_tcp_serial.h"
+#include "gtest/gtest.h"
+#include "sim/fuji_ac_tcp_bridge_sim.h"
+#include "sim/fuji_ac_unit_sim.h"
+
+namespace fuji_iot {
+namespace tests {
+
+// Runs FujiAcController over FujiAcTcpSerial connected to a simulated bridge.
+class FujiAcTcpTransportTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    bridge_ = std::unique_ptr<sim::FujiAcTcpBridgeSim>(
+        new sim::FujiAcTcpBridgeSim());
+    FujiAcTcpSerialOptions options;
+    options.host = "localhost";
+    options.port = bridge_->Port();
+    options.frame_gap = absl::Milliseconds(50);
+    options.reply_delay = absl::ZeroDuration();
+    options.min_backoff = absl::Milliseconds(10);
+    serial_ = FujiAcTcpSerial::Build(options);
+    controller_ = FujiAcController::MakeFujiAcController(serial_.get());
+    controller_->GetStatus();
+  }
+
+  void TearDown() override {
+    controller_->Shutdown();
+    controller_.reset();
+    serial_.reset();
+    bridge_.reset();
+  }
+
+  bool Enabled() {
+    bool enabled;
+    bridge_->WithSim([&](sim::FujiAcUnitSim *sim) { enabled = sim->Enabled(); });
+    return enabled;
+  }
+
+  // Turns the unit on via controller and verifies the simulated unit agrees.
+  void TurnOnViaController() {
+    proto::ACUnitState state;
+    state.set_mode(proto::MODE_COOL);
+    EXPECT_TRUE(controller_->Update(state).ok());
+    EXPECT_TRUE(Enabled());
+  }
+
+  // Waits until controller reports mode, fails after timeout.
+  void AwaitMode(proto::Mode mode) {
+    absl::Time deadline = absl::Now() + absl::Seconds(10);
+    while (controller_->GetStatus().mode() != mode) {
+      ASSERT_LT(absl::Now(), deadline) << "Timed out waiting for " << mode;
+      absl::SleepFor(absl::Milliseconds(10));
+    }
+  }
+
+  std::unique_ptr<sim::FujiAcTcpBridgeSim> bridge_;
+  std::unique_ptr<FujiAcTcpSerial> serial_;
+  std::unique_ptr<FujiAcController> controller_;
+};
+
+TEST_F(FujiAcTcpTransportTest, GetStatus) {
+  auto state = controller_->GetStatus();
+  EXPECT_EQ(proto::MODE_OFF, state.mode());
+  EXPECT_EQ(1, serial_->LineStats()->connects);
+}
+
+TEST_F(FujiAcTcpTransportTest, TurnOnViaController) {
+  EXPECT_FALSE(Enabled());
+  TurnOnViaController();
+}
+
+TEST_F(FujiAcTcpTransportTest, TurnOnViaRemote) {
+  bridge_->WithSim([](sim::FujiAcUnitSim *sim) { sim->SetEnabled(true); });
+  AwaitMode(proto::MODE_COOL);
+}
+
+TEST_F(FujiAcTcpTransportTest, FrameSplitIntoBytes) {
+  bridge_->SetByteDelay(absl::Milliseconds(5));
+  TurnOnViaController();
+  EXPECT_EQ(0, serial_->LineStats()->frames_incomplete);
+}
+
+TEST_F(FujiAcTcpTransportTest, ResyncAfterPartialFrame) {
+  bridge_->InjectPartialFrame(3, absl::Milliseconds(150));
+  TurnOnViaController();
+  EXPECT_EQ(1, serial_->LineStats()->frames_incomplete);
+}
+
+TEST_F(FujiAcTcpTransportTest, Reconnect) {
+  bridge_->DropConnection();
+  TurnOnViaController();
+  EXPECT_EQ(2, serial_->LineStats()->connects);
+}
+
+}  // namespace tests
+}  // namespace fuji_iot